@@ -0,0 +1,264 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+/* Benchmarks for uqwordiply, run against a generated dictionary of random
+ * lower case words, 3 to 10 letters long
+ *
+ * Usage: bench [--binary path] [--words n] [--guesses n] guesses|load
+ *
+ * load: Times a game with no guesses, from start to exit, which is the time
+ * to load the dictionary and build the tables over it, and prints the
+ * game's peak resident memory
+ *
+ * guesses: Times a game with the starter word ABC and 2000 guesses which
+ * contain it but are too long to be words, and the same game with no
+ * guesses, which is just the time to load the dictionary. On a fast build
+ * the guesses take little time next to loading, so give it more of them
+ *
+ * --binary runs another build (such as solution/uqwordiply, or that of an
+ * older commit to compare with) in place of ./uqwordiply, and --words sets
+ * the size of the dictionary
+ */
+
+// Defaults for the build to run and the number of words in the dictionary
+#define DEFAULT_BINARY "./uqwordiply"
+#define DEFAULT_WORDS 3000000
+// Seed for the dictionary and the guesses, so every run is the same
+#define SEED 2310
+// Bounds on the length of the dictionary's words
+#define MIN_WORD 3
+#define MAX_WORD 10
+// Starter word, and the guesses made in the guesses benchmark. Each is the
+// starter followed by random letters, longer than any dictionary word
+#define STARTER "ABC"
+#define DEFAULT_GUESSES 2000
+#define GUESS_LENGTH 20
+// Runs of each measurement, of which the fastest is printed
+#define RUNS 3
+#define US_PER_SEC 1000000.0
+#define NS_PER_SEC 1000000000.0
+
+// Typedefs
+// struct for one run of uqwordiply, how long it took and its peak memory
+typedef struct {
+    double seconds;
+    long maxRssKb;
+} Run;
+
+// Method declarations
+void print_usage(void);
+void random_word(char*, int);
+char* write_temp(const char*, int, bool);
+Run run_game(const char*, const char*, const char*);
+Run best_run(const char*, const char*, const char*);
+void bench_guesses(const char*, const char*, int);
+void bench_load(const char*, const char*);
+
+/* main()
+ * ------
+ * This function generates the dictionary, runs the benchmark and removes
+ * the files it made
+ *
+ * Returns: 0
+ * Errors: exits with code 1 if the arguments are invalid, and 2 if the
+ * build cannot be run
+*/
+int main(int argc, char* argv[]) {
+    const char* binary = DEFAULT_BINARY;
+    int words = DEFAULT_WORDS;
+    int guesses = DEFAULT_GUESSES;
+    int arg = 1;
+    for (; arg + 1 < argc && strncmp(argv[arg], "--", 2) == 0; arg += 2) {
+        if (strcmp(argv[arg], "--binary") == 0) {
+            binary = argv[arg + 1];
+        } else if (strcmp(argv[arg], "--words") == 0 &&
+                atoi(argv[arg + 1]) > 0) {
+            words = atoi(argv[arg + 1]);
+        } else if (strcmp(argv[arg], "--guesses") == 0 &&
+                atoi(argv[arg + 1]) > 0) {
+            guesses = atoi(argv[arg + 1]);
+        } else {
+            print_usage();
+        }
+    }
+    if (arg != argc - 1 || (strcmp(argv[arg], "guesses") != 0 &&
+            strcmp(argv[arg], "load") != 0)) {
+        print_usage();
+    }
+    if (access(binary, X_OK) != 0) {
+        fprintf(stderr, "bench: cannot run %s\n", binary);
+        exit(2);
+    }
+    srand(SEED);
+    char* dictionary = write_temp("bench-dict", words, false);
+    printf("%s, %d word dictionary\n", binary, words);
+    if (strcmp(argv[arg], "load") == 0) {
+        bench_load(binary, dictionary);
+    } else {
+        bench_guesses(binary, dictionary, guesses);
+    }
+    unlink(dictionary);
+    free(dictionary);
+    return 0;
+}
+
+/* print_usage()
+ * -------------
+ * This function prints the usage message and exits with code 1
+*/
+void print_usage(void) {
+    fprintf(stderr, "Usage: bench [--binary path] [--words n] "
+            "[--guesses n] guesses|load\n");
+    exit(1);
+}
+
+/* random_word()
+ * -------------
+ * This function makes a random lower case word
+ *
+ * word: Where to write the word, with room for length letters and a
+ * terminator
+ *
+ * length: The number of letters
+*/
+void random_word(char* word, int length) {
+    for (int i = 0; i < length; i++) {
+        word[i] = 'a' + rand() % 26;
+    }
+    word[length] = '\0';
+}
+
+/* write_temp()
+ * ------------
+ * This function writes a file of random words, one per line, in the current
+ * directory
+ *
+ * prefix: The start of the file's name
+ *
+ * count: The number of words
+ *
+ * guesses: true for guesses (the starter word and random letters), false
+ * for dictionary words
+ *
+ * Returns: The malloc'd path of the file
+*/
+char* write_temp(const char* prefix, int count, bool guesses) {
+    char* path = malloc(strlen(prefix) + sizeof("-XXXXXX"));
+    sprintf(path, "%s-XXXXXX", prefix);
+    int fd = mkstemp(path);
+    FILE* file = fd < 0 ? NULL : fdopen(fd, "w");
+    if (file == NULL) {
+        fprintf(stderr, "bench: cannot write %s\n", path);
+        exit(2);
+    }
+    char word[GUESS_LENGTH + 1];
+    for (int i = 0; i < count; i++) {
+        if (guesses) {
+            strcpy(word, STARTER);
+            random_word(word + strlen(STARTER),
+                    GUESS_LENGTH - strlen(STARTER));
+        } else {
+            random_word(word, MIN_WORD + rand() % (MAX_WORD - MIN_WORD + 1));
+        }
+        fprintf(file, "%s\n", word);
+    }
+    fclose(file);
+    return path;
+}
+
+/* run_game()
+ * ----------
+ * This function runs one game of the build with its output discarded
+ *
+ * binary: The build to run
+ *
+ * dictionary: The dictionary to give it
+ *
+ * input: The file of guesses to play, or /dev/null for none
+ *
+ * Returns: How long the game took and its peak memory
+*/
+Run run_game(const char* binary, const char* dictionary, const char* input) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pid_t pid = fork();
+    if (pid == 0) {
+        int in = open(input, O_RDONLY);
+        int out = open("/dev/null", O_WRONLY);
+        dup2(in, STDIN_FILENO);
+        dup2(out, STDOUT_FILENO);
+        dup2(out, STDERR_FILENO);
+        execl(binary, binary, "--start", STARTER, "--dictionary", dictionary,
+                NULL);
+        _exit(2);
+    }
+    int status;
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    Run run = {.seconds = end.tv_sec - start.tv_sec +
+            (end.tv_nsec - start.tv_nsec) / NS_PER_SEC,
+            .maxRssKb = usage.ru_maxrss};
+    return run;
+}
+
+/* best_run()
+ * ----------
+ * This function runs the same game RUNS times
+ *
+ * binary, dictionary, input: As for run_game()
+ *
+ * Returns: The fastest run
+*/
+Run best_run(const char* binary, const char* dictionary, const char* input) {
+    Run best = run_game(binary, dictionary, input);
+    for (int i = 1; i < RUNS; i++) {
+        Run run = run_game(binary, dictionary, input);
+        best = run.seconds < best.seconds ? run : best;
+    }
+    return best;
+}
+
+/* bench_guesses()
+ * ---------------
+ * This function times a game of guesses against loading alone, and prints
+ * the time each guess took
+ *
+ * binary: The build to run
+ *
+ * dictionary: The dictionary to give it
+ *
+ * count: The number of guesses
+*/
+void bench_guesses(const char* binary, const char* dictionary, int count) {
+    char* guesses = write_temp("bench-guesses", count, true);
+    Run load = best_run(binary, dictionary, "/dev/null");
+    Run game = best_run(binary, dictionary, guesses);
+    printf("load alone %.3f s, %d guesses %.3f s, %.1f us per guess\n",
+            load.seconds, count, game.seconds,
+            (game.seconds - load.seconds) * US_PER_SEC / count);
+    unlink(guesses);
+    free(guesses);
+}
+
+/* bench_load()
+ * ------------
+ * This function times a game with no guesses, and prints its peak memory
+ *
+ * binary: The build to run
+ *
+ * dictionary: The dictionary to give it
+*/
+void bench_load(const char* binary, const char* dictionary) {
+    Run load = best_run(binary, dictionary, "/dev/null");
+    printf("startup %.3f s, peak RSS %.1f MB\n", load.seconds,
+            load.maxRssKb / 1024.0);
+}
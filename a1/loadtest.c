@@ -0,0 +1,350 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+
+/* Load test for uqwordiply's server mode (--port or --unix)
+ *
+ * Usage: loadtest [--games n] [--clients n] [--idle n --pid pid]
+ *          address guess...
+ *
+ * address is a port on this host, or a path (containing a '/') to a Unix
+ * socket. The guesses must all be valid for the server's starter word and
+ * dictionary, so that every game ends after them. Each of the clients plays
+ * its share of the games one after another, sending every guess at once and
+ * reading until the server ends the game, and the games per second are
+ * printed. With --idle, that many games are then left open at once without
+ * guessing, and the growth in the server's resident memory (read from /proc
+ * for --pid) is printed per game
+ */
+
+// Defaults for the number of games to play and the clients to play them
+#define DEFAULT_GAMES 10000
+#define DEFAULT_CLIENTS 1
+// Printed by the server at the end of every game
+#define RESULTS_LINE "Longest word(s) possible"
+// Size of the buffer each game's output is read into
+#define READ_SIZE 4096
+// Seconds to wait for the server before giving up on a game, which only
+// happens if a guess is not valid, as the game then waits for another, or
+// if the server is already playing as many games as it will
+#define GAME_TIMEOUT 10
+#define NS_PER_SEC 1000000000.0
+
+// Typedefs
+// struct for the options, and the guesses every game sends as one block
+typedef struct {
+    int games;
+    int clients;
+    int idle;
+    int pid;
+    const char* address;
+    char* guesses;
+} Options;
+
+// struct for a client thread, counting the games it finished
+typedef struct {
+    const Options* options;
+    int games;
+    int finished;
+    pthread_t thread;
+} Client;
+
+// Method declarations
+Options parse_options(int, char**);
+void print_usage(void);
+int connect_server(const char*);
+bool play_one(const Options*);
+void* client_thread(void*);
+long server_rss(int);
+double now_seconds(void);
+void play_games(const Options*);
+void hold_idle(const Options*);
+
+/* main()
+ * ------
+ * This function plays the games, then holds the idle ones if asked to
+ *
+ * Returns: 0
+ * Errors: exits with code 1 if the options are invalid, and 2 if the server
+ * cannot be connected to
+*/
+int main(int argc, char* argv[]) {
+    Options options = parse_options(argc, argv);
+    int fd = connect_server(options.address);
+    if (fd < 0) {
+        fprintf(stderr, "loadtest: unable to connect to %s\n",
+                options.address);
+        exit(2);
+    }
+    close(fd);
+    if (options.games > 0) {
+        play_games(&options);
+    }
+    if (options.idle > 0) {
+        hold_idle(&options);
+    }
+    free(options.guesses);
+    return 0;
+}
+
+/* parse_options()
+ * ---------------
+ * This function reads the command line, joining the guesses into the lines
+ * each game sends
+ *
+ * argc: The number of arguments
+ *
+ * argv: The arguments
+ *
+ * Returns: The options
+*/
+Options parse_options(int argc, char* argv[]) {
+    Options options = {.games = DEFAULT_GAMES, .clients = DEFAULT_CLIENTS,
+            .idle = 0, .pid = 0};
+    struct option longOpt[] = {
+        {"games", required_argument, NULL, 'g'},
+        {"clients", required_argument, NULL, 'c'},
+        {"idle", required_argument, NULL, 'i'},
+        {"pid", required_argument, NULL, 'p'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", longOpt, NULL)) != -1) {
+        int value = atoi(optarg != NULL ? optarg : "");
+        if (opt == 'g' && value >= 0) {
+            options.games = value;
+        } else if (opt == 'c' && value > 0) {
+            options.clients = value;
+        } else if (opt == 'i' && value >= 0) {
+            options.idle = value;
+        } else if (opt == 'p' && value > 0) {
+            options.pid = value;
+        } else {
+            print_usage();
+        }
+    }
+    // guesses are only needed to play games
+    if (argc - optind < (options.games > 0 ? 2 : 1) ||
+            (options.idle > 0 && options.pid == 0)) {
+        print_usage();
+    }
+    options.address = argv[optind++];
+    size_t length = 1;
+    for (int i = optind; i < argc; i++) {
+        length += strlen(argv[i]) + 1;
+    }
+    options.guesses = malloc(length);
+    options.guesses[0] = '\0';
+    for (int i = optind; i < argc; i++) {
+        strcat(strcat(options.guesses, argv[i]), "\n");
+    }
+    return options;
+}
+
+/* print_usage()
+ * -------------
+ * This function prints the usage message and exits with code 1
+*/
+void print_usage(void) {
+    fprintf(stderr, "Usage: loadtest [--games n] [--clients n] "
+            "[--idle n --pid pid] address guess...\n");
+    exit(1);
+}
+
+/* connect_server()
+ * ----------------
+ * This function connects to the server
+ *
+ * address: A port on this host, or the path of a Unix socket
+ *
+ * Returns: The connected socket, or -1 if it could not be connected
+*/
+int connect_server(const char* address) {
+    int fd = -1;
+    if (strchr(address, '/') != NULL) {
+        struct sockaddr_un addr = {.sun_family = AF_UNIX};
+        strncpy(addr.sun_path, address, sizeof(addr.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr*) &addr,
+                sizeof(addr)) < 0) {
+            close(fd);
+            fd = -1;
+        }
+        return fd;
+    }
+    struct addrinfo hints;
+    struct addrinfo* ai = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo("localhost", address, &hints, &ai) != 0) {
+        return -1;
+    }
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(ai);
+    return fd;
+}
+
+/* play_one()
+ * ----------
+ * This function plays a game, sending every guess and reading until the
+ * server closes the connection
+ *
+ * options: The options, with the server's address and the guesses
+ *
+ * Returns: true if the game ended with its results
+*/
+bool play_one(const Options* options) {
+    int fd = connect_server(options->address);
+    if (fd < 0) {
+        return false;
+    }
+    struct timeval timeout = {.tv_sec = GAME_TIMEOUT};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    size_t sendLength = strlen(options->guesses);
+    bool sent = write(fd, options->guesses, sendLength) ==
+            (ssize_t) sendLength;
+    // the results are the last thing sent, but may be split across reads,
+    // so keep the tail of each read in front of the next one
+    char buffer[sizeof(RESULTS_LINE) + READ_SIZE];
+    size_t kept = 0;
+    bool results = false;
+    ssize_t got;
+    while (sent && (got = read(fd, buffer + kept, READ_SIZE)) > 0) {
+        size_t length = kept + got;
+        buffer[length] = '\0';
+        results = results || strstr(buffer, RESULTS_LINE) != NULL;
+        kept = length < sizeof(RESULTS_LINE) - 1 ? length :
+                sizeof(RESULTS_LINE) - 1;
+        memmove(buffer, buffer + length - kept, kept);
+    }
+    close(fd);
+    return results;
+}
+
+/* client_thread()
+ * ---------------
+ * This function plays one client's share of the games, one after another
+ *
+ * arg: The Client
+ *
+ * Returns: NULL
+*/
+void* client_thread(void* arg) {
+    Client* client = arg;
+    for (int i = 0; i < client->games; i++) {
+        client->finished += play_one(client->options);
+    }
+    return NULL;
+}
+
+/* server_rss()
+ * ------------
+ * This function reads a process's resident memory from /proc
+ *
+ * pid: The process
+ *
+ * Returns: Its resident memory in kB, or -1 if it could not be read
+*/
+long server_rss(int pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    char line[256];
+    long rss = -1;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (sscanf(line, "VmRSS: %ld", &rss) == 1) {
+            break;
+        }
+    }
+    fclose(file);
+    return rss;
+}
+
+/* now_seconds()
+ * -------------
+ * Returns: The time on the monotonic clock, in seconds
+*/
+double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / NS_PER_SEC;
+}
+
+/* play_games()
+ * ------------
+ * This function shares the games out between the clients, plays them all at
+ * once and prints how many ended with their results, and how fast
+ *
+ * options: The options
+*/
+void play_games(const Options* options) {
+    Client* clients = calloc(options->clients, sizeof(Client));
+    double start = now_seconds();
+    for (int i = 0; i < options->clients; i++) {
+        clients[i].options = options;
+        clients[i].games = options->games / options->clients +
+                (i < options->games % options->clients);
+        pthread_create(&clients[i].thread, NULL, client_thread, &clients[i]);
+    }
+    int finished = 0;
+    for (int i = 0; i < options->clients; i++) {
+        pthread_join(clients[i].thread, NULL);
+        finished += clients[i].finished;
+    }
+    double elapsed = now_seconds() - start;
+    printf("%d of %d games finished in %.2f s: %.0f games/s with %d "
+            "clients\n", finished, options->games, elapsed,
+            finished / elapsed, options->clients);
+    free(clients);
+}
+
+/* hold_idle()
+ * -----------
+ * This function opens the idle games, waits for each to be welcomed so that
+ * the server has started it, and prints the server's memory per game
+ *
+ * options: The options, with the number of idle games and the server's pid
+*/
+void hold_idle(const Options* options) {
+    long before = server_rss(options->pid);
+    int* fds = malloc(sizeof(int) * options->idle);
+    int open = 0;
+    char buffer[READ_SIZE];
+    struct timeval timeout = {.tv_sec = GAME_TIMEOUT};
+    while (open < options->idle &&
+            (fds[open] = connect_server(options->address)) >= 0) {
+        // past the server's cap on games, the welcome never comes
+        setsockopt(fds[open], SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                sizeof(timeout));
+        if (read(fds[open], buffer, sizeof(buffer)) <= 0) {
+            close(fds[open]);
+            break;
+        }
+        open++;
+    }
+    long after = server_rss(options->pid);
+    printf("%d idle games: server RSS %ld kB -> %ld kB, %.1f kB per game\n",
+            open, before, after, open > 0 ? (after - before) /
+            (double) open : 0.0);
+    for (int i = 0; i < open; i++) {
+        close(fds[i]);
+    }
+    free(fds);
+}
@@ -35,6 +35,14 @@
 // Maximum number of guesses that will be permitted
 #define MAX_GUESSES 5
 
+// FNV-1a offset basis and prime - used to hash words into a word set
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
+
+// A word set has at least this many slots for each word, so that it is
+// never more than half full
+#define SET_SLOTS_PER_WORD 2
+
 // Enumerated type with our argument types - used for the getopt() version
 // of command line argument parsing
 typedef enum {
@@ -66,9 +74,20 @@ typedef struct {
     char** wordArray;
 } WordList;
 
+// Structure type to hold an open addressing hash set of words - used to
+// check guesses against the dictionary without searching the whole list.
+// The words are copied one after another into text. Each slot holds the
+// offset of a word in text (or -1 if the slot is empty) and the word's hash.
+typedef struct {
+    int numSlots;		// Always a power of two
+    int* offsets;
+    unsigned int* hashes;
+    char* text;
+} WordSet;
+
 /* Function prototypes - see descriptions with the functions themselves */
-bool check_guess(const char* guess, const char* starterWord, WordList words,
-	WordList previousGuesses);
+bool check_guess(const char* guess, const char* starterWord, 
+	const WordSet* words, WordList previousGuesses);
 GameParameters process_command_line(int argc, char* argv[]);
 GameParameters process_command_line_getopt(int argc, char* argv[]);
 void usage_error(void);
@@ -81,6 +100,10 @@ void free_word_list(WordList words);
 bool word_contains_only_letters(const char* word);
 char* convert_word_to_upper_case(char* word);
 bool is_word_in_list(const char* word, WordList words);
+unsigned int hash_word(const char* word);
+WordSet build_word_set(WordList words);
+void free_word_set(WordSet set);
+bool is_word_in_set(const char* word, const WordSet* set);
 char* read_line(void);
 ExitStatus play_game(const char* starterWord, WordList words);
 
@@ -438,6 +461,94 @@ bool is_word_in_list(const char* word, WordList words) {
     return false;
 }
 
+/*
+ * hash_word()
+ * 	Returns the FNV-1a hash of the given word.
+ */
+unsigned int hash_word(const char* word) {
+    unsigned int hash = FNV_OFFSET;
+    while (*word) {
+	hash = (hash ^ (unsigned char)*word) * FNV_PRIME;
+	word++;
+    }
+    return hash;
+}
+
+/*
+ * build_word_set()
+ * 	Build a word set holding copies of all the words in the given list.
+ * 	Collisions are resolved by trying each following slot in turn 
+ * 	(wrapping around at the end). Words already in the set are skipped.
+ */
+WordSet build_word_set(WordList words) {
+    WordSet set;
+    int textSize = 0;
+
+    // Work out how much space is needed for the words and the slots
+    for (int i = 0; i < words.numWords; i++) {
+	textSize += strlen(words.wordArray[i]) + 1;
+    }
+    set.numSlots = 1;
+    while (set.numSlots < words.numWords * SET_SLOTS_PER_WORD) {
+	set.numSlots *= 2;
+    }
+    set.offsets = malloc(sizeof(int) * set.numSlots);
+    set.hashes = malloc(sizeof(unsigned int) * set.numSlots);
+    set.text = malloc(textSize);
+    memset(set.offsets, -1, sizeof(int) * set.numSlots);
+
+    // Copy each word into place and put it in the first free slot from
+    // the one its hash selects
+    textSize = 0;
+    for (int i = 0; i < words.numWords; i++) {
+	const char* word = words.wordArray[i];
+	unsigned int hash = hash_word(word);
+	if (is_word_in_set(word, &set)) {
+	    continue;
+	}
+	int slot = hash & (set.numSlots - 1);
+	while (set.offsets[slot] >= 0) {
+	    slot = (slot + 1) & (set.numSlots - 1);
+	}
+	set.offsets[slot] = textSize;
+	set.hashes[slot] = hash;
+	strcpy(set.text + textSize, word);
+	textSize += strlen(word) + 1;
+    }
+    return set;
+}
+
+/*
+ * free_word_set()
+ * 	Deallocates all memory associated with the given word set.
+ */
+void free_word_set(WordSet set) {
+    free(set.offsets);
+    free(set.hashes);
+    free(set.text);
+}
+
+/*
+ * is_word_in_set()
+ * 	Returns true if the given word is in the given word set, false 
+ * 	otherwise. The word and all words in the set are known to be upper
+ * 	case. Only words with the same hash as the given word are compared
+ * 	with it.
+ */
+bool is_word_in_set(const char* word, const WordSet* set) {
+    unsigned int hash = hash_word(word);
+    int slot = hash & (set->numSlots - 1);
+    while (set->offsets[slot] >= 0) {
+	if (set->hashes[slot] == hash && 
+		strcmp(set->text + set->offsets[slot], word) == 0) {
+	    return true;
+	}
+	slot = (slot + 1) & (set->numSlots - 1);
+    }
+    // Word not found
+    return false;
+}
+
 /*
  * read_line()
  *	Read a line of indeterminate length from stdin (i.e. we read
@@ -477,6 +588,7 @@ ExitStatus play_game(const char* starterWord, WordList dictionary) {
     int numValidGuesses = 0;
     int totalLen = 0;	// Total length of all valid guesses
     WordList previousGuesses = {0, NULL};
+    WordSet dictionarySet = build_word_set(dictionary);
 
     printf("Welcome to UQWordiply!\n");
     printf("The starter word is: %s\n", starterWord);
@@ -494,7 +606,8 @@ ExitStatus play_game(const char* starterWord, WordList dictionary) {
 	// Convert the guess to upper case, and make sure it is valid
 	// If it is valid, update our stats and add it to the list of guesses
 	convert_word_to_upper_case(guess);
-	if (check_guess(guess, starterWord, dictionary, previousGuesses)) {
+	if (check_guess(guess, starterWord, &dictionarySet, 
+		previousGuesses)) {
 	    int guessLen = strlen(guess);
 	    totalLen += guessLen;
 	    previousGuesses = add_word_to_list(previousGuesses, guess);
@@ -505,6 +618,7 @@ ExitStatus play_game(const char* starterWord, WordList dictionary) {
     }
 
     // Have detected EOF or run out of guesses - game is over
+    free_word_set(dictionarySet);
     if (numValidGuesses == 0) {
 	return NO_GUESSES_MADE;
     } else {
@@ -529,7 +643,7 @@ ExitStatus play_game(const char* starterWord, WordList dictionary) {
  *	Return true if OK, false otherwise (with a suitable message printed)..
  */
 bool check_guess(const char* guess, const char* starterWord, 
-	WordList validWords, WordList previousGuesses) {
+	const WordSet* validWords, WordList previousGuesses) {
     if (!word_contains_only_letters(guess)) {
 	printf("Guesses must contain only letters - try again.\n");
 	return false;
@@ -542,7 +656,7 @@ bool check_guess(const char* guess, const char* starterWord,
 	printf("Guesses can't be the starter word - try again.\n");
 	return false;
     }
-    if (!is_word_in_list(guess, validWords)) {
+    if (!is_word_in_set(guess, validWords)) {
 	printf("Guess not found in dictionary - try again.\n");
 	return false;
     }
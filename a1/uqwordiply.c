@@ -4,23 +4,158 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <getopt.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <poll.h>
+#include <signal.h>
+#include <errno.h>
+#include <semaphore.h>
+#include <netdb.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
 #include <csse2310a1.h>
 
 #define MAX_LINE_LENGTH 52
 #define MAX_GUESSES 5
 #define NEWLINE '\n'
 #define NULLTERMINATOR '\0'
+// FNV-1a offset basis and prime, used to hash words into the word set
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
+// The word set has at least this many slots per word, so it stays at most
+// half full and probes stay short
+#define SET_SLOTS_PER_WORD 2
+// Lengths of the substrings indexed, which are the possible starter lengths
+#define MIN_NGRAM_LENGTH 3
+#define MAX_NGRAM_LENGTH 4
+#define ALPHABET_SIZE 26
+// Number of possible 3 letter substrings, whose keys come before those of the
+// 4 letter substrings, and of possible substrings of either length
+#define NGRAM3_KEYS (ALPHABET_SIZE * ALPHABET_SIZE * ALPHABET_SIZE)
+#define NGRAM_KEYS (NGRAM3_KEYS + NGRAM3_KEYS * ALPHABET_SIZE)
+// The most distinct indexed substrings a single word can have
+#define MAX_WORD_NGRAMS (2 * MAX_LINE_LENGTH)
+// Exit code when the server cannot listen on its port or socket
+#define LISTEN_ERROR 5
+// Stack size of each game's thread in server mode, which only needs room for
+// a line buffer and the formatting of short messages
+#define SESSION_STACK_SIZE (64 * 1024)
+// Size of each game's input and output buffers in server mode. Lines either
+// way are short, so these are kept far smaller than the stdio default
+#define SESSION_BUFFER_SIZE 256
+// Most games played at once in server mode. Further connections wait in the
+// listen backlog until a game ends
+#define MAX_SESSIONS 1024
+// Seconds a game waits for its client to send or take a line before ending
+#define SESSION_TIMEOUT 60
+// Microseconds to wait before accepting again when out of file descriptors
+// or memory, as the listener stays readable until something is freed
+#define ACCEPT_BACKOFF 100000
+// A 64 bit block with every byte set to value, and with the top bit of every
+// byte set, for checking and converting 8 dictionary bytes at a time
+#define BYTES(value) (0x0101010101010101ULL * (uint8_t) (value))
+#define HIGH_BITS BYTES(0x80)
+#define BLOCK_SIZE 8
+// Most threads to split a dictionary over, and least of the file each takes
+#define MAX_LOAD_THREADS 16
+#define MIN_LOAD_CHUNK (4 * 1024 * 1024)
+// How much of a mapped dictionary is split into words between handing the
+// pages already done back to the kernel, to keep them out of peak memory use
+#define LOAD_RELEASE_SIZE (4 * 1024 * 1024)
+// Start of every longest word table file, which changes with its layout
+#define TABLE_MAGIC "UQWLONG1"
+#define TABLE_MAGIC_LENGTH 8
+// FNV-1a 64 bit offset basis and prime, used to fingerprint the dictionary a
+// longest word table was built from
+#define FNV64_OFFSET 14695981039346656037ULL
+#define FNV64_PRIME 1099511628211ULL
+// Added to a longest word table's path while it is being written
+#define TABLE_TEMP_SUFFIX ".tmp"
+// Exit code when a longest word table cannot be written
+#define TABLE_ERROR 6
 
 // Typedefs
-// Dictionary to contain the words as well as it's current size
+// A slot in a word set, holding the index of a word plus one (0 for an empty
+// slot) and that word's hash, so most probes that miss never have to look at
+// the word itself
+typedef struct {
+    int word;
+    unsigned int hash;
+} WordSlot;
+
+// Open addressing hash set over the words of a dictionary
+typedef struct {
+    WordSlot* slots;
+    unsigned int mask;
+} WordSet;
+
+// Inverted index from every 3 and 4 letter substring to the words containing
+// it. The words containing the substring with key k are words[starts[k]] up
+// to words[starts[k + 1]], as indexes into the dictionary, longest first and
+// otherwise in dictionary order
+typedef struct {
+    int* starts;
+    int* words;
+} NgramIndex;
+
+// Header of a longest word table file, built by --build-table for --table.
+// It is followed by NGRAM_KEYS + 1 offsets, and then an entry for each
+// substring key running from its offset up to the next. An entry is the
+// length of the longest words containing the substring, as one byte, followed
+// by each of those words without terminators. The entry is empty if no word
+// contains the substring. The table is only used with the dictionary it was
+// built from, which is told by its fingerprint and number of words
+typedef struct {
+    char magic[TABLE_MAGIC_LENGTH];
+    uint64_t dictHash;
+    uint32_t numKeys;
+    uint32_t numWords;
+} TableHeader;
+
+// A longest word table mapped from a file, with mapping NULL if none is
+typedef struct {
+    void* mapping;
+    size_t size;
+    const uint32_t* offsets;
+    const unsigned char* entries;
+} LongestTable;
+
+// Dictionary to contain the words as well as it's current size. The words of
+// a loaded dictionary are packed one after another in text, and can be looked
+// up through set and found by substring through index, or through longest if
+// a longest word table was loaded in place of the index. Guesses are strdup'd
+// instead and have none of these (text, set.slots, index.starts and
+// longest.mapping are NULL)
 typedef struct {
     bool isInitialised;
     char** words;
     int size;
     int maxLength;
+    char* text;
+    WordSet set;
+    NgramIndex index;
+    LongestTable longest;
 } Dictionary;
 
+// struct for part of a dictionary file being split into words by one thread,
+// holding the part (starting at the start of a line), whether its pages may be
+// handed back as it is split, where its words are to be packed, and the words
+// found
+typedef struct {
+    const char* start;
+    const char* end;
+    bool release;
+    char* text;
+    char** words;
+    int size;
+    int maxLength;
+} LoadChunk;
+
 // struct to store important game variables like the dictionary and the starter
 // word
 typedef struct {
@@ -29,20 +164,66 @@ typedef struct {
     Dictionary guesses;
 } GameVariables;
 
+// struct for the server mode, holding where to listen (both NULL when just
+// playing one game on stdin), the starter word length for random starter
+// words, and a game with the dictionary which every game shares. Nothing in
+// it but the lock and the count of free game slots changes once games are
+// being played
+typedef struct {
+    const char* port;
+    const char* unixPath;
+    int starterLen;
+    GameVariables game;
+    pthread_mutex_t starterLock;
+    sem_t freeSessions;
+} Server;
+
+// struct for a game being played over a connection, with that game's
+// input and output buffers
+typedef struct {
+    int fd;
+    Server* server;
+    char inBuffer[SESSION_BUFFER_SIZE];
+    char outBuffer[SESSION_BUFFER_SIZE];
+} Session;
+
 // Method declarations
 void print_usage();
-void print_results(GameVariables);
-void print_longest_in_dict(Dictionary, const char*);
+void print_results(GameVariables, FILE*);
+void print_longest_in_dict(Dictionary, const char*, FILE*);
+void print_longest_containing(Dictionary, const char*, FILE*);
 void clean_up(GameVariables);
+void free_guesses(Dictionary);
 int len_processing(char*, GameVariables);
-bool validate_guess(char*, GameVariables, Dictionary);
+bool validate_guess(char*, GameVariables, Dictionary, FILE*);
 bool str_all_alpha(char*);
 bool in_dictionary(Dictionary, char*);
+unsigned int hash_word(const char*);
+WordSet build_word_set(char**, int);
+int ngram_key(const char*, int);
+int starter_key(const char*);
+int word_ngram_keys(const char*, int, const char*, int*, int*);
+NgramIndex build_ngram_index(char**, int, const char*);
+int words_containing(Dictionary, const char*, const int**);
 char* str_to_upper(char*);
 char* starter_word_processing(char*);
-Dictionary get_guesses(GameVariables);
-Dictionary dictionary_processing(char*, const char*);
-GameVariables initialise_game(int argc, char* argv[]);
+Dictionary get_guesses(GameVariables, FILE*, FILE*);
+Dictionary play_game(GameVariables, FILE*, FILE*);
+Dictionary dictionary_processing(char*, const char*, const char*);
+uint64_t dictionary_fingerprint(char**, int);
+bool write_longest_table(Dictionary, const char*);
+LongestTable load_longest_table(const char*, char**, int);
+char* read_dictionary_file(const char*, size_t*, bool*);
+uint64_t byte_range_bits(uint64_t, uint8_t, uint8_t);
+bool bytes_all_alpha(const char*, int);
+void copy_upper(char*, const char*, int);
+void* load_chunk(void*);
+int load_threads(size_t);
+GameVariables initialise_game(int argc, char* argv[], Server*, const char**);
+int open_port(const char*);
+int open_unix(const char*);
+void serve_games(Server*);
+void* play_session(void*);
 
 /* main()
  * ------
@@ -55,36 +236,79 @@ GameVariables initialise_game(int argc, char* argv[]);
  * argv: the inputs provided at command line
  *
  * Returns: 0
- * Errors: Silently exits with code 4. For all other potential errors, see any
- * used helper functions (in particular initialise_game())
-*/ 
+ * Errors: Silently exits with code 4. Exits with code 6 and prints to std
+ * error if --build-table cannot write its table. For all other potential
+ * errors, see any used helper functions (in particular initialise_game() and
+ * serve_games())
+*/
 int main(int argc, char* argv[]) {
     GameVariables gameValues;
-    gameValues = initialise_game(argc, argv);
+    Server server;
+    const char* buildTable;
+    gameValues = initialise_game(argc, argv, &server, &buildTable);
 
-    // print the welcome message
-    printf("Welcome to UQWordiply!\n" \
-            "The starter word is: %s\n" \
-            "Enter words containing this word.\n",
-            gameValues.starterWord);
+    if (buildTable != NULL) {
+        bool written = write_longest_table(gameValues.dictionary, buildTable);
+        clean_up(gameValues);
+        if (!written) {
+            fprintf(stderr, "uqwordiply: table file \"%s\" cannot be "
+                    "written\n", buildTable);
+            exit(TABLE_ERROR);
+        }
+        return 0;
+    }
 
-    gameValues.guesses = get_guesses(gameValues);
+    if (server.port != NULL || server.unixPath != NULL) {
+        server.game = gameValues;
+        serve_games(&server);
+    }
+
+    gameValues.guesses = play_game(gameValues, stdin, stdout);
 
     if (gameValues.guesses.size == 0) { // in case of silent exit
         clean_up(gameValues);
         exit(4);
     }
 
-    print_results(gameValues);
-
     clean_up(gameValues);
     return 0;
 }
 
+/* play_game()
+ * -----------
+ * This function plays one game, reading guesses from one stream and writing
+ * the prompts and results to another
+ *
+ * game: The game variables being used for this instance of play
+ *
+ * in: Where guesses are read from
+ *
+ * out: Where the game is printed to
+ *
+ * Returns: The valid guesses made, with no results printed if there were none
+*/
+Dictionary play_game(GameVariables game, FILE* in, FILE* out) {
+    // print the welcome message
+    fprintf(out, "Welcome to UQWordiply!\n" \
+            "The starter word is: %s\n" \
+            "Enter words containing this word.\n",
+            game.starterWord);
+
+    game.guesses = get_guesses(game, in, out);
+    if (game.guesses.size != 0) {
+        print_results(game, out);
+    }
+    fflush(out);
+    return game.guesses;
+}
+
 /* print_usage()
  * -------------
  * This function prints to standard error the proper usage of the built code 
- * and exits the program with code 1
+ * and exits the program with code 1. The message is kept as the assignment
+ * specifies, so it leaves out the server mode options --port portnum and
+ * --unix path (see serve_games()) and the longest word table options
+ * --build-table filename and --table filename (see initialise_game())
  *
  * Returns: void
  * Errors: Will always exit with code 1 when called by design
@@ -107,19 +331,34 @@ void print_usage() {
 void clean_up(GameVariables game) {
     // Freeing up the dictionary values
     if (game.dictionary.isInitialised) {
-        for (int i = 0; i < game.dictionary.size; i++) {
-            free(game.dictionary.words[i]);
-        }
+        free(game.dictionary.text);
         free(game.dictionary.words);
+        free(game.dictionary.set.slots);
+        free(game.dictionary.index.starts);
+        free(game.dictionary.index.words);
+        if (game.dictionary.longest.mapping != NULL) {
+            munmap(game.dictionary.longest.mapping,
+                    game.dictionary.longest.size);
+        }
     }
     if (game.guesses.isInitialised) {
-        if (game.guesses.size != 0) {
-            for (int i = 0; i < game.guesses.size; i++) {
-                free(game.guesses.words[i]);
-            }
-        }
-        free(game.guesses.words);
+        free_guesses(game.guesses);
+    }
+}
+
+/* free_guesses()
+ * --------------
+ * This function frees the guesses made in a game
+ *
+ * guesses: The guesses
+ *
+ * Returns: void
+*/
+void free_guesses(Dictionary guesses) {
+    for (int i = 0; i < guesses.size; i++) {
+        free(guesses.words[i]);
     }
+    free(guesses.words);
 }
 
 /* print_results()
@@ -130,20 +369,22 @@ void clean_up(GameVariables game) {
  *
  * game: The game variables that store the guesses and dictionary used
  *
+ * out: Where the results are printed to
+ *
  * Returns: void
 */
-void print_results(GameVariables game) {
+void print_results(GameVariables game, FILE* out) {
     int totalLength = 0;
     for (int i = 0; i < game.guesses.size; i++) {
         int currentLength = strlen(game.guesses.words[i]);
         totalLength += currentLength;
     }
-    printf("\nTotal length of words found: %d\n", totalLength);
-    printf("Longest word(s) found:\n");
-    print_longest_in_dict(game.guesses, game.starterWord);
+    fprintf(out, "\nTotal length of words found: %d\n", totalLength);
+    fprintf(out, "Longest word(s) found:\n");
+    print_longest_in_dict(game.guesses, game.starterWord, out);
 
-    printf("Longest word(s) possible:\n");
-    print_longest_in_dict(game.dictionary, game.starterWord);
+    fprintf(out, "Longest word(s) possible:\n");
+    print_longest_containing(game.dictionary, game.starterWord, out);
 }
 
 /* print_longest_in_dict()
@@ -156,21 +397,70 @@ void print_results(GameVariables game) {
  *
  * starter: The starter word, required to be in current word to print
  *
+ * out: Where the words are printed to
+ *
  * Returns: void
 */
-void print_longest_in_dict(Dictionary dict, const char* starter) {
+void print_longest_in_dict(Dictionary dict, const char* starter, FILE* out) {
     for (int i = 0; i < dict.size; i++) {
         if ((int) strlen(dict.words[i]) == dict.maxLength) {
             if (strstr(dict.words[i], starter) != NULL) {
-                printf("%s (%d)\n", dict.words[i], dict.maxLength);
+                fprintf(out, "%s (%d)\n", dict.words[i], dict.maxLength);
             }
         }
     }
 }
 
+/* print_longest_containing()
+ * --------------------------
+ * This function prints the longest words in a loaded dictionary containing
+ * the starter word, looked up in the dictionary's longest word table if it
+ * has one, or otherwise found through its index, rather than by searching
+ * every word
+ *
+ * dict: The dictionary to be searched
+ *
+ * starter: The starter word, in upper case
+ *
+ * out: Where the words are printed to
+ *
+ * Returns: void
+*/
+void print_longest_containing(Dictionary dict, const char* starter,
+        FILE* out) {
+    int key = starter_key(starter);
+    if (dict.longest.mapping != NULL) {
+        if (key < 0) {
+            return;
+        }
+        const unsigned char* entry = dict.longest.entries +
+                dict.longest.offsets[key];
+        int entrySize = dict.longest.offsets[key + 1] -
+                dict.longest.offsets[key];
+        int length = entrySize > 0 ? entry[0] : 0;
+        if (length == 0 || (entrySize - 1) % length != 0) {
+            return;
+        }
+        for (int i = 1; i < entrySize; i += length) {
+            fprintf(out, "%.*s (%d)\n", length, (const char*) entry + i,
+                    length);
+        }
+        return;
+    }
+    const int* found;
+    int count = words_containing(dict, starter, &found);
+    int longest = count > 0 ? (int) strlen(dict.words[found[0]]) : 0;
+    for (int i = 0; i < count; i++) {
+        if ((int) strlen(dict.words[found[i]]) != longest) {
+            break;
+        }
+        fprintf(out, "%s (%d)\n", dict.words[found[i]], longest);
+    }
+}
+
 /* str_to_upper()
  * --------------
- * This function takes an input string and converts all characters to upper 
+ * This function takes an input string and converts all characters to upper
  * case
  *
  * word: The string to be converted to upper case
@@ -178,7 +468,8 @@ void print_longest_in_dict(Dictionary dict, const char* starter) {
  * Returns: The string in all upper case
 */
 char* str_to_upper(char* word){
-    for (int i = 0; i < strlen(word); i++) {
+    int length = strlen(word);
+    for (int i = 0; i < length; i++) {
         word[i] = toupper(word[i]);
     }
     return word;
@@ -245,52 +536,458 @@ int len_processing(char* lenInput, GameVariables game) {
 
 /* dictionary_processing()
  * -----------------------
- *  This function processes the dictionary and returns an array of all the 
- *  words within the dictionary and then closes the file
+ *  This function processes the dictionary and returns an array of all the
+ *  words within the dictionary and then closes the file. The file is read
+ *  (mapped where possible) in one go and split into words in a single pass,
+ *  by several threads for a large file on a machine with several cores (see
+ *  load_chunk()). The words are upper cased and packed into one buffer, and a
+ *  word set and a substring index are built over them, so guesses can be
+ *  looked up and the words containing a starter word found without scanning
+ *  the dictionary
  *
  *  path: The path to the dictionary to be used
  *
+ *  starter: The only starter word to index the words containing, or NULL to
+ *  index every starter word (see build_ngram_index())
+ *
+ *  tablePath: A longest word table to load in place of building the index,
+ *  or NULL. If it cannot be used with this dictionary, a warning is printed
+ *  to std error and the index is built after all
+ *
  *  Returns: an array of each word contained within the dictionary
 */
-Dictionary dictionary_processing(char* path, const char* starter) {
-    FILE* dictionaryFile = fopen(path, "r");
+Dictionary dictionary_processing(char* path, const char* starter,
+        const char* tablePath) {
+    size_t fileSize;
+    bool mapped;
+    char* contents = read_dictionary_file(path, &fileSize, &mapped);
     // Dictionary not openable
-    if (dictionaryFile == NULL) {
+    if (contents == NULL) {
         fprintf(stderr, "uqwordiply: dictionary file \"%s\" cannot be opened"\
                 "\n", path);
         exit(3);
+    }
+    Dictionary dict;
+    dict.isInitialised = true;
+    dict.size = 0;
+    dict.maxLength = -1;
+    // a word takes no more room than the line it came from, except where a
+    // long line is split without a newline to become the word's terminator
+    int numThreads = load_threads(fileSize);
+    dict.text = malloc(fileSize + fileSize / (MAX_LINE_LENGTH - 1) +
+            numThreads + 1);
+
+    // split the file at line starts, and give each thread's words room as if
+    // every part before it had taken the most room possible
+    LoadChunk chunks[MAX_LOAD_THREADS];
+    pthread_t threads[MAX_LOAD_THREADS];
+    bool threaded[MAX_LOAD_THREADS];
+    const char* start = contents;
+    for (int i = 0; i < numThreads; i++) {
+        const char* end = contents + fileSize * (i + 1) / numThreads;
+        const char* newline = end < contents + fileSize ?
+                memchr(end, NEWLINE, contents + fileSize - end) : NULL;
+        end = i == numThreads - 1 || newline == NULL ? contents + fileSize :
+                newline + 1;
+        size_t offset = start - contents;
+        chunks[i].start = start;
+        chunks[i].end = end < start ? start : end;
+        chunks[i].release = mapped;
+        chunks[i].text = dict.text + offset + offset / (MAX_LINE_LENGTH - 1) +
+                i;
+        start = chunks[i].end;
+        threaded[i] = i > 0 && pthread_create(&threads[i], NULL, load_chunk,
+                &chunks[i]) == 0;
+    }
+    for (int i = 0; i < numThreads; i++) {
+        if (threaded[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            load_chunk(&chunks[i]);
+        }
+        dict.size += chunks[i].size;
+        if (chunks[i].maxLength > dict.maxLength) {
+            dict.maxLength = chunks[i].maxLength;
+        }
+    }
+    if (mapped) {
+        munmap(contents, fileSize);
     } else {
-        Dictionary dict;
-        dict.isInitialised = true;
-        dict.size = 0;
-        dict.maxLength = -1;
-        char lineBuffer[MAX_LINE_LENGTH];
-        int bufferSize = sizeof(char*) * 32;
-        dict.words = (char**) malloc(bufferSize);
-        while (fgets(lineBuffer, MAX_LINE_LENGTH, dictionaryFile)) {
-            if ((dict.size * sizeof(char*)) == bufferSize - 8) {
-                bufferSize = bufferSize * 2;
-                dict.words = realloc(dict.words, bufferSize);
+        free(contents);
+    }
+
+    dict.words = malloc(sizeof(char*) * (dict.size + 1));
+    for (int i = 0, size = 0; i < numThreads; i++) {
+        memcpy(dict.words + size, chunks[i].words,
+                sizeof(char*) * chunks[i].size);
+        size += chunks[i].size;
+        free(chunks[i].words);
+    }
+    dict.set = build_word_set(dict.words, dict.size);
+    dict.longest.mapping = NULL;
+    dict.index.starts = NULL;
+    dict.index.words = NULL;
+    if (tablePath != NULL) {
+        dict.longest = load_longest_table(tablePath, dict.words, dict.size);
+        if (dict.longest.mapping == NULL) {
+            fprintf(stderr, "uqwordiply: table file \"%s\" cannot be used "
+                    "with this dictionary\n", tablePath);
+        }
+    }
+    if (dict.longest.mapping == NULL) {
+        dict.index = build_ngram_index(dict.words, dict.size, starter);
+    }
+    return dict;
+}
+
+/* dictionary_fingerprint()
+ * ------------------------
+ *  This function hashes all the words in the dictionary into one number
+ *  using FNV-1a. It is stored in a longest word table to check the table
+ *  matches the dictionary it is used with
+ *
+ *  words: The words, in upper case
+ *
+ *  size: The number of words
+ *
+ *  Returns: The fingerprint
+*/
+uint64_t dictionary_fingerprint(char** words, int size) {
+    uint64_t hash = FNV64_OFFSET;
+    for (int i = 0; i < size; i++) {
+        // hash the '\0' too, otherwise "AB" "C" would equal "A" "BC"
+        const char* c = words[i];
+        do {
+            hash = (hash ^ (unsigned char) *c) * FNV64_PRIME;
+        } while (*c++ != NULLTERMINATOR);
+    }
+    return hash;
+}
+
+/* write_longest_table()
+ * ---------------------
+ *  This function writes the longest words for every starter word to a table
+ *  file. They are taken from the front of each starter's list in the index.
+ *  The file is written under a temporary name and only renamed to path once
+ *  it is finished
+ *
+ *  dict: The dictionary, indexed for every starter word
+ *
+ *  path: Where to write the table
+ *
+ *  Returns: true if the table was written, false otherwise
+*/
+bool write_longest_table(Dictionary dict, const char* path) {
+    uint32_t* offsets = malloc(sizeof(uint32_t) * (NGRAM_KEYS + 1));
+    int* counts = malloc(sizeof(int) * NGRAM_KEYS);
+    uint64_t total = 0;
+    for (int k = 0; k < NGRAM_KEYS; k++) {
+        const int* found = dict.index.words + dict.index.starts[k];
+        int count = dict.index.starts[k + 1] - dict.index.starts[k];
+        int length = count > 0 ? strlen(dict.words[found[0]]) : 0;
+        counts[k] = 0;
+        while (counts[k] < count &&
+                (int) strlen(dict.words[found[counts[k]]]) == length) {
+            counts[k]++;
+        }
+        offsets[k] = total;
+        total += counts[k] > 0 ? 1 + (uint64_t) counts[k] * length : 0;
+    }
+    offsets[NGRAM_KEYS] = total;
+
+    char* tempPath = malloc(strlen(path) + sizeof(TABLE_TEMP_SUFFIX));
+    sprintf(tempPath, "%s%s", path, TABLE_TEMP_SUFFIX);
+    FILE* file = total <= UINT32_MAX ? fopen(tempPath, "w") : NULL;
+    bool written = file != NULL;
+    if (written) {
+        TableHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, TABLE_MAGIC, TABLE_MAGIC_LENGTH);
+        header.dictHash = dictionary_fingerprint(dict.words, dict.size);
+        header.numKeys = NGRAM_KEYS;
+        header.numWords = dict.size;
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(offsets, sizeof(uint32_t), NGRAM_KEYS + 1, file);
+        for (int k = 0; k < NGRAM_KEYS; k++) {
+            const int* found = dict.index.words + dict.index.starts[k];
+            if (counts[k] > 0) {
+                fputc(strlen(dict.words[found[0]]), file);
             }
-            int length = strlen(lineBuffer);
-            if (lineBuffer[length - 1] == NEWLINE) {
-                lineBuffer[length - 1] = NULLTERMINATOR;
+            for (int i = 0; i < counts[k]; i++) {
+                fputs(dict.words[found[i]], file);
             }
-            if (str_all_alpha(lineBuffer)) {
-                length--;
-                dict.words[dict.size] = strdup(lineBuffer);
-                dict.words[dict.size] = str_to_upper(dict.words[dict.size]);
-                if (strstr(dict.words[dict.size], starter) != NULL) {
-                    if ((int) strlen(dict.words[dict.size]) > dict.maxLength) {
-                        dict.maxLength = (int) length;
-                    }
+        }
+        written = !ferror(file);
+        written = fclose(file) == 0 && written;
+    }
+    written = written && rename(tempPath, path) == 0;
+    if (!written && file != NULL) {
+        unlink(tempPath);
+    }
+    free(tempPath);
+    free(counts);
+    free(offsets);
+    return written;
+}
+
+/* load_longest_table()
+ * --------------------
+ *  This function maps a longest word table written by write_longest_table(),
+ *  checking that it was built from the given dictionary and is laid out as
+ *  its header says
+ *
+ *  path: The table file
+ *
+ *  words: The words of the dictionary it must have been built from
+ *
+ *  size: The number of words
+ *
+ *  Returns: The table, with mapping NULL if it could not be read or is not
+ *  for this dictionary
+*/
+LongestTable load_longest_table(const char* path, char** words, int size) {
+    LongestTable table;
+    table.mapping = NULL;
+    size_t offsetsSize = sizeof(uint32_t) * (NGRAM_KEYS + 1);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return table;
+    }
+    struct stat info;
+    void* mapping = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) &&
+            (size_t) info.st_size >= sizeof(TableHeader) + offsetsSize) {
+        mapping = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return table;
+    }
+    const TableHeader* header = mapping;
+    const uint32_t* offsets = (const uint32_t*) (header + 1);
+    bool valid = memcmp(header->magic, TABLE_MAGIC, TABLE_MAGIC_LENGTH) == 0 &&
+            header->numKeys == NGRAM_KEYS &&
+            header->numWords == (uint32_t) size &&
+            header->dictHash == dictionary_fingerprint(words, size) &&
+            offsets[NGRAM_KEYS] == info.st_size - sizeof(TableHeader) -
+            offsetsSize;
+    for (int k = 0; valid && k < NGRAM_KEYS; k++) {
+        valid = offsets[k] <= offsets[k + 1];
+    }
+    if (!valid) {
+        munmap(mapping, info.st_size);
+        return table;
+    }
+    table.mapping = mapping;
+    table.size = info.st_size;
+    table.offsets = offsets;
+    table.entries = (const unsigned char*) (offsets + NGRAM_KEYS + 1);
+    return table;
+}
+
+/* read_dictionary_file()
+ * ----------------------
+ *  This function reads the whole of a dictionary file, by mapping it if it is
+ *  a regular file and otherwise reading it into memory
+ *
+ *  path: The path to the dictionary to be read
+ *
+ *  size: Where to store the size of the file
+ *
+ *  mapped: Where to store whether the file was mapped (and must be unmapped
+ *  rather than freed)
+ *
+ *  Returns: The contents of the file, or NULL if it cannot be opened
+*/
+char* read_dictionary_file(const char* path, size_t* size, bool* mapped) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat info;
+    *mapped = false;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        char* contents = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd,
+                0);
+        if (contents != MAP_FAILED) {
+            madvise(contents, info.st_size, MADV_SEQUENTIAL);
+            close(fd);
+            *size = info.st_size;
+            *mapped = true;
+            return contents;
+        }
+    }
+    // pipes and the like, which cannot be mapped, are read the slow way
+    size_t capacity = BUFSIZ;
+    char* contents = malloc(capacity);
+    ssize_t got;
+    *size = 0;
+    while ((got = read(fd, contents + *size, capacity - *size)) > 0) {
+        *size += got;
+        if (*size == capacity) {
+            capacity = capacity * 2;
+            contents = realloc(contents, capacity);
+        }
+    }
+    close(fd);
+    return contents;
+}
+
+/* byte_range_bits()
+ * -----------------
+ *  This function checks which of the 8 bytes in a block are within a range,
+ *  all at once. Adding 0x80 - low to a byte below 0x80 sets its top bit
+ *  exactly when the byte is at least low, and can never carry into the next
+ *  byte
+ *
+ *  block: The 8 bytes to be checked
+ *
+ *  low: The lowest byte in the range, at least 1
+ *
+ *  high: The highest byte in the range, below 0x80
+ *
+ *  Returns: The block with the top bit of each byte in the range set, and no
+ *  other bit set
+*/
+uint64_t byte_range_bits(uint64_t block, uint8_t low, uint8_t high) {
+    uint64_t lowBits = block & ~HIGH_BITS;
+    uint64_t atLeastLow = lowBits + BYTES(0x80 - low);
+    uint64_t aboveHigh = lowBits + BYTES(0x7f - high);
+    return atLeastLow & ~aboveHigh & ~block & HIGH_BITS;
+}
+
+/* bytes_all_alpha()
+ * -----------------
+ *  This function checks whether some bytes are all letters, 8 at a time
+ *
+ *  bytes: The bytes to be checked
+ *
+ *  length: The number of bytes
+ *
+ *  Returns: true if every byte is a letter (of either case)
+*/
+bool bytes_all_alpha(const char* bytes, int length) {
+    uint64_t notAlpha = 0;
+    uint64_t block;
+    int i = 0;
+    for (; i + BLOCK_SIZE <= length; i += BLOCK_SIZE) {
+        memcpy(&block, bytes + i, BLOCK_SIZE);
+        notAlpha |= ~byte_range_bits(block | BYTES(0x20), 'a', 'z');
+    }
+    block = BYTES('A'); // any bytes past the end count as letters
+    memcpy(&block, bytes + i, length - i);
+    notAlpha |= ~byte_range_bits(block | BYTES(0x20), 'a', 'z');
+    return (notAlpha & HIGH_BITS) == 0;
+}
+
+/* copy_upper()
+ * ------------
+ *  This function copies bytes, converting lower case letters to upper case
+ *  8 at a time. A lower case letter has its 0x20 bit cleared, which is its
+ *  top bit from byte_range_bits() moved down 2 places
+ *
+ *  dest: Where to copy to
+ *
+ *  src: Where to copy from
+ *
+ *  length: The number of bytes
+ *
+ *  Returns: void
+*/
+void copy_upper(char* dest, const char* src, int length) {
+    uint64_t block;
+    int i = 0;
+    for (; i + BLOCK_SIZE <= length; i += BLOCK_SIZE) {
+        memcpy(&block, src + i, BLOCK_SIZE);
+        block ^= byte_range_bits(block, 'a', 'z') >> 2;
+        memcpy(dest + i, &block, BLOCK_SIZE);
+    }
+    block = 0;
+    memcpy(&block, src + i, length - i);
+    block ^= byte_range_bits(block, 'a', 'z') >> 2;
+    memcpy(dest + i, &block, length - i);
+}
+
+/* load_chunk()
+ * ------------
+ *  This function splits part of a dictionary file into words, in the same way
+ *  as reading it a line at a time with fgets() into a MAX_LINE_LENGTH buffer
+ *  would: a line too long for the buffer is split into pieces, and a word is
+ *  kept if every character but its last is a letter (as str_all_alpha()
+ *  checks). Lines are found with memchr() and words checked and upper cased
+ *  8 bytes at a time as they are packed into the chunk's text. The pages of a
+ *  mapped file are handed back every LOAD_RELEASE_SIZE bytes
+ *
+ *  arg: The chunk to be split, which the words found are stored in
+ *
+ *  Returns: NULL
+*/
+void* load_chunk(void* arg) {
+    LoadChunk* chunk = arg;
+    const char* line = chunk->start;
+    const char* released = chunk->start;
+    char* text = chunk->text;
+    int capacity = 32;
+    chunk->words = malloc(sizeof(char*) * capacity);
+    chunk->size = 0;
+    chunk->maxLength = -1;
+    uintptr_t pageMask = ~(uintptr_t) (sysconf(_SC_PAGESIZE) - 1);
+    while (line < chunk->end) {
+        const char* newline = memchr(line, NEWLINE, chunk->end - line);
+        const char* lineEnd = newline == NULL ? chunk->end : newline + 1;
+        while (line < lineEnd) {
+            int pieceLength = lineEnd - line < MAX_LINE_LENGTH - 1 ?
+                    lineEnd - line : MAX_LINE_LENGTH - 1;
+            int length = newline != NULL && line + pieceLength == newline + 1 ?
+                    pieceLength - 1 : pieceLength;
+            if (length > 0 && bytes_all_alpha(line, length - 1)) {
+                if (chunk->size == capacity) {
+                    capacity = capacity * 2;
+                    chunk->words = realloc(chunk->words,
+                            sizeof(char*) * capacity);
                 }
-                dict.size++;
+                copy_upper(text, line, length);
+                text[length] = NULLTERMINATOR;
+                chunk->words[chunk->size++] = text;
+                text += length + 1;
+                if (length > chunk->maxLength) {
+                    chunk->maxLength = length;
+                }
+            }
+            line += pieceLength;
+        }
+        if (chunk->release && line - released >= LOAD_RELEASE_SIZE) {
+            // only whole pages, which a file mapping starts on
+            uintptr_t from = ((uintptr_t) released + ~pageMask) & pageMask;
+            uintptr_t to = (uintptr_t) line & pageMask;
+            if (to > from) {
+                madvise((void*) from, to - from, MADV_DONTNEED);
             }
+            released = line;
         }
-        fclose(dictionaryFile);
-        return dict;
     }
+    return NULL;
+}
+
+/* load_threads()
+ * --------------
+ *  This function decides how many threads to split a dictionary file over,
+ *  one per online core but no more than leave each MIN_LOAD_CHUNK of it
+ *
+ *  fileSize: The size of the file
+ *
+ *  Returns: The number of threads, at least 1
+*/
+int load_threads(size_t fileSize) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threads = fileSize / MIN_LOAD_CHUNK;
+    if (cores > 0 && threads > (size_t) cores) {
+        threads = cores;
+    }
+    if (threads > MAX_LOAD_THREADS) {
+        threads = MAX_LOAD_THREADS;
+    }
+    return threads < 1 ? 1 : threads;
 }
 
 /* initialise_game()
@@ -302,6 +999,15 @@ Dictionary dictionary_processing(char* path, const char* starter) {
  *
  *  argv: argv from main, the contents of input arguments at command line
  *
+ *  server: Where to store the server mode options. With --port or --unix the
+ *  dictionary is indexed for every starter word and no starter word is
+ *  chosen unless --start was given
+ *
+ *  buildTable: Where to store the path given with --build-table, or NULL. The
+ *  dictionary is then indexed for every starter word, so that the longest
+ *  word table can be built from it, and no other option but --dictionary may
+ *  be given. --table loads such a table in place of the index
+ *
  *  Returns: struct GameVariables containing all variables important for the
  *           game to be played
  *  Errors: if any of the conditions required for proper usage are failed, 
@@ -309,18 +1015,29 @@ Dictionary dictionary_processing(char* path, const char* starter) {
  *  REF: The code relating to command line arguments is inspired by code at
  *  REF: https://stackoverflow.com/questions/17877368
 */
-GameVariables initialise_game(int argc, char* argv[]) {
+GameVariables initialise_game(int argc, char* argv[], Server* server,
+        const char** buildTable) {
     bool startFlag = false;
     bool lenFlag = false;
     int starterLen = 0; // can be 3 or 4, randomised when 0
     char* dictionaryPath = "/usr/share/dict/words";
+    const char* tablePath = NULL;
     GameVariables values;
+    values.starterWord = NULL;
     values.dictionary.isInitialised = false;
+    values.guesses.isInitialised = false;
+    server->port = NULL;
+    server->unixPath = NULL;
+    *buildTable = NULL;
     int opt;
     struct option longOpt[] = { // struct for options for getopt_long
         {"start", required_argument, NULL, 's'},
         {"len", required_argument, NULL, 'l'},
         {"dictionary", required_argument, NULL, 'd'},
+        {"port", required_argument, NULL, 'p'},
+        {"unix", required_argument, NULL, 'u'},
+        {"table", required_argument, NULL, 't'},
+        {"build-table", required_argument, NULL, 'b'},
         {NULL, 0, NULL, 0}
     };
     if (argc % 2 != 1) { // error for option without argument
@@ -346,15 +1063,54 @@ GameVariables initialise_game(int argc, char* argv[]) {
             case 'd':
                 dictionaryPath = optarg;
                 break;
+            case 'p':
+                if (server->port != NULL || strlen(optarg) == 0) {
+                    print_usage();
+                }
+                server->port = optarg;
+                break;
+            case 'u':
+                if (server->unixPath != NULL || strlen(optarg) == 0) {
+                    print_usage();
+                }
+                server->unixPath = optarg;
+                break;
+            case 't':
+                if (tablePath != NULL || strlen(optarg) == 0) {
+                    print_usage();
+                }
+                tablePath = optarg;
+                break;
+            case 'b':
+                if (*buildTable != NULL || strlen(optarg) == 0) {
+                    print_usage();
+                }
+                *buildTable = optarg;
+                break;
             default:
                 print_usage();
         }
     }
+    server->starterLen = starterLen;
+    if (*buildTable != NULL) {
+        if (startFlag || lenFlag || tablePath != NULL ||
+                server->port != NULL || server->unixPath != NULL) {
+            print_usage();
+        }
+        values.dictionary = dictionary_processing(dictionaryPath, NULL, NULL);
+        return values;
+    }
+    if (server->port != NULL || server->unixPath != NULL) {
+        // every game gets its own starter word, so index them all
+        values.dictionary = dictionary_processing(dictionaryPath, NULL,
+                tablePath);
+        return values;
+    }
     if (!startFlag) {
         values.starterWord = get_wordiply_starter_word(starterLen);
     }
-    values.dictionary = dictionary_processing(dictionaryPath, 
-            values.starterWord);
+    values.dictionary = dictionary_processing(dictionaryPath,
+            values.starterWord, tablePath);
     return values;
 }
 
@@ -367,7 +1123,11 @@ GameVariables initialise_game(int argc, char* argv[]) {
  * Returns: boolean value true if word is valid, false otherwise
 */
 bool str_all_alpha(char* guess) {
-    for (int i = 0; i < strlen(guess) - 1; i++) {
+    int length = strlen(guess);
+    if (length == 0) {
+        return false;
+    }
+    for (int i = 0; i < length - 1; i++) {
         // every character must be a letter
         if (!isalpha(guess[i])) {
             return false;
@@ -376,16 +1136,254 @@ bool str_all_alpha(char* guess) {
     return true;
 }
 
+/* hash_word()
+ * -----------
+ * This function hashes a word with FNV-1a, for the word set
+ *
+ * word: The word to be hashed
+ *
+ * Returns: The hash of the word
+*/
+unsigned int hash_word(const char* word) {
+    unsigned int hash = FNV_OFFSET;
+    for (; *word != NULLTERMINATOR; word++) {
+        hash = (hash ^ (unsigned char) *word) * FNV_PRIME;
+    }
+    return hash;
+}
+
+/* build_word_set()
+ * ----------------
+ * This function builds a word set over an array of words. The set has a power
+ * of two number of slots, at least SET_SLOTS_PER_WORD for every word, and
+ * collisions are resolved by trying the following slots in turn. A word which
+ * appears more than once is only added the first time
+ *
+ * words: The words to be added, which must not move while the set is used
+ *
+ * size: The number of words
+ *
+ * Returns: The word set
+*/
+WordSet build_word_set(char** words, int size) {
+    WordSet set;
+    unsigned int capacity = 1;
+    while (capacity < (unsigned int) size * SET_SLOTS_PER_WORD) {
+        capacity = capacity * 2;
+    }
+    set.mask = capacity - 1;
+    set.slots = calloc(capacity, sizeof(WordSlot));
+    for (int i = 0; i < size; i++) {
+        unsigned int hash = hash_word(words[i]);
+        unsigned int slot = hash & set.mask;
+        bool duplicate = false;
+        while (set.slots[slot].word != 0 && !duplicate) {
+            duplicate = set.slots[slot].hash == hash &&
+                    strcmp(words[set.slots[slot].word - 1], words[i]) == 0;
+            slot = (slot + 1) & set.mask;
+        }
+        if (!duplicate) {
+            set.slots[slot].word = i + 1;
+            set.slots[slot].hash = hash;
+        }
+    }
+    return set;
+}
+
+/* ngram_key()
+ * -----------
+ * This function finds the key of a 3 or 4 letter substring in a substring
+ * index
+ *
+ * ngram: The start of the substring
+ *
+ * length: The length of the substring, 3 or 4
+ *
+ * Returns: The key, or -1 if the substring is not all upper case letters
+*/
+int ngram_key(const char* ngram, int length) {
+    int key = 0;
+    for (int i = 0; i < length; i++) {
+        if (ngram[i] < 'A' || ngram[i] > 'Z') {
+            return -1;
+        }
+        key = key * ALPHABET_SIZE + (ngram[i] - 'A');
+    }
+    return length == MAX_NGRAM_LENGTH ? NGRAM3_KEYS + key : key;
+}
+
+/* starter_key()
+ * -------------
+ * This function finds the key of a starter word in a substring index
+ *
+ * starter: The starter word
+ *
+ * Returns: The key, or -1 if the starter word is not 3 or 4 upper case
+ * letters
+*/
+int starter_key(const char* starter) {
+    int length = strlen(starter);
+    if (length < MIN_NGRAM_LENGTH || length > MAX_NGRAM_LENGTH) {
+        return -1;
+    }
+    return ngram_key(starter, length);
+}
+
+/* word_ngram_keys()
+ * -----------------
+ * This function finds the keys of the distinct 3 and 4 letter substrings of a
+ * word
+ *
+ * word: The word, in upper case
+ *
+ * wordIndex: The index of the word in the dictionary
+ *
+ * only: The only substring whose key is to be given, or NULL to give every
+ * key
+ *
+ * lastWord: For each key, the index of the last word it was found in, which
+ * is updated so that a key is only given once for each word
+ *
+ * keys: Where to store the keys, with room for MAX_WORD_NGRAMS
+ *
+ * Returns: The number of keys stored
+*/
+int word_ngram_keys(const char* word, int wordIndex, const char* only,
+        int* lastWord, int* keys) {
+    int numKeys = 0;
+    if (only != NULL) {
+        keys[0] = starter_key(only);
+        return keys[0] >= 0 && strstr(word, only) != NULL ? 1 : 0;
+    }
+    int length = strlen(word);
+    for (int n = MIN_NGRAM_LENGTH; n <= MAX_NGRAM_LENGTH; n++) {
+        for (int i = 0; i + n <= length; i++) {
+            int key = ngram_key(word + i, n);
+            if (key >= 0 && lastWord[key] != wordIndex) {
+                lastWord[key] = wordIndex;
+                keys[numKeys++] = key;
+            }
+        }
+    }
+    return numKeys;
+}
+
+/* build_ngram_index()
+ * -------------------
+ * This function builds a substring index over an array of words. The words
+ * containing each substring are counted first so that every list can be laid
+ * out in one array, then the lists are filled in going through the words
+ * longest first. Indexing every substring takes several times as long as
+ * loading the dictionary, which only pays off when many starter words are to
+ * be looked up, so a single game indexes just its own starter word
+ *
+ * words: The words to be indexed, in upper case
+ *
+ * size: The number of words
+ *
+ * only: The only starter word to index, or NULL to index every substring
+ *
+ * Returns: The substring index
+*/
+NgramIndex build_ngram_index(char** words, int size, const char* only) {
+    NgramIndex index;
+    int keys[MAX_WORD_NGRAMS];
+    int* lastWord = malloc(sizeof(int) * NGRAM_KEYS);
+    int* next = calloc(NGRAM_KEYS + 1, sizeof(int));
+    memset(lastWord, -1, sizeof(int) * NGRAM_KEYS);
+    for (int i = 0; i < size; i++) {
+        int numKeys = word_ngram_keys(words[i], i, only, lastWord, keys);
+        for (int k = 0; k < numKeys; k++) {
+            next[keys[k] + 1]++;
+        }
+    }
+    for (int k = 0; k < NGRAM_KEYS; k++) {
+        next[k + 1] += next[k];
+    }
+    index.starts = malloc(sizeof(int) * (NGRAM_KEYS + 1));
+    memcpy(index.starts, next, sizeof(int) * (NGRAM_KEYS + 1));
+    index.words = malloc(sizeof(int) * (next[NGRAM_KEYS] + 1));
+
+    // sort the words longest first, keeping dictionary order between words of
+    // the same length, by counting how many there are of each length
+    int* byLength = calloc(MAX_LINE_LENGTH + 1, sizeof(int));
+    int* order = malloc(sizeof(int) * (size + 1));
+    for (int i = 0; i < size; i++) {
+        byLength[MAX_LINE_LENGTH - strlen(words[i])]++;
+    }
+    for (int i = 0, total = 0; i <= MAX_LINE_LENGTH; i++) {
+        int count = byLength[i];
+        byLength[i] = total;
+        total += count;
+    }
+    for (int i = 0; i < size; i++) {
+        order[byLength[MAX_LINE_LENGTH - strlen(words[i])]++] = i;
+    }
+
+    memset(lastWord, -1, sizeof(int) * NGRAM_KEYS);
+    for (int i = 0; i < size; i++) {
+        int numKeys = word_ngram_keys(words[order[i]], order[i], only,
+                lastWord, keys);
+        for (int k = 0; k < numKeys; k++) {
+            index.words[next[keys[k]]++] = order[i];
+        }
+    }
+    free(order);
+    free(byLength);
+    free(next);
+    free(lastWord);
+    return index;
+}
+
+/* words_containing()
+ * ------------------
+ * This function finds the words of a loaded dictionary which contain a
+ * starter word, through the dictionary's substring index
+ *
+ * dict: The dictionary to be searched
+ *
+ * starter: The starter word, 3 or 4 upper case letters
+ *
+ * found: Where to store the indexes of the words found, longest first
+ *
+ * Returns: The number of words found
+*/
+int words_containing(Dictionary dict, const char* starter,
+        const int** found) {
+    int key = starter_key(starter);
+    if (key < 0 || dict.index.starts == NULL) {
+        *found = NULL;
+        return 0;
+    }
+    *found = dict.index.words + dict.index.starts[key];
+    return dict.index.starts[key + 1] - dict.index.starts[key];
+}
+
 /* in_dictionary()
  * ---------------
+ * This function checks whether a word is in a dictionary, through its word
+ * set if it has one, otherwise by checking every word
  *
  * dictionary: The dictionary to be checked with
  *
- * word: The word to be checked
+ * word: The word to be checked, in upper case
  *
  * Returns: Boolean true if in the dictionary, false otherwise
 */
 bool in_dictionary(Dictionary dictionary, char* word) {
+    if (dictionary.set.slots != NULL) {
+        WordSet set = dictionary.set;
+        unsigned int hash = hash_word(word);
+        for (unsigned int slot = hash & set.mask; set.slots[slot].word != 0;
+                slot = (slot + 1) & set.mask) {
+            WordSlot found = set.slots[slot];
+            if (found.hash == hash &&
+                    strcmp(dictionary.words[found.word - 1], word) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
     for (int i = 0; i < dictionary.size; i++) {
         if (strcmp(dictionary.words[i], word) == 0) {
             return true;
@@ -398,10 +1396,13 @@ bool in_dictionary(Dictionary dictionary, char* word) {
  * ----------------
  * guess: current guess for a word to validate
  * game: the game containing the library and other values
+ * guesses: the valid guesses made so far
+ * out: where to print why the guess is not valid
  *
  * Returns: boolean true if a valid guess, false otherwise
 */
-bool validate_guess(char* guess, GameVariables game, Dictionary guesses) {
+bool validate_guess(char* guess, GameVariables game, Dictionary guesses,
+        FILE* out) {
     guess = str_to_upper(guess);
     char* contained;
     bool allAlpha;
@@ -411,23 +1412,23 @@ bool validate_guess(char* guess, GameVariables game, Dictionary guesses) {
     allAlpha = str_all_alpha(guess);
 
     if (!allAlpha) { // Must be only letters
-        printf("Guesses must contain only letters - try again.\n");
+        fprintf(out, "Guesses must contain only letters - try again.\n");
         return false;
     }
     if (contained == NULL) { // Must contain starter word
-        printf("Guesses must contain the starter word - try again.\n");
+        fprintf(out, "Guesses must contain the starter word - try again.\n");
         return false;
     }
     if (strcmp(guess, game.starterWord) == 0) { // Cannot be the starter word
-        printf("Guesses can't be the starter word - try again.\n");
+        fprintf(out, "Guesses can't be the starter word - try again.\n");
         return false;
     }
     if (!inDict) { // Must be in the dictionary
-        printf("Guess not found in dictionary - try again.\n");
+        fprintf(out, "Guess not found in dictionary - try again.\n");
         return false;
     }
     if (alreadyGuessed) { // Cannot use already guessed word
-        printf("You've already guessed that word - try again.\n");
+        fprintf(out, "You've already guessed that word - try again.\n");
         return false;
     }
     return true;
@@ -440,11 +1441,13 @@ bool validate_guess(char* guess, GameVariables game, Dictionary guesses) {
  *
  * game: The game variables being used for this instance of play
  *
- * dict: The dictionary to make sure word is within
+ * in: Where guesses are read from
  *
- * Returns: Boolean, if the guessing steps are finished
+ * out: Where prompts are printed to, flushed before each guess is read
+ *
+ * Returns: The valid guesses made
 */ 
-Dictionary get_guesses(GameVariables game) {
+Dictionary get_guesses(GameVariables game, FILE* in, FILE* out) {
     char buffer[MAX_LINE_LENGTH];
     Dictionary guesses;
 
@@ -452,27 +1455,34 @@ Dictionary get_guesses(GameVariables game) {
     guesses.maxLength = -1;
     guesses.size = 0;
     guesses.words = malloc(sizeof(char*) * MAX_GUESSES);
+    guesses.text = NULL;
+    guesses.set.slots = NULL;
+    guesses.index.starts = NULL;
+    guesses.index.words = NULL;
+    guesses.longest.mapping = NULL;
 
     while (guesses.size < MAX_GUESSES) {
         bool validGuess;
         char* currentGuess;
         do {
-            printf("Enter guess %d:\n", guesses.size + 1);
-            currentGuess = fgets(buffer, MAX_LINE_LENGTH, stdin);
+            fprintf(out, "Enter guess %d:\n", guesses.size + 1);
+            fflush(out);
+            currentGuess = fgets(buffer, MAX_LINE_LENGTH, in);
             // Check for guessing finished early with ctrl-d
             if (currentGuess == NULL) {
                 return guesses;
             }
             int length = strlen(currentGuess);
             if (currentGuess[0] == NEWLINE) {
-                printf("Guesses must contain the starter word - try again.\n");
+                fprintf(out, "Guesses must contain the starter word - try "
+                        "again.\n");
                 validGuess = false;
                 continue;
             }
             if (currentGuess[length - 1] == NEWLINE) {
                 currentGuess[length - 1] = NULLTERMINATOR;
             } 
-            validGuess = validate_guess(currentGuess, game, guesses);
+            validGuess = validate_guess(currentGuess, game, guesses, out);
         } while (!validGuess || !currentGuess);
         guesses.words[guesses.size] = strdup(currentGuess);
         if ((int) strlen(guesses.words[guesses.size]) > guesses.maxLength) {
@@ -483,3 +1493,205 @@ Dictionary get_guesses(GameVariables game) {
     return guesses;
 }
 
+
+/* open_port()
+ * -----------
+ * This function opens a TCP socket listening on the given port, on all
+ * interfaces, and prints the port actually listened on to standard error
+ *
+ * port: The port number or service name, 0 for any free port
+ *
+ * Returns: The listening socket, or -1 if it could not be opened
+*/
+int open_port(const char* port) {
+    struct addrinfo hints;
+    struct addrinfo* ai = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    if (getaddrinfo(NULL, port, &hints, &ai) != 0) {
+        return -1;
+    }
+    int optVal = 1;
+    int listenfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenfd < 0 || setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR,
+            &optVal, sizeof(optVal)) < 0 ||
+            bind(listenfd, ai->ai_addr, ai->ai_addrlen) < 0 ||
+            listen(listenfd, SOMAXCONN) < 0) {
+        if (listenfd >= 0) {
+            close(listenfd);
+        }
+        freeaddrinfo(ai);
+        return -1;
+    }
+    freeaddrinfo(ai);
+    struct sockaddr_in addr;
+    socklen_t addrLen = sizeof(addr);
+    getsockname(listenfd, (struct sockaddr*) &addr, &addrLen);
+    fprintf(stderr, "%d\n", ntohs(addr.sin_port));
+    fflush(stderr);
+    return listenfd;
+}
+
+/* open_unix()
+ * -----------
+ * This function opens a Unix domain socket listening at the given path,
+ * replacing any socket left there before (but nothing else)
+ *
+ * path: Where in the file system to create the socket
+ *
+ * Returns: The listening socket, or -1 if it could not be opened
+*/
+int open_unix(const char* path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    struct stat info;
+    if (stat(path, &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(path);
+    }
+    int listenfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenfd < 0 || bind(listenfd, (struct sockaddr*) &addr,
+            sizeof(addr)) < 0 || listen(listenfd, SOMAXCONN) < 0) {
+        if (listenfd >= 0) {
+            close(listenfd);
+        }
+        return -1;
+    }
+    return listenfd;
+}
+
+/* serve_games()
+ * -------------
+ * This function runs the server mode, started with --port and/or --unix in
+ * place of playing a single game on stdin. Every connection plays one game,
+ * exactly as a single game is played over stdin and stdout, on a thread of
+ * its own. The dictionary is loaded and indexed once, before any connection
+ * is accepted, and only read from then on, so every game shares it. Each game
+ * holds only its own starter word (the --start word, or a random one of the
+ * --len length), its guesses and small line buffers. A game ends when its
+ * client has made 5 valid guesses, closes its side of the connection, or
+ * leaves it idle for SESSION_TIMEOUT seconds. At most MAX_SESSIONS games are
+ * played at once
+ *
+ * server: The server mode options and the shared game, with its dictionary
+ *
+ * Returns: never
+ * Errors: exits with code 5 and prints to std error if the port or socket
+ * cannot be listened on
+*/
+void serve_games(Server* server) {
+    struct pollfd listeners[2];
+    int numListeners = 0;
+    if (server->port != NULL) {
+        listeners[numListeners++].fd = open_port(server->port);
+    }
+    if (server->unixPath != NULL) {
+        listeners[numListeners++].fd = open_unix(server->unixPath);
+    }
+    for (int i = 0; i < numListeners; i++) {
+        if (listeners[i].fd < 0) {
+            fprintf(stderr, "uqwordiply: unable to listen for games\n");
+            exit(LISTEN_ERROR);
+        }
+        listeners[i].events = POLLIN;
+    }
+    // a client leaving mid game must not end the server
+    struct sigaction ignore;
+    memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignore, NULL);
+    pthread_mutex_init(&server->starterLock, NULL);
+    sem_init(&server->freeSessions, 0, MAX_SESSIONS);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&attr, SESSION_STACK_SIZE);
+
+    while (true) {
+        if (poll(listeners, numListeners, -1) < 0) {
+            continue;
+        }
+        for (int i = 0; i < numListeners; i++) {
+            if (!(listeners[i].revents & POLLIN)) {
+                continue;
+            }
+            sem_wait(&server->freeSessions);
+            int fd = accept(listeners[i].fd, NULL, NULL);
+            if (fd < 0) {
+                sem_post(&server->freeSessions);
+                if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS ||
+                        errno == ENOMEM) {
+                    usleep(ACCEPT_BACKOFF);
+                }
+                continue;
+            }
+            // a client which never sends or reads must not hold its game
+            struct timeval timeout = {.tv_sec = SESSION_TIMEOUT};
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            Session* session = malloc(sizeof(Session));
+            session->fd = fd;
+            session->server = server;
+            pthread_t thread;
+            if (pthread_create(&thread, &attr, play_session, session) != 0) {
+                close(fd);
+                free(session);
+                sem_post(&server->freeSessions);
+            }
+        }
+    }
+}
+
+/* play_session()
+ * --------------
+ * This function plays one game over a connection, as the thread started for
+ * it by serve_games(), then closes the connection and frees its game slot
+ *
+ * arg: The session for the connection, which is freed
+ *
+ * Returns: NULL
+*/
+void* play_session(void* arg) {
+    Session* session = arg;
+    Server* server = session->server;
+    GameVariables game = server->game; // shares the dictionary, not copies it
+    char starter[MAX_NGRAM_LENGTH + 1];
+    if (game.starterWord == NULL) {
+        // the starter word library need not be safe to call from threads
+        pthread_mutex_lock(&server->starterLock);
+        strncpy(starter, get_wordiply_starter_word(server->starterLen),
+                MAX_NGRAM_LENGTH);
+        pthread_mutex_unlock(&server->starterLock);
+        starter[MAX_NGRAM_LENGTH] = NULLTERMINATOR;
+        game.starterWord = starter;
+    }
+    int outfd = dup(session->fd);
+    FILE* in = fdopen(session->fd, "r");
+    FILE* out = outfd < 0 ? NULL : fdopen(outfd, "w");
+    if (in == NULL || out == NULL) {
+        if (in != NULL) {
+            fclose(in);
+        } else {
+            close(session->fd);
+        }
+        if (out != NULL) {
+            fclose(out);
+        } else if (outfd >= 0) {
+            close(outfd);
+        }
+        free(session);
+        sem_post(&server->freeSessions);
+        return NULL;
+    }
+    setvbuf(in, session->inBuffer, _IOFBF, SESSION_BUFFER_SIZE);
+    setvbuf(out, session->outBuffer, _IOFBF, SESSION_BUFFER_SIZE);
+    free_guesses(play_game(game, in, out));
+    fclose(out);
+    fclose(in);
+    free(session);
+    sem_post(&server->freeSessions);
+    return NULL;
+}
@@ -0,0 +1,201 @@
+#!/bin/sh
+#
+# bench.sh
+#      CSSE2310 - Assignment Four
+#
+# Benchmarks for crackserver, run from this directory after make. Each one
+# starts its own servers on free ports and stops them when it is done.
+#
+# Usage:
+#  bench.sh placement dictionary
+#  bench.sh soak dictionary [rounds]
+#  bench.sh rainbow
+#  bench.sh logging dictionary
+#
+#  placement cracks a word missing from dictionary, so that all of it is
+#  swept, CRACKS times with one thread per online core, against a server
+#  started with each --placement mode in turn (none meaning no --placement),
+#  and prints the crack rate from the server's SIGHUP statistics.
+#
+#  soak makes a job of SOAK_WORDS crypts of words from dictionary, cracks of
+#  the resulting hashes and one invalid request. It then runs the job against
+#  one server rounds times (SOAK_ROUNDS by default) over a text connection
+#  and over 3 binary connections, printing the server's VmRSS every
+#  SOAK_EVERY rounds, which should stay flat.
+#
+#  rainbow has crackrainbow make a table of the lower case strings of up to
+#  4 letters for each number of chains in RAINBOW_CHAINS, RAINBOW_LENGTH steps
+#  long, and compare RAINBOW_LOOKUPS lookups of random strings in it with a
+#  brute force sweep. The strings differ between runs.
+#
+#  logging times LOG_REQUESTS crypts sent over one connection, against a
+#  server without logging and one with --log info, started alternately
+#  LOG_RUNS times each, and prints the median and best time of each.
+#
+
+# The number of cracks made against each server
+CRACKS=3
+# A word which is in no dictionary, and the salt it is crypted with
+MISS_WORD=bench-mi
+MISS_SALT=ab
+# The number of words in the soak job, and the default number of rounds of
+# it, of which the server's memory is printed every SOAK_EVERY
+SOAK_WORDS=100
+SOAK_ROUNDS=400
+SOAK_EVERY=50
+# The table sizes, chain length and number of lookups of the rainbow bench
+RAINBOW_CHAINS="5000 20000"
+RAINBOW_LENGTH=200
+RAINBOW_LOOKUPS=20
+# The number of crypts timed by the logging bench, and the runs of each mode
+LOG_REQUESTS=20000
+LOG_RUNS=5
+
+# usage
+# Prints the usage message and exits with status 1
+usage() {
+    echo "Usage: bench.sh placement dictionary" >&2
+    echo "       bench.sh soak dictionary [rounds]" >&2
+    echo "       bench.sh rainbow" >&2
+    echo "       bench.sh logging dictionary" >&2
+    exit 1
+}
+
+# start_server errfile argument...
+# Starts crackserver with the given arguments and its stderr in errfile, and
+# sets port and pid once it is listening. Exits if it never does.
+start_server() {
+    err=$1
+    shift
+    ./crackserver "$@" >/dev/null 2>"$err" </dev/null &
+    pid=$!
+    port=
+    while [ -z "$port" ] && kill -0 $pid 2>/dev/null; do
+        sleep 0.1
+        port=$(head -n 1 "$err")
+    done
+    if [ -z "$port" ]; then
+        echo "bench.sh: crackserver $* did not start" >&2
+        exit 2
+    fi
+}
+
+# stop_server
+# Has the server started last print its statistics, then stops it
+stop_server() {
+    kill -HUP $pid
+    sleep 1
+    kill $pid
+    wait $pid 2>/dev/null
+}
+
+# bench_placement dictionary
+# Prints the crack rate of each --placement mode, see the top of this file
+bench_placement() {
+    err=$(mktemp)
+    for mode in none pin replicate interleave; do
+        if [ $mode = none ]; then
+            start_server "$err" --dictionary "$1"
+        else
+            start_server "$err" --dictionary "$1" --placement $mode
+        fi
+        hash=$(echo "crypt $MISS_WORD $MISS_SALT" | ./crackclient $port)
+        for i in $(seq $CRACKS); do
+            echo "crack $hash $(nproc)"
+        done | ./crackclient $port >/dev/null
+        stop_server
+        echo "$mode: $(grep 'Crack rate' "$err")"
+    done
+    rm -f "$err"
+}
+
+# bench_soak dictionary rounds
+# Prints the server's memory as the soak job is run, see the top of this file
+bench_soak() {
+    err=$(mktemp)
+    crypts=$(mktemp)
+    job=$(mktemp)
+    start_server "$err" --dictionary "$1"
+    for word in $(awk 'length($0) <= 8' "$1" | head -n $SOAK_WORDS); do
+        echo "crypt $word $MISS_SALT"
+    done >"$crypts"
+    for hash in $(./crackclient $port "$crypts"); do
+        echo "crack $hash 1"
+    done >"$job"
+    cat "$crypts" >>"$job"
+    echo "crack" >>"$job"
+    for i in $(seq $2); do
+        ./crackclient $port "$job" >/dev/null
+        ./crackclient --connections 3 --binary $port "$job" >/dev/null
+        if [ $i -eq 1 ] || [ $((i % SOAK_EVERY)) -eq 0 ]; then
+            echo "round $i: $(grep VmRSS /proc/$pid/status)"
+        fi
+    done
+    stop_server
+    rm -f "$err" "$crypts" "$job"
+}
+
+# bench_rainbow
+# Prints crackrainbow's benchmark for each table size
+bench_rainbow() {
+    table=$(mktemp)
+    for chains in $RAINBOW_CHAINS; do
+        ./crackrainbow --charset abcdefghijklmnopqrstuvwxyz --maxlen 4 \
+                --chainlen $RAINBOW_LENGTH --chains $chains \
+                --bench $RAINBOW_LOOKUPS $MISS_SALT "$table"
+    done
+    rm -f "$table"
+}
+
+# bench_logging dictionary
+# Prints the time taken with and without logging, see the top of this file
+bench_logging() {
+    err=$(mktemp)
+    job=$(mktemp)
+    times=$(mktemp)
+    awk -v n=$LOG_REQUESTS -v salt=$MISS_SALT \
+            'BEGIN { for (i = 0; i < n; i++) print "crypt w" i, salt }' >"$job"
+    for run in $(seq $LOG_RUNS); do
+        for level in off info; do
+            if [ $level = off ]; then
+                start_server "$err" --dictionary "$1"
+            else
+                start_server "$err" --dictionary "$1" --log $level
+            fi
+            start=$(date +%s%N)
+            ./crackclient $port "$job" >/dev/null
+            end=$(date +%s%N)
+            stop_server
+            echo "$level $(((end - start) / 1000000))" >>"$times"
+        done
+    done
+    for level in off info; do
+        grep "^$level " "$times" | cut -d ' ' -f 2 | sort -n | awk \
+                -v level=$level '{ ms[NR] = $1 } END { printf "%s: median " \
+                "%d ms, best %d ms\n", level, ms[int((NR + 1) / 2)], ms[1] }'
+    done
+    rm -f "$err" "$job" "$times"
+}
+
+[ $# -ge 1 ] || usage
+case $1 in
+    placement)
+        [ $# -eq 2 ] || usage
+        bench_placement "$2"
+        ;;
+    soak)
+        [ $# -eq 2 ] || [ $# -eq 3 ] || usage
+        bench_soak "$2" "${3:-$SOAK_ROUNDS}"
+        ;;
+    rainbow)
+        [ $# -eq 1 ] || usage
+        bench_rainbow
+        ;;
+    logging)
+        [ $# -eq 2 ] || usage
+        bench_logging "$2"
+        ;;
+    *)
+        usage
+        ;;
+esac
@@ -0,0 +1,157 @@
+/*
+ * bloom.c
+ *      CSSE2310 - Assignment Four
+ *
+ *      Written by Alex Viller, a.viller@uqconnect.edu.au
+ *
+ * Bloom filters of strings, see bloom.h
+ *
+ */
+#include <stdlib.h>
+#include <limits.h>
+#include <math.h>
+#include "bloom.h"
+
+// The FNV-1a offset basis and prime
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+// The multiplier of the MurmurHash3 finaliser, used to derive a second hash
+#define MIX_MULTIPLIER 0xff51afd7ed558ccdULL
+// The number of bits in each word of a filter
+#define WORD_BITS 64
+
+/* Function Prototypes */
+void bloom_shape(long numItems, double falsePositiveRate, uint64_t* numBits,
+        int* numHashes);
+void bloom_hashes(const char* item, uint64_t* first, uint64_t* second);
+
+/* bloom_shape()
+ * -------------
+ * Works out the best number of bits and hash functions for a filter.
+ *
+ * numItems: How many strings will be added
+ *
+ * falsePositiveRate: The false positive rate wanted, between 0 and 1
+ *
+ * numBits: Where to store the number of bits, a whole number of words
+ *
+ * numHashes: Where to store the number of hash functions
+ *
+ * Returns: void
+ */
+void bloom_shape(long numItems, double falsePositiveRate, uint64_t* numBits,
+        int* numHashes) {
+    double bits = -numItems * log(falsePositiveRate) / (M_LN2 * M_LN2);
+    *numBits = ((uint64_t)bits / WORD_BITS + 1) * WORD_BITS;
+    *numHashes = (int)round((double)*numBits / numItems * M_LN2);
+    if (*numHashes < 1) {
+        *numHashes = 1;
+    } else if (*numHashes > BLOOM_MAX_HASHES) {
+        *numHashes = BLOOM_MAX_HASHES;
+    }
+}
+
+/* bloom_size()
+ * ------------
+ * Works out how much memory a filter would take.
+ *
+ * numItems: How many strings will be added
+ *
+ * falsePositiveRate: The false positive rate wanted, between 0 and 1
+ *
+ * Returns: The size of the filter in bytes
+ */
+size_t bloom_size(long numItems, double falsePositiveRate) {
+    uint64_t numBits;
+    int numHashes;
+    bloom_shape(numItems, falsePositiveRate, &numBits, &numHashes);
+    return sizeof(BloomFilter) + numBits / CHAR_BIT;
+}
+
+/* bloom_create()
+ * --------------
+ * Makes an empty filter.
+ *
+ * numItems: How many strings will be added
+ *
+ * falsePositiveRate: The false positive rate wanted, between 0 and 1
+ *
+ * Returns: The malloced filter, to be freed with free()
+ */
+BloomFilter* bloom_create(long numItems, double falsePositiveRate) {
+    BloomFilter* filter = calloc(1, bloom_size(numItems, falsePositiveRate));
+    if (filter != NULL) {
+        bloom_shape(numItems, falsePositiveRate, &filter->numBits,
+                &filter->numHashes);
+    }
+    return filter;
+}
+
+/* bloom_hashes()
+ * --------------
+ * Hashes a string two ways. Each of a filter's hash functions is then a
+ * different combination of the two.
+ *
+ * item: The string to hash
+ *
+ * first: Where to store the first hash
+ *
+ * second: Where to store the second hash, which is always odd
+ *
+ * Returns: void
+ */
+void bloom_hashes(const char* item, uint64_t* first, uint64_t* second) {
+    uint64_t value = FNV_OFFSET;
+    for (; *item != '\0'; item++) {
+        value = (value ^ (unsigned char)*item) * FNV_PRIME;
+    }
+    *first = value;
+    // a second, independent enough hash from mixing the first
+    value ^= value >> 33;
+    value *= MIX_MULTIPLIER;
+    value ^= value >> 33;
+    *second = value | 1;
+}
+
+/* bloom_add()
+ * -----------
+ * Adds a string to a filter. Bits are only ever set, atomically, so threads
+ * may add at the same time.
+ *
+ * filter: The filter to add to
+ *
+ * item: The string to add
+ *
+ * Returns: void
+ */
+void bloom_add(BloomFilter* filter, const char* item) {
+    uint64_t first, second;
+    bloom_hashes(item, &first, &second);
+    for (int i = 0; i < filter->numHashes; i++) {
+        uint64_t bit = (first + i * second) % filter->numBits;
+        __atomic_fetch_or(&filter->bits[bit / WORD_BITS],
+                1ULL << (bit % WORD_BITS), __ATOMIC_RELAXED);
+    }
+}
+
+/* bloom_contains()
+ * ----------------
+ * Checks whether a string may have been added to a filter.
+ *
+ * filter: The filter to check
+ *
+ * item: The string to check for
+ *
+ * Returns: false if the string was definitely never added
+ */
+bool bloom_contains(const BloomFilter* filter, const char* item) {
+    uint64_t first, second;
+    bloom_hashes(item, &first, &second);
+    for (int i = 0; i < filter->numHashes; i++) {
+        uint64_t bit = (first + i * second) % filter->numBits;
+        if (!(filter->bits[bit / WORD_BITS] & (1ULL << (bit % WORD_BITS)))) {
+            return false;
+        }
+    }
+    return true;
+}
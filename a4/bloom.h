@@ -0,0 +1,36 @@
+/*
+ * bloom.h
+ *      CSSE2310 - Assignment Four
+ *
+ *      Written by Alex Viller, a.viller@uqconnect.edu.au
+ *
+ * Bloom filters of strings. A filter never says a string it was given is
+ * missing, and says a string it was not given is present with about the
+ * false positive rate it was made for. Strings may be added from several
+ * threads at once.
+ *
+ */
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// The most hash functions a filter will use
+#define BLOOM_MAX_HASHES 16
+
+// struct for containing a filter, with its bits following it in memory
+typedef struct {
+    uint64_t numBits;
+    int numHashes;
+    uint64_t bits[];
+} BloomFilter;
+
+/* Function Prototypes */
+size_t bloom_size(long numItems, double falsePositiveRate);
+BloomFilter* bloom_create(long numItems, double falsePositiveRate);
+void bloom_add(BloomFilter* filter, const char* item);
+bool bloom_contains(const BloomFilter* filter, const char* item);
+
+#endif
@@ -5,8 +5,17 @@
  *      Written by Alex Viller, a.viller@uqconnect.edu.au
  *
  * Usage:
- *  crackclient portnum [jobfile]
- *          optional arguments must be after the portnum
+ *  crackclient [--connections num] [--binary | --shm] portnum [jobfile]
+ *          option arguments must be before the portnum, the job file must
+ *          be after it
+ *
+ *  A portnum containing a '/' is the path of a server's Unix domain socket
+ *  (see crackserver --unix). --shm, which needs such a path, sends requests
+ *  through shared memory rather than the socket. Commands too long to fit in
+ *  shared memory are answered as invalid.
+ *
+ *  Progress reports, profiles and ETAs (see the crackserver crack options)
+ *  are printed to standard error as they arrive.
  *
  */
 
@@ -15,20 +24,70 @@
 #include <string.h>
 #include <stdbool.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <ctype.h>
+#include <pthread.h>
 #include <netdb.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+#include <poll.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <csse2310a3.h>
 #include <csse2310a4.h>
+#include "crackprotocol.h"
 
 /* Global Definitions */
-// The number of arguments that there will be if there is a job file
-#define HAS_JOB_FILE 3
-// The number of arguments that there will be if there is no job file
-#define NO_JOB_FILE 2
+// The number of positional arguments that there will be if there is a job file
+#define HAS_JOB_FILE 2
+// The number of positional arguments that there will be if there is no job
+//      file
+#define NO_JOB_FILE 1
 // The default host name for using local host
 #define HOST "localhost"
+// The default number of connections to make to the server
+#define DEFAULT_CONNECTIONS 1
+// The maximum number of connections a single client may open at once
+#define MAX_CONNECTIONS 256
+// The maximum number of binary requests sent ahead of their responses when
+//      reading commands from a job file
+#define PIPELINE_DEPTH 32
+// The number of commands per connection that parallel mode holds at once,
+//      between reading them and printing their responses
+#define JOBS_PER_CONNECTION 32
+// How often, in milliseconds, a client waiting on a shared memory ring checks
+//      that the server is still there
+#define SHM_POLL_MS 100
+// The number of nanoseconds in a millisecond and in a second
+#define NS_PER_MS 1000000L
+#define NS_PER_SEC 1000000000L
+// The number of fields in a crypt command, and in a crack command before its
+//      options, matching the server
+#define MAX_COMMAND_ARGS 3
+// The maximum number of fields in any command, matching the server
+#define MAX_REQUEST_FIELDS 8
+// The length of a salt string for crypt
+#define SALT_LENGTH 2
+// The length of encrypted text
+#define CRYPT_LEN 13
+// The most digits in a numeric field that will be encoded in binary mode
+#define MAX_NUMBER_DIGITS 9
+// The crack options which binary mode knows how to encode
+#define TIMEOUT_OPTION "timeout="
+#define PROGRESS_OPTION "progress="
+#define PROFILE_OPTION "profile"
+// The response strings the server uses in the text protocol
+#define INVALID_RESPONSE ":invalid"
+#define FAILED_RESPONSE ":failed"
+#define TIMEOUT_RESPONSE ":timeout"
+#define PROGRESS_RESPONSE ":progress"
+#define PROFILE_RESPONSE ":profile"
+#define ETA_RESPONSE ":eta"
 
 /* New Type Creations */
 // enum containing all the error codes
@@ -40,33 +99,96 @@ typedef enum {
     CONNECTION_TERMINATED = 4
 } ErrorCodes;
 
-// enum containing the indecies of where we expect each command line arg to be
+// enum containing the indecies of where we expect each positional command
+//      line arg to be, after the option arguments have been removed
 typedef enum {
-    PORT_NUM = 1,
-    JOB_PATH = 2
+    PORT_NUM = 0,
+    JOB_PATH = 1
 } ArgIndex;
 
+// enum containing the values to be used for getopt_long
+typedef enum {
+    CONNECTIONS_ARG = 1,
+    BINARY_ARG = 2,
+    SHM_ARG = 3
+} ArgType;
+
 // A struct to hold information about the socket
 typedef struct {
     const char* portNum;
     const char* hostName;
     FILE* to;
     FILE* from;
+    bool binary;
+    uint32_t nextSendId;
+    uint32_t nextReceiveId;
+    ShmRing* ring;
 } SocketInfo;
 
 // A struct to hold all the information important for the client
 typedef struct {
-    SocketInfo sock;
+    SocketInfo* socks;
+    int numConnections;
+    bool binary;
+    bool shm;
     bool useJobFile;
     FILE* stream;
 } ClientData;
 
+// A struct to hold a single job line and the server's response to it
+typedef struct {
+    char* command;
+    char* response;
+    bool done;
+} Job;
+
+// A struct shared between the threads in parallel mode. The main thread adds
+// jobs as it reads them, they are handed out in input order to whichever
+// connection is free next, and the print thread prints the responses back
+// out in that same order. Only the jobs from numPrinted up to numJobs are
+// held, in a ring of capacity jobs indexed by job number.
+typedef struct {
+    Job* jobs;
+    int capacity;
+    long numJobs;
+    long nextJob;
+    long numPrinted;
+    bool inputDone;
+    bool terminated;
+    pthread_mutex_t lock;
+    pthread_cond_t jobAdded;
+    pthread_cond_t jobDone;
+    pthread_cond_t jobPrinted;
+} JobQueue;
+
+// A struct for containing the information for each connection thread
+typedef struct {
+    SocketInfo* sock;
+    JobQueue* queue;
+} ConnectionParams;
+
 /* Function Prototypes */
 int main(int argc, char* argv[]);
 ClientData get_args(int argc, char* argv[]);
+void print_usage(void);
 bool process_socket(SocketInfo* socketInfo);
+bool negotiate_binary(SocketInfo* socketInfo);
+bool negotiate_shm(SocketInfo* socketInfo, int index);
+bool send_request(SocketInfo* sock, const char* command);
+char* receive_response(SocketInfo* sock);
+char* receive_frame(SocketInfo* sock);
+char* receive_slot(SocketInfo* sock);
+int pack_setting(FrameHeader* header, unsigned char* payload,
+        const char* setting, size_t usualLength);
+bool is_number(const char* value);
 bool process_command(char** line);
 void add_new_line(char** line);
+void print_response(const char* fromServer);
+bool run_serial(ClientData* data);
+bool run_parallel(ClientData* data);
+void* connection_thread(void* arg);
+void* print_thread(void* arg);
+void close_sockets(ClientData* data);
 
 /* main()
  * ------
@@ -81,39 +203,16 @@ void add_new_line(char** line);
  */
 int main(int argc, char* argv[]) {
     ClientData data = get_args(argc, argv);
-    bool connectionTerminated = false;
-    
-    char* currentIn;
-    while ((currentIn = read_line(data.stream))) {
-        if (process_command(&currentIn)) {
-            // send command to server
-            fprintf(data.sock.to, "%s", currentIn);
-            fflush(data.sock.to); // flush to send message immediately
-            free(currentIn); // ensure no memory leakage
-
-            // receive server output
-            char* fromServer;
-            fromServer = read_line(data.sock.from);
-            if (fromServer == NULL) {
-                connectionTerminated = true;
-                break;
-            }
-            add_new_line(&fromServer);
+    bool connectionTerminated;
+
+    if (data.numConnections == DEFAULT_CONNECTIONS) {
+        connectionTerminated = !run_serial(&data);
+    } else {
+        connectionTerminated = !run_parallel(&data);
+    }
 
-            // handle server output
-            if (strcmp(":invalid\n", fromServer) == 0) {
-                fprintf(stdout, "Error in command\n");
-            } else if (strcmp(":failed\n", fromServer) == 0) {
-                fprintf(stdout, "Unable to decrypt\n");
-            } else {
-                fprintf(stdout, "%s", fromServer);
-            }
-            free(fromServer);
-        }
-    } 
     // close all streams
-    fclose(data.sock.to);
-    fclose(data.sock.from);
+    close_sockets(&data);
     if (data.useJobFile) { // only close if opened
         fclose(data.stream);
     }
@@ -126,6 +225,270 @@ int main(int argc, char* argv[]) {
     return OK;
 }
 
+/* run_serial()
+ * ------------
+ * Sends each command from the input stream to the server over the single
+ * connection, waiting for and printing each response before sending the next.
+ *
+ * data: The client data containing the input stream and the connection
+ *
+ * Returns: false if the server terminated the connection, true otherwise
+ */
+bool run_serial(ClientData* data) {
+    SocketInfo* sock = &data->socks[0];
+    // binary requests from a job file are sent ahead without waiting, since
+    // the responses are matched back to them by request ID, and shared
+    // memory requests by their slot
+    int depth = !data->useJobFile ? 1 : sock->ring ? SHM_RING_SLOTS :
+            sock->binary ? PIPELINE_DEPTH : 1;
+    int outstanding = 0;
+    bool moreInput = true;
+    
+    while (moreInput || outstanding > 0) {
+        char* currentIn = moreInput ? read_line(data->stream) : NULL;
+        if (currentIn == NULL) {
+            moreInput = false;
+        } else if (process_command(&currentIn)) {
+            // send command to server
+            send_request(sock, currentIn);
+            outstanding++;
+        }
+        free(currentIn); // ensure no memory leakage
+        if (outstanding == 0 || (moreInput && outstanding < depth)) {
+            continue;
+        }
+        fflush(sock->to); // flush to send messages immediately
+
+        // receive server output
+        char* fromServer;
+        fromServer = receive_response(sock);
+        if (fromServer == NULL) {
+            return false;
+        }
+        outstanding--;
+        print_response(fromServer);
+        free(fromServer);
+    } 
+    return true;
+}
+
+/* run_parallel()
+ * --------------
+ * Shares the commands from the input stream out between all of the open
+ * connections so the server can work on them concurrently. Each command is
+ * handed out as soon as it is read, and responses are printed in the same
+ * order as the commands were read, as soon as each one (and all those before
+ * it) have been answered. Reading waits while the connections are a full
+ * window of commands behind, so only that many are ever held.
+ *
+ * data: The client data containing the input stream and the connections
+ *
+ * Returns: false if the server terminated any connection before all of the
+ *      responses were received, true otherwise
+ */
+bool run_parallel(ClientData* data) {
+    JobQueue queue = {.capacity = data->numConnections * JOBS_PER_CONNECTION,
+            .numJobs = 0, .nextJob = 0, .numPrinted = 0, .inputDone = false,
+            .terminated = false};
+    queue.jobs = malloc(sizeof(Job) * queue.capacity);
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.jobAdded, NULL);
+    pthread_cond_init(&queue.jobDone, NULL);
+    pthread_cond_init(&queue.jobPrinted, NULL);
+
+    pthread_t* threads = malloc(sizeof(pthread_t) * data->numConnections);
+    ConnectionParams* params = malloc(sizeof(ConnectionParams) *
+            data->numConnections);
+    for (int i = 0; i < data->numConnections; i++) {
+        params[i].sock = &data->socks[i];
+        params[i].queue = &queue;
+        pthread_create(&threads[i], NULL, connection_thread, &params[i]);
+    }
+    pthread_t printer;
+    pthread_create(&printer, NULL, print_thread, &queue);
+
+    char* currentIn;
+    while ((currentIn = read_line(data->stream))) {
+        if (!process_command(&currentIn)) {
+            free(currentIn);
+            continue;
+        }
+        pthread_mutex_lock(&queue.lock);
+        while (!queue.terminated &&
+                queue.numJobs - queue.numPrinted == queue.capacity) {
+            pthread_cond_wait(&queue.jobPrinted, &queue.lock);
+        }
+        if (queue.terminated) { // nothing more will be answered
+            pthread_mutex_unlock(&queue.lock);
+            free(currentIn);
+            break;
+        }
+        Job* job = &queue.jobs[queue.numJobs++ % queue.capacity];
+        job->command = currentIn;
+        job->response = NULL;
+        job->done = false;
+        pthread_cond_signal(&queue.jobAdded);
+        pthread_mutex_unlock(&queue.lock);
+    }
+    pthread_mutex_lock(&queue.lock);
+    queue.inputDone = true;
+    pthread_cond_broadcast(&queue.jobAdded);
+    pthread_cond_broadcast(&queue.jobDone);
+    pthread_mutex_unlock(&queue.lock);
+
+    void* printed;
+    pthread_join(printer, &printed);
+    for (int i = 0; i < data->numConnections; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    for (long i = queue.numPrinted; i < queue.numJobs; i++) {
+        free(queue.jobs[i % queue.capacity].command);
+        free(queue.jobs[i % queue.capacity].response);
+    }
+    free(queue.jobs);
+    free(threads);
+    free(params);
+    pthread_mutex_destroy(&queue.lock);
+    pthread_cond_destroy(&queue.jobAdded);
+    pthread_cond_destroy(&queue.jobDone);
+    pthread_cond_destroy(&queue.jobPrinted);
+    return printed != NULL;
+}
+
+/* print_thread()
+ * --------------
+ * The thread which prints the responses in parallel mode, in input order,
+ * waiting on any not yet received. Each job is freed once printed, making
+ * room for the main thread to read another.
+ *
+ * arg: The JobQueue shared with the main and connection threads
+ *
+ * Returns: the queue if every response was printed, or NULL if the server
+ *      terminated a connection first
+ */
+void* print_thread(void* arg) {
+    JobQueue* queue = (JobQueue*)arg;
+
+    while (true) {
+        pthread_mutex_lock(&queue->lock);
+        Job* job = &queue->jobs[queue->numPrinted % queue->capacity];
+        // once terminated, only the jobs already sent will still be answered
+        while ((queue->numPrinted < queue->numJobs ? !job->done :
+                !queue->inputDone) && !(queue->terminated &&
+                queue->numPrinted >= queue->nextJob)) {
+            pthread_cond_wait(&queue->jobDone, &queue->lock);
+        }
+        if (queue->numPrinted == queue->numJobs && !queue->terminated) {
+            pthread_mutex_unlock(&queue->lock);
+            return queue;
+        }
+        if (!job->done || job->response == NULL) { // connection lost
+            pthread_mutex_unlock(&queue->lock);
+            return NULL;
+        }
+        pthread_mutex_unlock(&queue->lock);
+
+        print_response(job->response);
+        free(job->command);
+        free(job->response);
+        pthread_mutex_lock(&queue->lock);
+        queue->numPrinted++;
+        pthread_cond_signal(&queue->jobPrinted);
+        pthread_mutex_unlock(&queue->lock);
+    }
+}
+
+/* connection_thread()
+ * -------------------
+ * The thread run for each connection in parallel mode. Repeatedly takes the
+ * next unsent job from the queue, waiting for one to be read if need be,
+ * sends it to the server over this thread's connection and stores the
+ * response. If the server terminates the connection the queue is marked as
+ * terminated so that the other threads stop at that point.
+ *
+ * arg: The ConnectionParams for this thread
+ *
+ * Returns: void*
+ */
+void* connection_thread(void* arg) {
+    ConnectionParams* params = (ConnectionParams*)arg;
+    JobQueue* queue = params->queue;
+
+    while (true) {
+        pthread_mutex_lock(&queue->lock);
+        while (!queue->terminated && !queue->inputDone &&
+                queue->nextJob == queue->numJobs) {
+            pthread_cond_wait(&queue->jobAdded, &queue->lock);
+        }
+        if (queue->terminated || queue->nextJob == queue->numJobs) {
+            pthread_mutex_unlock(&queue->lock);
+            break;
+        }
+        // the ring may be refilled while we wait, but not this job's slot,
+        // which is only reused after it has been printed
+        Job* job = &queue->jobs[queue->nextJob++ % queue->capacity];
+        pthread_mutex_unlock(&queue->lock);
+
+        send_request(params->sock, job->command);
+        fflush(params->sock->to);
+        char* fromServer = receive_response(params->sock);
+
+        pthread_mutex_lock(&queue->lock);
+        job->response = fromServer;
+        job->done = true;
+        if (fromServer == NULL) { // stop everything still unanswered
+            queue->terminated = true;
+            pthread_cond_broadcast(&queue->jobAdded);
+            pthread_cond_broadcast(&queue->jobPrinted);
+        }
+        pthread_cond_broadcast(&queue->jobDone);
+        pthread_mutex_unlock(&queue->lock);
+    }
+    return NULL;
+}
+
+/* print_response()
+ * ----------------
+ * Prints a single response received from the server to stdout, translating
+ * the server's error responses into their user facing messages.
+ *
+ * fromServer: The response line from the server, without its new line
+ *
+ * Returns: void
+ */
+void print_response(const char* fromServer) {
+    if (strcmp(INVALID_RESPONSE, fromServer) == 0) {
+        fprintf(stdout, "Error in command\n");
+    } else if (strcmp(FAILED_RESPONSE, fromServer) == 0) {
+        fprintf(stdout, "Unable to decrypt\n");
+    } else if (strcmp(TIMEOUT_RESPONSE, fromServer) == 0) {
+        fprintf(stdout, "Timed out\n");
+    } else {
+        fprintf(stdout, "%s\n", fromServer);
+    }
+    fflush(stdout);
+}
+
+/* close_sockets()
+ * ---------------
+ * Closes the streams of every connection that was opened to the server and
+ * frees the list of connections.
+ *
+ * data: The client data containing the connections
+ *
+ * Returns: void
+ */
+void close_sockets(ClientData* data) {
+    for (int i = 0; i < data->numConnections; i++) {
+        if (data->socks[i].ring != NULL) {
+            munmap(data->socks[i].ring, sizeof(ShmRing));
+        }
+        fclose(data->socks[i].to);
+        fclose(data->socks[i].from);
+    }
+    free(data->socks);
+}
+
 /* get_args()
  * ----------
  * This function processes the command line arguments as well as checking
@@ -139,16 +502,48 @@ int main(int argc, char* argv[]) {
  * Returns: A ClientData struct containing all important information for the
  *      successful running of the program
  *
- * Errors: If the number of arguments given is not 1 (just portnum) or 2 (port
- *          and jobfile provided) -> usage error. 
+ * Errors: If the number of positional arguments given is not 1 (just portnum)
+ *          or 2 (port and jobfile provided), or an option is invalid
+ *          (including --shm without a socket path, or with --binary)
+ *          -> usage error. 
  *         If a jobfile is provided, and is not able to be opened for reading
  *          -> jobfile open error
  *         If the socket provided cannot be connected to -> port error
  */
 ClientData get_args(int argc, char* argv[]) {
     // initialise structs
-    ClientData data;
-    SocketInfo sock = {.portNum = argv[PORT_NUM], .hostName = HOST};
+    ClientData data = {.numConnections = DEFAULT_CONNECTIONS};
+    bool connectionsFlag = false;
+    static struct option longOpts[] = {
+        {"connections", required_argument, NULL, CONNECTIONS_ARG},
+        {"binary", no_argument, NULL, BINARY_ARG},
+        {"shm", no_argument, NULL, SHM_ARG},
+        {0, 0, 0, 0}
+    };
+
+    while (true) { // "+" stops at the portnum so the job file is not permuted
+        int opt = getopt_long(argc, argv, "+:", longOpts, NULL);
+        if (opt == -1) { // no more option args
+            break;
+        } else if (opt == CONNECTIONS_ARG && !connectionsFlag) {
+            connectionsFlag = true;
+            data.numConnections = atoi(optarg);
+            if (strlen(optarg) == 0 || strspn(optarg, "0123456789") !=
+                    strlen(optarg) || data.numConnections < 1 ||
+                    data.numConnections > MAX_CONNECTIONS) {
+                print_usage();
+            }
+        } else if (opt == BINARY_ARG && !data.binary && !data.shm) {
+            data.binary = true;
+        } else if (opt == SHM_ARG && !data.shm && !data.binary) {
+            data.shm = true;
+        } else {
+            print_usage();
+        }
+    }
+    argc -= optind;
+    argv += optind;
+
     // check correct number of args, and process arguments accordingly
     if (argc == NO_JOB_FILE) { // just port provided
         data.useJobFile = false;
@@ -158,35 +553,69 @@ ClientData get_args(int argc, char* argv[]) {
         // file open error
         if (data.stream == NULL) {
             fprintf(stderr, "crackclient: unable to open job file \"%s\"\n",
-                    argv[2]);
+                    argv[JOB_PATH]);
             exit(JOBFILE_ERR);
         } else {
             data.useJobFile = true;
         }
     } else { // incorrect number of arguments provided
-        fprintf(stderr, "Usage: crackclient portnum [jobfile]\n");
-        exit(USAGE_ERR);
+        print_usage();
+    }
+    if (data.shm && strchr(argv[PORT_NUM], '/') == NULL) {
+        print_usage(); // shared memory only works on the same host
     }
     
-    if (!process_socket(&sock)) { // portnum cannot be connected to
-        fprintf(stderr, "crackclient: unable to connect to port %s\n", 
-                sock.portNum);
-        if (data.useJobFile) {
-            fclose(data.stream);
+    data.socks = malloc(sizeof(SocketInfo) * data.numConnections);
+    for (int i = 0; i < data.numConnections; i++) {
+        SocketInfo sock = {.portNum = argv[PORT_NUM], .hostName = HOST,
+                .binary = data.binary, .ring = NULL};
+        bool connected = process_socket(&sock);
+        if (!connected || (sock.binary && !negotiate_binary(&sock)) ||
+                (data.shm && !negotiate_shm(&sock, i))) {
+            if (connected) { // the server is too old for the protocol
+                fprintf(stderr, "crackclient: server on port %s does not "
+                        "support --%s\n", sock.portNum,
+                        data.shm ? "shm" : "binary");
+                fclose(sock.to);
+                fclose(sock.from);
+            } else { // portnum cannot be connected to
+                fprintf(stderr, "crackclient: unable to connect to port %s\n",
+                        sock.portNum);
+            }
+            data.numConnections = i; // only close those already opened
+            close_sockets(&data);
+            if (data.useJobFile) {
+                fclose(data.stream);
+            }
+            exit(PORT_ERR);
         }
-        exit(PORT_ERR);
+        data.socks[i] = sock;
     }
-    data.sock = sock;
     return data;
 }
 
+/* print_usage()
+ * -------------
+ * Prints the usage message to standard error and exits.
+ *
+ * Returns: void
+ * Errors: Always exits with USAGE_ERR
+ */
+void print_usage(void) {
+    fprintf(stderr, "Usage: crackclient [--connections num] "
+            "[--binary | --shm] portnum [jobfile]\n");
+    exit(USAGE_ERR);
+}
+
 /* process_socket()
  * ----------------
  * This function takes in a pointer to a SocketInfo struct and adds the
  * appropriate information to it and also connects the client to the socket.
  * If there was an unsuccessful connection all information is properly closed
- * and false is returned. This function raises no errors and instead by
- * returning the connection status pushes the errors up the call chain.
+ * and false is returned. A portNum containing a '/' is instead connected to
+ * as the path of a Unix domain socket. This function raises no errors and
+ * instead by returning the connection status pushes the errors up the call
+ * chain.
  *
  * socketInfo: A pointer to the SocketInfo struct to have the information
  *          placed inside of
@@ -202,14 +631,24 @@ bool process_socket(SocketInfo* socketInfo) {
     hints.ai_family = AF_INET; // ipv4
     hints.ai_socktype = SOCK_STREAM;
     bool success = true;
+    struct sockaddr_un local = {.sun_family = AF_UNIX};
 
     int err;
-    if ((err = getaddrinfo(socketInfo->hostName, socketInfo->portNum,
+    if (strchr(socketInfo->portNum, '/') != NULL) {
+        strncpy(local.sun_path, socketInfo->portNum,
+                sizeof(local.sun_path) - 1);
+        sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (strlen(socketInfo->portNum) >= sizeof(local.sun_path) ||
+                connect(sockfd, (struct sockaddr*)&local,
+                sizeof(local)) == -1) {
+            success = false; // could not connect to the local server
+        }
+    } else if ((err = getaddrinfo(socketInfo->hostName, socketInfo->portNum,
             &hints, &ai)) != 0) {
         success = false; // cannot get address info
     }
     
-    if (success) { // guard already failed process
+    if (success && ai != NULL) { // guard already failed process
         sockfd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
         if (connect(sockfd, ai->ai_addr, ai->ai_addrlen) == -1) {
             success = false; // could not connect the socket to the server
@@ -224,10 +663,337 @@ bool process_socket(SocketInfo* socketInfo) {
         }
     }
 
-    freeaddrinfo(ai);
+    if (ai != NULL) {
+        freeaddrinfo(ai);
+    }
+    if (!success && sockfd >= 0) {
+        close(sockfd);
+    }
+    return success;
+}
+
+/* negotiate_binary()
+ * ------------------
+ * Asks the server to switch a freshly opened connection to the binary
+ * protocol and waits for it to acknowledge the switch.
+ *
+ * socketInfo: The connection to switch
+ *
+ * Returns: true if the server agreed to use the binary protocol
+ */
+bool negotiate_binary(SocketInfo* socketInfo) {
+    fputc(BINARY_MAGIC, socketInfo->to);
+    fflush(socketInfo->to);
+    socketInfo->nextSendId = socketInfo->nextReceiveId = 0;
+    return fgetc(socketInfo->from) == BINARY_MAGIC;
+}
+
+/* negotiate_shm()
+ * ---------------
+ * Creates a shared memory ring for a freshly opened local connection and asks
+ * the server to move the connection onto it. The ring's name is removed again
+ * once the server has mapped it (or failed to), so it never outlives both
+ * processes.
+ *
+ * socketInfo: The connection to move
+ *
+ * index: Which of the client's connections this is, to make the name unique
+ *
+ * Returns: true if the server is now reading requests from the ring
+ */
+bool negotiate_shm(SocketInfo* socketInfo, int index) {
+    char name[sizeof(SHM_NAME_PREFIX) + 2 * MAX_NUMBER_DIGITS + 2];
+    snprintf(name, sizeof(name), "%s%d.%d", SHM_NAME_PREFIX, (int)getpid(),
+            index);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        return false;
+    }
+    ShmRing* ring = MAP_FAILED;
+    if (ftruncate(fd, sizeof(ShmRing)) == 0) {
+        ring = mmap(NULL, sizeof(ShmRing), PROT_READ | PROT_WRITE, MAP_SHARED,
+                fd, 0);
+    }
+    close(fd);
+    bool success = ring != MAP_FAILED;
+    if (success) {
+        sem_init(&ring->requests, 1, 0);
+        sem_init(&ring->responses, 1, 0);
+        fprintf(socketInfo->to, "%s%s\n", SHM_COMMAND, name);
+        fflush(socketInfo->to);
+        char* reply = read_line(socketInfo->from);
+        success = reply != NULL && strcmp(reply, SHM_RESPONSE) == 0;
+        free(reply);
+    }
+    shm_unlink(name);
+    if (success) {
+        socketInfo->ring = ring;
+        socketInfo->nextSendId = socketInfo->nextReceiveId = 0;
+    } else if (ring != MAP_FAILED) {
+        munmap(ring, sizeof(ShmRing));
+    }
     return success;
 }
 
+/* send_request()
+ * --------------
+ * Writes a command to the server in the connection's protocol. In binary mode
+ * the command is encoded into a frame here; anything which does not look like
+ * a crack or crypt command is sent as OP_NONE so that the server still decides
+ * what is invalid. The request is buffered until the connection is flushed,
+ * except in shared memory, where the server sees it straight away.
+ *
+ * sock: The connection to send on
+ *
+ * command: The new line terminated command
+ *
+ * Returns: false if the request could not be written
+ */
+bool send_request(SocketInfo* sock, const char* command) {
+    if (sock->ring != NULL) {
+        char* request = sock->ring->slots[sock->nextSendId++ %
+                SHM_RING_SLOTS].request;
+        size_t length = strcspn(command, "\n");
+        // too long to fit, so send an empty (and so invalid) request instead
+        length = length < SHM_SLOT_SIZE ? length : 0;
+        memcpy(request, command, length);
+        request[length] = '\0';
+        return sem_post(&sock->ring->requests) == 0;
+    } else if (!sock->binary) {
+        return fprintf(sock->to, "%s", command) >= 0;
+    }
+    // split a copy of the command the same way the server splits text
+    char fields[MAX_FRAME_PAYLOAD + 1];
+    char* arguments[MAX_REQUEST_FIELDS + 1] = {fields};
+    snprintf(fields, sizeof(fields), "%s", command);
+    fields[strcspn(fields, "\n")] = '\0';
+    int numArgs = 1;
+    while (numArgs < MAX_REQUEST_FIELDS && (arguments[numArgs] =
+            strchr(arguments[numArgs - 1], ' ')) != NULL) {
+        *arguments[numArgs++]++ = '\0';
+    }
+
+    unsigned char frame[FRAME_HEADER_LEN + MAX_FRAME_PAYLOAD];
+    unsigned char* payload = frame + FRAME_HEADER_LEN;
+    FrameHeader header = {.opcode = OP_NONE, .flags = 0, .length = 0,
+            .requestId = sock->nextSendId++};
+    if (numArgs < MAX_COMMAND_ARGS ||
+            strcspn(command, "\n") > MAX_FRAME_PAYLOAD) {
+        // too few fields, or too long to have been copied whole, so leave as
+        // OP_NONE rather than send a different request
+    } else if (strcmp(arguments[0], "crack") == 0 &&
+            strlen(arguments[1]) <= UINT8_MAX) {
+        header.opcode = OP_CRACK;
+        // thread counts the server would reject are sent as 0, which it
+        // also rejects
+        int threads = atoi(arguments[2]);
+        payload[0] = is_number(arguments[2]) && threads <= UINT8_MAX ?
+                threads : 0;
+        int hashLength = pack_setting(&header, payload + 1, arguments[1],
+                CRYPT_LEN);
+        header.length = 1 + hashLength;
+        uint32_t options[2] = {0, 0}; // timeout, progress
+        for (int i = MAX_COMMAND_ARGS; i < numArgs; i++) {
+            if (strcmp(arguments[i], PROFILE_OPTION) == 0) {
+                header.flags |= PROFILE_FLAG;
+                continue;
+            }
+            header.length = 1 + hashLength + sizeof(options);
+            char* value = strchr(arguments[i], '=');
+            value = value != NULL && is_number(value + 1) &&
+                    atoi(value + 1) > 0 ? value + 1 : NULL;
+            if (value && strncmp(arguments[i], TIMEOUT_OPTION,
+                    strlen(TIMEOUT_OPTION)) == 0) {
+                options[0] = htonl(atoi(value));
+            } else if (value && strncmp(arguments[i], PROGRESS_OPTION,
+                    strlen(PROGRESS_OPTION)) == 0) {
+                options[1] = htonl(atoi(value));
+            } else {
+                header.opcode = OP_NONE; // not an option binary mode knows
+            }
+        }
+        memcpy(payload + 1 + hashLength, options, sizeof(options));
+    } else if (strcmp(arguments[0], "crypt") == 0 &&
+            numArgs == MAX_COMMAND_ARGS &&
+            strlen(arguments[2]) <= UINT8_MAX) {
+        header.opcode = OP_CRYPT;
+        int saltLength = pack_setting(&header, payload, arguments[2],
+                SALT_LENGTH);
+        header.length = saltLength + strlen(arguments[1]);
+        memcpy(payload + saltLength, arguments[1], strlen(arguments[1]));
+    }
+    if (header.opcode == OP_NONE) {
+        header.length = 0;
+    }
+    pack_header(frame, &header);
+    return fwrite(frame, 1, FRAME_HEADER_LEN + header.length, sock->to) ==
+            FRAME_HEADER_LEN + header.length;
+}
+
+/* pack_setting()
+ * --------------
+ * Writes the hash of a crack request or the salt of a crypt request into its
+ * payload. Those of the usual (DES) length are written as they are, anything
+ * else after a length byte, with SETTING_FLAG set in the header.
+ *
+ * header: The request's header
+ *
+ * payload: Where in the payload to write the setting
+ *
+ * setting: The hash or salt, at most UINT8_MAX characters
+ *
+ * usualLength: The length of a DES hash or salt
+ *
+ * Returns: the number of bytes written
+ */
+int pack_setting(FrameHeader* header, unsigned char* payload,
+        const char* setting, size_t usualLength) {
+    size_t length = strlen(setting);
+    if (length == usualLength) {
+        memcpy(payload, setting, length);
+        return length;
+    }
+    header->flags |= SETTING_FLAG;
+    payload[0] = length;
+    memcpy(payload + 1, setting, length);
+    return 1 + length;
+}
+
+/* is_number()
+ * -----------
+ * Checks that a string is a non-empty run of digits short enough for atoi.
+ *
+ * value: The string to check
+ *
+ * Returns: true if value is a valid number
+ */
+bool is_number(const char* value) {
+    size_t length = strlen(value);
+    return length > 0 && length <= MAX_NUMBER_DIGITS &&
+            strspn(value, "0123456789") == length;
+}
+
+/* receive_response()
+ * ------------------
+ * Reads the final response to the oldest outstanding request from the server,
+ * printing any progress reports, profile and ETA which come before it to
+ * standard error.
+ * Binary responses are converted to the equivalent text protocol response so
+ * the rest of the client can treat both protocols the same.
+ *
+ * sock: The connection to read from
+ *
+ * Returns: The malloced response without a new line, or NULL if the
+ *          connection was terminated (or sent an unexpected frame)
+ */
+char* receive_response(SocketInfo* sock) {
+    while (true) {
+        char* response = sock->ring ? receive_slot(sock) :
+                sock->binary ? receive_frame(sock) : read_line(sock->from);
+        if (response != NULL && strncmp(response, PROFILE_RESPONSE,
+                strlen(PROFILE_RESPONSE)) == 0) {
+            fprintf(stderr, "Profile: %s\n",
+                    response + strlen(PROFILE_RESPONSE) + 1);
+        } else if (response != NULL && strncmp(response, ETA_RESPONSE,
+                strlen(ETA_RESPONSE)) == 0) {
+            fprintf(stderr, "ETA: %s ms\n",
+                    response + strlen(ETA_RESPONSE) + 1);
+        } else if (response == NULL || strncmp(response, PROGRESS_RESPONSE,
+                strlen(PROGRESS_RESPONSE)) != 0) {
+            return response;
+        } else {
+            fprintf(stderr, "Progress: %s\n",
+                    response + strlen(PROGRESS_RESPONSE) + 1);
+        }
+        free(response);
+    }
+}
+
+/* receive_frame()
+ * ---------------
+ * Reads the next frame from a binary connection and converts it into the text
+ * protocol line which the server would have sent instead.
+ *
+ * sock: The connection to read from
+ *
+ * Returns: The malloced response without a new line, or NULL if the
+ *          connection was terminated (or sent an unexpected frame)
+ */
+char* receive_frame(SocketInfo* sock) {
+    unsigned char buffer[FRAME_HEADER_LEN];
+    FrameHeader header;
+    if (fread(buffer, 1, FRAME_HEADER_LEN, sock->from) != FRAME_HEADER_LEN) {
+        return NULL;
+    }
+    unpack_header(buffer, &header);
+    if (header.requestId != sock->nextReceiveId ||
+            header.length > MAX_FRAME_PAYLOAD) {
+        return NULL; // responses must come back in order
+    }
+    char* response = malloc(header.length + 1);
+    if (fread(response, 1, header.length, sock->from) != header.length) {
+        free(response);
+        return NULL;
+    }
+    response[header.length] = '\0';
+    if (header.opcode == OP_PROGRESS && header.length == 2 *
+            sizeof(uint32_t)) {
+        uint32_t counts[2];
+        memcpy(counts, response, sizeof(counts));
+        free(response);
+        response = malloc(sizeof(PROGRESS_RESPONSE) + 2 * MAX_NUMBER_DIGITS +
+                2 + 2);
+        sprintf(response, "%s %u/%u", PROGRESS_RESPONSE, ntohl(counts[0]),
+                ntohl(counts[1]));
+        return response; // not the final response to this request
+    } else if (header.opcode == OP_PROFILE) {
+        char* profile = malloc(sizeof(PROFILE_RESPONSE) + header.length + 1);
+        sprintf(profile, "%s %s", PROFILE_RESPONSE, response);
+        free(response);
+        return profile; // nor is this
+    }
+    sock->nextReceiveId++;
+    const char* text = header.opcode == OP_INVALID ? INVALID_RESPONSE :
+            header.opcode == OP_FAILED ? FAILED_RESPONSE :
+            header.opcode == OP_TIMEOUT ? TIMEOUT_RESPONSE : NULL;
+    if (text != NULL) {
+        free(response);
+        response = strdup(text);
+    }
+    return response;
+}
+
+/* receive_slot()
+ * --------------
+ * Waits for the server to answer the oldest outstanding request in a shared
+ * memory ring. While waiting, the socket is checked now and then in case the
+ * server has gone.
+ *
+ * sock: The connection whose ring is to be waited on
+ *
+ * Returns: The malloced response, or NULL if the connection was terminated
+ */
+char* receive_slot(SocketInfo* sock) {
+    while (true) {
+        struct timespec wake;
+        clock_gettime(CLOCK_REALTIME, &wake);
+        wake.tv_nsec += SHM_POLL_MS * NS_PER_MS;
+        wake.tv_sec += wake.tv_nsec / NS_PER_SEC;
+        wake.tv_nsec %= NS_PER_SEC;
+        if (sem_timedwait(&sock->ring->responses, &wake) == 0) {
+            break;
+        } else if (errno != ETIMEDOUT && errno != EINTR) {
+            return NULL;
+        }
+        struct pollfd pollFd = {.fd = fileno(sock->from), .events = POLLIN};
+        if (poll(&pollFd, 1, 0) != 0) {
+            return NULL; // the server never writes to the socket after :shm
+        }
+    }
+    return strndup(sock->ring->slots[sock->nextReceiveId++ %
+            SHM_RING_SLOTS].response, SHM_SLOT_SIZE - 1);
+}
+
 /* process_command()
  * -----------------
  * Simple function to check if a line being read is a comment or not. And then
@@ -0,0 +1,973 @@
+/*
+ * crackengine.c
+ *      CSSE2310 - Assignment Four
+ *
+ *      Written by Alex Viller, a.viller@uqconnect.edu.au
+ *
+ * The crack engine behind crackserver, see crackengine.h
+ *
+ */
+#define _GNU_SOURCE // for thread affinity
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include "crackengine.h"
+
+// Where the kernel lists the cpus of each NUMA node
+#define NODE_CPULIST "/sys/devices/system/node/node%d/cpulist"
+// The most digits a NUMA node number is given room for
+#define MAX_NODE_DIGITS 9
+// The longest cpu list of a NUMA node that will be read
+#define MAX_CPULIST_LEN 4096
+// The mbind() memory policy which spreads pages round robin over nodes, as
+//      in <numaif.h>
+#define MPOL_INTERLEAVE 3
+// The number of microseconds in a second and a millisecond
+#define US_PER_SEC 1000000LL
+#define US_PER_MS 1000
+// The number of nanoseconds in a microsecond
+#define NS_PER_US 1000
+// What testing one word against a hash of each scheme costs, in DES hashes,
+//      as measured with libxcrypt. SHA-crypt costs are per 1000 rounds and
+//      yescrypt's per YESCRYPT_COST_UNIT of its N times r.
+#define COST_DES 1
+#define COST_MD5 26
+#define COST_SHA256_PER_1000 110
+#define COST_SHA512_PER_1000 100
+#define YESCRYPT_COST_UNIT 32
+// The rounds SHA-crypt uses when a hash does not give any, and the fewest
+//      and most it will use
+#define SHA_DEFAULT_ROUNDS 5000
+#define SHA_MIN_ROUNDS 1000
+#define SHA_MAX_ROUNDS 999999999
+// The parameter a SHA-crypt hash gives its rounds in
+#define ROUNDS_PARAM "rounds="
+// The yescrypt N (as a power of 2) and r assumed when a hash's parameters
+//      cannot be read, which are libxcrypt's defaults, and the largest N
+//      which is believed
+#define YESCRYPT_DEFAULT_N_LOG2 12
+#define YESCRYPT_DEFAULT_R 32
+#define YESCRYPT_MAX_N_LOG2 30
+// The characters of crypt's base 64, in the order of their values
+#define ASCII64 "./0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"\
+                "abcdefghijklmnopqrstuvwxyz"
+
+// The prefix of each scheme's hashes, and its name, by HashScheme
+static const char* const schemePrefixes[NUM_SCHEMES] = {"", "$1$", "$5$",
+        "$6$", "$y$"};
+static const char* const schemeNames[NUM_SCHEMES] = {"des", "md5", "sha256",
+        "sha512", "yescrypt"};
+
+/* Function Prototypes */
+Dictionary copy_dict(Dictionary dict, const unsigned long* interleave);
+void find_nodes(CrackEngine* engine);
+bool parse_cpulist(const char* list, cpu_set_t* cpus);
+void place_dict(CrackEngine* engine);
+void* replica_thread(void* arg);
+int nth_cpu(const cpu_set_t* cpus, int n);
+void* crack_thread(void* arg);
+void crack_builtin(CrackThreadData* data);
+void crack_libc(CrackThreadData* data);
+void fill_profile(CrackProfile* profile, const CrackJob* job);
+bool parse_setting(const char* setting, size_t length, HashInfo* info);
+long sha_cost(HashScheme scheme, const char* params, const char* end);
+long yescrypt_cost(const char* params, const char* end);
+
+/* engine_load_dict()
+ * ------------------
+ * Goes line by line through a dictionary file, keeping each word that is
+ * between 1 and ENGINE_MAX_WORD_LEN characters long.
+ *
+ * path: The path to the dictionary to be read
+ *
+ * dict: Where to store the dictionary, which may be left with no words
+ *
+ * Returns: false if the file could not be opened
+ */
+bool engine_load_dict(const char* path, Dictionary* dict) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+    memset(dict, 0, sizeof(Dictionary));
+    int capacity = 1;
+    dict->words = malloc(sizeof(char*) * capacity);
+    char* line = NULL;
+    size_t lineSize = 0;
+    ssize_t length;
+    while ((length = getline(&line, &lineSize, file)) >= 0) {
+        if (length > 0 && line[length - 1] == '\n') {
+            line[--length] = '\0';
+        }
+        if (length > ENGINE_MAX_WORD_LEN || length == 0) {
+            continue; // skip over this word if not the right length
+        }
+        if (dict->numWords == capacity) { // double the list when full
+            capacity *= 2;
+            dict->words = realloc(dict->words, sizeof(char*) * capacity);
+        }
+        dict->words[dict->numWords++] = strdup(line);
+    }
+    free(line);
+    fclose(file);
+    return true;
+}
+
+/* engine_free_dict()
+ * ------------------
+ * Frees a dictionary, whether it was loaded by engine_load_dict() or is a
+ * packed copy.
+ *
+ * dict: The dictionary to be freed
+ *
+ * Returns: void
+ */
+void engine_free_dict(Dictionary dict) {
+    if (dict.packed != NULL) {
+        munmap(dict.packed, dict.packedSize);
+        return;
+    }
+    for (int i = 0; i < dict.numWords; i++) {
+        free(dict.words[i]);
+    }
+    free(dict.words);
+}
+
+/* copy_dict()
+ * -----------
+ * Makes a packed copy of a dictionary in a fresh mapping. The kernel places
+ * each page on the NUMA node of the thread which first writes it, so the copy
+ * is local to whichever node this is called on, unless it is interleaved.
+ *
+ * dict: The dictionary to be copied
+ *
+ * interleave: A bit mask of the nodes to spread the copy evenly over, or NULL
+ *
+ * Returns: The copy, or dict itself if there was no memory for a copy
+ */
+Dictionary copy_dict(Dictionary dict, const unsigned long* interleave) {
+    Dictionary copy = {.numWords = dict.numWords,
+            .packedSize = sizeof(char*) * dict.numWords};
+    for (int i = 0; i < dict.numWords; i++) {
+        copy.packedSize += strlen(dict.words[i]) + 1;
+    }
+    copy.packed = mmap(NULL, copy.packedSize, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (copy.packed == MAP_FAILED) {
+        return dict;
+    }
+    if (interleave != NULL) { // must come before any page is touched
+        syscall(SYS_mbind, copy.packed, copy.packedSize, MPOL_INTERLEAVE,
+                interleave, sizeof(*interleave) * CHAR_BIT, 0);
+    }
+    copy.words = (char**)copy.packed;
+    char* text = copy.packed + sizeof(char*) * dict.numWords;
+    for (int i = 0; i < dict.numWords; i++) {
+        size_t length = strlen(dict.words[i]) + 1;
+        memcpy(text, dict.words[i], length);
+        copy.words[i] = text;
+        text += length;
+    }
+    return copy;
+}
+
+/* engine_create()
+ * ---------------
+ * Makes an engine, finding the NUMA nodes and laying the dictionary out over
+ * them as placement asks.
+ *
+ * dict: The dictionary, which the engine takes over and frees when it is
+ *      destroyed. It may be replaced by a copy, so use the engine's.
+ *
+ * cpus: The cpus job threads may run on, or NULL to let them run anywhere
+ *
+ * placement: How to place the threads and dictionary. Anything but
+ *      PLACE_NONE needs cpus.
+ *
+ * nice: The nice value job threads run at, or 0 to leave them at the
+ *      caller's
+ *
+ * Returns: The engine
+ */
+CrackEngine* engine_create(Dictionary dict, const cpu_set_t* cpus,
+        Placement placement, int nice) {
+    CrackEngine* engine = calloc(1, sizeof(CrackEngine));
+    engine->dict = dict;
+    engine->pinned = cpus != NULL;
+    if (cpus != NULL) {
+        engine->cpus = *cpus;
+    }
+    engine->placement = cpus != NULL ? placement : PLACE_NONE;
+    engine->nice = nice;
+    find_nodes(engine);
+    place_dict(engine);
+    return engine;
+}
+
+/* engine_destroy()
+ * ----------------
+ * Frees an engine, its dictionary and any replicas of it. No jobs may be
+ * running on it.
+ *
+ * engine: The engine
+ *
+ * Returns: void
+ */
+void engine_destroy(CrackEngine* engine) {
+    for (int i = 0; i < engine->numNodes; i++) {
+        if (engine->nodes[i].dict.words != engine->dict.words) {
+            engine_free_dict(engine->nodes[i].dict);
+        }
+    }
+    engine_free_dict(engine->dict);
+    free(engine);
+}
+
+/* find_nodes()
+ * ------------
+ * Reads which cpus belong to each NUMA node from sysfs. Only cpus this
+ * process may run on are kept, and nodes left with none are skipped. If
+ * nothing can be read, every cpu is treated as being on a single node 0.
+ *
+ * engine: The engine to store the nodes in
+ *
+ * Returns: void
+ */
+void find_nodes(CrackEngine* engine) {
+    cpu_set_t online;
+    sched_getaffinity(0, sizeof(online), &online);
+    engine->numNodes = 0;
+    for (int id = 0; id < ENGINE_MAX_NODES; id++) {
+        char path[sizeof(NODE_CPULIST) + MAX_NODE_DIGITS];
+        char list[MAX_CPULIST_LEN];
+        snprintf(path, sizeof(path), NODE_CPULIST, id);
+        FILE* file = fopen(path, "r");
+        if (file == NULL) {
+            continue; // node numbers need not be contiguous
+        }
+        NumaNode* node = &engine->nodes[engine->numNodes];
+        bool valid = fgets(list, sizeof(list), file) != NULL &&
+                parse_cpulist(list, &node->cpus);
+        fclose(file);
+        CPU_AND(&node->cpus, &node->cpus, &online);
+        if (valid && CPU_COUNT(&node->cpus) > 0) {
+            node->id = id;
+            node->dict = engine->dict;
+            engine->numNodes++;
+        }
+    }
+    if (engine->numNodes == 0) {
+        engine->nodes[0].id = 0;
+        engine->nodes[0].cpus = online;
+        engine->nodes[0].dict = engine->dict;
+        engine->numNodes = 1;
+    }
+}
+
+/* parse_cpulist()
+ * ---------------
+ * Parses a kernel cpu list, such as "0-3,8-11", into a cpu set.
+ *
+ * list: The list to be parsed, which may end in a new line
+ *
+ * cpus: The set to store the cpus in
+ *
+ * Returns: true if the whole list was valid
+ */
+bool parse_cpulist(const char* list, cpu_set_t* cpus) {
+    CPU_ZERO(cpus);
+    while (*list != '\0' && *list != '\n') {
+        char* end;
+        long first = strtol(list, &end, 10);
+        long last = first;
+        if (end == list) {
+            return false;
+        } else if (*end == '-') {
+            list = end + 1;
+            last = strtol(list, &end, 10);
+            if (end == list) {
+                return false;
+            }
+        }
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, cpus);
+        }
+        list = *end == ',' ? end + 1 : end;
+    }
+    return true;
+}
+
+/* place_dict()
+ * ------------
+ * Lays out the dictionary in memory as the engine's placement asks. For
+ * replicate, a thread pinned to each NUMA node makes that node's copy, and
+ * the original is kept for anything not pinned to a node. For interleave, the
+ * dictionary is replaced by a copy spread over all of the nodes.
+ *
+ * engine: The engine containing the dictionary and nodes
+ *
+ * Returns: void
+ */
+void place_dict(CrackEngine* engine) {
+    if (engine->placement == PLACE_INTERLEAVE) {
+        unsigned long mask = 0;
+        for (int i = 0; i < engine->numNodes; i++) {
+            if (engine->nodes[i].id < (int)(sizeof(mask) * CHAR_BIT)) {
+                mask |= 1UL << engine->nodes[i].id;
+            }
+        }
+        Dictionary copy = copy_dict(engine->dict, &mask);
+        if (copy.packed != NULL) {
+            engine_free_dict(engine->dict);
+            engine->dict = copy;
+            for (int i = 0; i < engine->numNodes; i++) {
+                engine->nodes[i].dict = copy;
+            }
+        }
+    } else if (engine->placement == PLACE_REPLICATE) {
+        pthread_t threads[ENGINE_MAX_NODES];
+        for (int i = 0; i < engine->numNodes; i++) {
+            pthread_attr_t attr;
+            pthread_attr_init(&attr);
+            pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t),
+                    &engine->nodes[i].cpus);
+            pthread_create(&threads[i], &attr, replica_thread,
+                    &engine->nodes[i]);
+            pthread_attr_destroy(&attr);
+        }
+        for (int i = 0; i < engine->numNodes; i++) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+}
+
+/* replica_thread()
+ * ----------------
+ * The thread run on each NUMA node to replace that node's dictionary with a
+ * copy in the node's own memory.
+ *
+ * arg: The NumaNode to make the copy for
+ *
+ * Returns: void*
+ */
+void* replica_thread(void* arg) {
+    NumaNode* node = (NumaNode*)arg;
+    node->dict = copy_dict(node->dict, NULL);
+    return NULL;
+}
+
+/* nth_cpu()
+ * ---------
+ * Finds a cpu of a set by its position, wrapping around to the start of the
+ * set when n is larger than it.
+ *
+ * cpus: The set to look in, which must not be empty
+ *
+ * n: The position of the cpu to be found, counting from 0
+ *
+ * Returns: The number of the cpu
+ */
+int nth_cpu(const cpu_set_t* cpus, int n) {
+    n %= CPU_COUNT(cpus);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, cpus) && n-- == 0) {
+            return cpu;
+        }
+    }
+    return 0;
+}
+
+/* engine_job_size()
+ * -----------------
+ * Works out how much memory a job needs, for callers which give
+ * engine_submit() their own.
+ *
+ * numThreads: The number of threads the job will use
+ *
+ * Returns: The size in bytes
+ */
+size_t engine_job_size(int numThreads) {
+    return sizeof(CrackJob) +
+            (sizeof(CrackThreadData) + sizeof(pthread_t)) * numThreads;
+}
+
+/* engine_submit()
+ * ---------------
+ * Starts a job searching part of the engine's dictionary for the word which
+ * encrypts to a hash. The range is split evenly between the threads, and the
+ * job returns straight away while they search.
+ *
+ * engine: The engine to run the job on
+ *
+ * encrypted: The hash to crack, which is copied
+ *
+ * numThreads: The number of threads to search with, up to ENGINE_MAX_THREADS
+ *
+ * start: The first word of the dictionary to search
+ *
+ * end: One past the last word of the dictionary to search
+ *
+ * bloom: A Bloom filter to add the hash of every word searched to, or NULL.
+ *      Only DES hashes can be added to one.
+ *
+ * nice: The nice value the job's threads run at, or 0 for the engine's
+ *
+ * memory: engine_job_size(numThreads) bytes aligned to ENGINE_CACHE_LINE to
+ *      keep the job in, which must last until it is finished, or NULL to
+ *      allocate it
+ *
+ * Returns: The job, or NULL if the hash or thread count is invalid or the
+ *      job could not be started
+ */
+CrackJob* engine_submit(const CrackEngine* engine, const char* encrypted,
+        int numThreads, int start, int end, BloomFilter* bloom, int nice,
+        void* memory) {
+    HashInfo info;
+    if (!engine_parse_hash(encrypted, &info) ||
+            (bloom != NULL && info.scheme != SCHEME_DES) ||
+            numThreads <= 0 || numThreads > ENGINE_MAX_THREADS ||
+            start < 0 || start > end || end > engine->dict.numWords) {
+        return NULL;
+    }
+    bool ownsMemory = memory == NULL;
+    if (ownsMemory && posix_memalign(&memory, ENGINE_CACHE_LINE,
+            engine_job_size(numThreads)) != 0) {
+        return NULL;
+    }
+    CrackJob* job = memory;
+    memset(job, 0, sizeof(CrackJob));
+    job->doneFd = eventfd(0, EFD_NONBLOCK); // counts threads that finished
+    if (job->doneFd < 0) {
+        if (ownsMemory) {
+            free(job);
+        }
+        return NULL;
+    }
+    strcpy(job->encrypted, encrypted);
+    memcpy(job->salt, encrypted, ENGINE_SALT_LEN);
+    job->info = info;
+    job->numThreads = numThreads;
+    job->ownsMemory = ownsMemory;
+    job->startUs = engine_now_us();
+    job->threadData = (CrackThreadData*)(job + 1);
+    job->threads = (pthread_t*)(job->threadData + numThreads);
+    // the salt and hash only need working out once for the whole job. A hash
+    // the builtin DES cannot decode is left to crypt_r(), which behaves the
+    // same either way.
+    uint32_t saltBits = 0;
+    DesBlock target = {0, 0};
+    bool builtin = engine->crypt == CRYPT_BUILTIN &&
+            info.scheme == SCHEME_DES && des_parse_salt(job->salt, &saltBits) &&
+            des_decode(job->encrypted + ENGINE_SALT_LEN, &target);
+
+    int rangeLen = end - start;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (engine->pinned) {
+        pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &engine->cpus);
+    }
+    for (int i = 0; i < numThreads; i++) {
+        CrackThreadData* data = &job->threadData[i];
+        memset(data, 0, sizeof(CrackThreadData));
+        data->encrypted = job->encrypted;
+        // crypt_r() reads the setting of any other scheme from the hash
+        data->salt = info.scheme == SCHEME_DES ? job->salt : job->encrypted;
+        // each thread gets floor(rangeLen / numThreads) words, and the last
+        // thread gets the rest of the words
+        data->start = start + i * (rangeLen / numThreads);
+        data->end = i == numThreads - 1 ? end :
+                data->start + rangeLen / numThreads;
+        data->dict = engine->dict;
+        data->stopFlag = &job->stopFlag;
+        data->doneFd = job->doneFd;
+        data->nice = nice != 0 ? nice : engine->nice;
+        data->bloom = bloom;
+        data->builtin = builtin;
+        data->saltBits = saltBits;
+        data->target = target;
+        if (engine->placement != PLACE_NONE) {
+            int cpuNum = nth_cpu(&engine->cpus, i);
+            cpu_set_t cpu; // spread the threads one to a core
+            CPU_ZERO(&cpu);
+            CPU_SET(cpuNum, &cpu);
+            pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &cpu);
+            for (int j = 0; j < engine->numNodes &&
+                    engine->placement == PLACE_REPLICATE; j++) {
+                if (CPU_ISSET(cpuNum, &engine->nodes[j].cpus)) {
+                    data->dict = engine->nodes[j].dict;
+                }
+            }
+        }
+        pthread_create(&job->threads[i], &attr, crack_thread, data);
+    }
+    pthread_attr_destroy(&attr);
+    return job;
+}
+
+/* crack_thread()
+ * --------------
+ * The thread method started by engine_submit() which does the actual
+ * cracking of the encryption.
+ *
+ * arg: The CrackThreadData struct which contains all the important information
+ *      for cracking a password, as well as the part of the dictionary this
+ *      thread should search.
+ *
+ * Returns: void*
+ * Errors: should not produce any errors.
+ */
+void* crack_thread(void* arg) {
+    CrackThreadData* data = (CrackThreadData*)arg;
+    data->startUs = engine_now_us();
+    if (data->nice != 0) {
+        setpriority(PRIO_PROCESS, syscall(SYS_gettid), data->nice);
+    }
+    if (data->builtin) {
+        crack_builtin(data);
+    } else {
+        crack_libc(data);
+    }
+
+    data->endUs = engine_now_us();
+    eventfd_write(data->doneFd, 1); // let the job's owner know we are done
+    return NULL;
+}
+
+/* crack_builtin()
+ * ---------------
+ * Searches a crack thread's part of the dictionary with the engine's own
+ * DES. Each word's block is compared to the job's decoded hash, so it is
+ * only encoded as text when there is a Bloom filter to add it to.
+ *
+ * data: The thread's data
+ *
+ * Returns: void
+ */
+void crack_builtin(CrackThreadData* data) {
+    DesKey key;
+    DesBlock block;
+    char encryptedWord[ENGINE_HASH_LEN + 1];
+    for (int i = data->start; i < data->end; i++) {
+        if (*data->stopFlag) {
+            break;
+        }
+        // only this thread writes the counter, others just read it
+        __atomic_store_n(&data->tested, i - data->start + 1, __ATOMIC_RELAXED);
+
+        des_set_key(data->dict.words[i], &key);
+        des_crypt_block(&key, data->saltBits, &block);
+        if (data->bloom != NULL) {
+            des_encode(&block, data->salt, encryptedWord);
+            bloom_add(data->bloom, encryptedWord + ENGINE_SALT_LEN);
+        }
+
+        if (block.l == data->target.l && block.r == data->target.r) {
+            *data->stopFlag = 1;
+            data->result = data->dict.words[i];
+            break;
+        }
+    }
+}
+
+/* crack_libc()
+ * ------------
+ * Searches a crack thread's part of the dictionary with crypt_r().
+ *
+ * data: The thread's data
+ *
+ * Returns: void
+ */
+void crack_libc(CrackThreadData* data) {
+    struct crypt_data cryptData;
+    cryptData.initialized = 0;
+    for (int i = data->start; i < data->end; i++) {
+        if (*data->stopFlag) {
+            break;
+        }
+        // only this thread writes the counter, others just read it
+        __atomic_store_n(&data->tested, i - data->start + 1, __ATOMIC_RELAXED);
+
+        // crypt_r() only touches cryptData, so the threads need no lock
+        char* encryptedWord = crypt_r(data->dict.words[i], data->salt,
+                &cryptData);
+        if (encryptedWord == NULL) {
+            continue; // crypt_r() gave up on the setting, so nothing matches
+        }
+        if (data->bloom != NULL) {
+            bloom_add(data->bloom, encryptedWord + ENGINE_SALT_LEN);
+        }
+
+        if (strcmp(encryptedWord, data->encrypted) == 0) {
+            *data->stopFlag = 1;
+            data->result = data->dict.words[i];
+            break;
+        }
+    }
+}
+
+/* engine_job_fd()
+ * ---------------
+ * Gets a file descriptor which is readable whenever some of a job's threads
+ * have finished since engine_poll() was last called, for callers waiting on
+ * several things at once with poll().
+ *
+ * job: The job
+ *
+ * Returns: The file descriptor, which belongs to the job
+ */
+int engine_job_fd(const CrackJob* job) {
+    return job->doneFd;
+}
+
+/* engine_poll()
+ * -------------
+ * Checks, without blocking, whether all of a job's threads have finished.
+ *
+ * job: The job
+ *
+ * Returns: true if the job is done and engine_finish() will not block
+ */
+bool engine_poll(CrackJob* job) {
+    eventfd_t count;
+    if (eventfd_read(job->doneFd, &count) == 0) {
+        job->finished += count;
+    }
+    return job->finished == job->numThreads;
+}
+
+/* engine_wait()
+ * -------------
+ * Waits for all of a job's threads to finish.
+ *
+ * job: The job
+ *
+ * timeoutMs: The longest to wait, or -1 to wait for as long as it takes
+ *
+ * Returns: true if the job is done, false if the wait timed out first
+ */
+bool engine_wait(CrackJob* job, int timeoutMs) {
+    long long deadline = engine_now_us() + (long long)timeoutMs * US_PER_MS;
+    while (!engine_poll(job)) {
+        int waitMs = -1;
+        if (timeoutMs >= 0) {
+            long long left = deadline - engine_now_us();
+            if (left <= 0) {
+                return false;
+            }
+            waitMs = (left + US_PER_MS - 1) / US_PER_MS;
+        }
+        struct pollfd pollFd = {.fd = job->doneFd, .events = POLLIN};
+        poll(&pollFd, 1, waitMs);
+    }
+    return true;
+}
+
+/* engine_tested()
+ * ---------------
+ * Counts how many words a job has tested so far, read from its threads'
+ * counters so they never need to synchronise.
+ *
+ * job: The job
+ *
+ * Returns: The number of words tested
+ */
+long engine_tested(const CrackJob* job) {
+    long tested = 0;
+    for (int i = 0; i < job->numThreads; i++) {
+        tested += __atomic_load_n(&job->threadData[i].tested,
+                __ATOMIC_RELAXED);
+    }
+    return tested;
+}
+
+/* engine_cancel()
+ * ---------------
+ * Asks a job's threads to stop searching. They finish soon after, and the job
+ * must still be finished. Safe to call from any thread, more than once.
+ *
+ * job: The job
+ *
+ * Returns: void
+ */
+void engine_cancel(CrackJob* job) {
+    job->stopFlag = 1;
+}
+
+/* engine_stopped()
+ * ----------------
+ * Checks whether a job's threads have been told to stop, either because one
+ * of them found the word or because the job was cancelled.
+ *
+ * job: The job
+ *
+ * Returns: true if the threads are stopping
+ */
+bool engine_stopped(const CrackJob* job) {
+    return job->stopFlag != 0;
+}
+
+/* engine_finish()
+ * ---------------
+ * Waits for a job's threads to finish and collects its result. The job may
+ * not be used afterwards.
+ *
+ * job: The job, which is freed if engine_submit() allocated it
+ *
+ * tested: Where to store the number of words tested, or NULL
+ *
+ * profile: Where to store the job's profile, or NULL
+ *
+ * Returns: The word which encrypts to the hash, or NULL if it was not found
+ *      (including if the job was cancelled before it was)
+ */
+const char* engine_finish(CrackJob* job, long* tested, CrackProfile* profile) {
+    const char* result = NULL;
+    long total = 0;
+    for (int i = 0; i < job->numThreads; i++) {
+        pthread_join(job->threads[i], NULL);
+        total += job->threadData[i].tested;
+        if (job->threadData[i].result != NULL) {
+            result = job->threadData[i].result;
+        }
+    }
+    close(job->doneFd);
+    if (tested != NULL) {
+        *tested = total;
+    }
+    if (profile != NULL) {
+        fill_profile(profile, job);
+    }
+    if (job->ownsMemory) {
+        free(job);
+    }
+    return result;
+}
+
+/* fill_profile()
+ * --------------
+ * Works out a job's profile from its threads' counters once they have all
+ * been joined.
+ *
+ * profile: The profile to fill in
+ *
+ * job: The job
+ *
+ * Returns: void
+ */
+void fill_profile(CrackProfile* profile, const CrackJob* job) {
+    profile->startUs = job->startUs;
+    profile->numThreads = job->numThreads;
+    profile->tested = 0;
+    profile->spawnUs = profile->computeUs = 0;
+    for (int i = 0; i < job->numThreads; i++) {
+        const CrackThreadData* data = &job->threadData[i];
+        profile->tested += data->tested;
+        if (data->startUs - job->startUs > profile->spawnUs) {
+            profile->spawnUs = data->startUs - job->startUs;
+        }
+        if (data->endUs - job->startUs > profile->computeUs) {
+            profile->computeUs = data->endUs - job->startUs;
+        }
+        long long runUs = data->endUs - data->startUs;
+        profile->rates[i] = runUs > 0 ? data->tested * US_PER_SEC / runUs :
+                0;
+    }
+}
+
+/* engine_crypt()
+ * --------------
+ * Encrypts a word with a salt, as the engine's jobs do.
+ *
+ * key: The plain text to be encrypted
+ *
+ * salt: The ENGINE_SALT_LEN character salt to encrypt with, or the setting
+ *      of another scheme, such as $6$rounds=10000$salt, with or without a
+ *      trailing '$'
+ *
+ * data: The crypt_r() state to use, which the result is written into
+ *
+ * Returns: The encrypted text, or NULL if the salt is invalid
+ */
+const char* engine_crypt(const char* key, const char* salt,
+        struct crypt_data* data) {
+    HashInfo info;
+    size_t length = strlen(salt);
+    if (salt[0] == '$') {
+        if (length > 0 && salt[length - 1] == '$') {
+            length--;
+        }
+        if (length > ENGINE_MAX_HASH_LEN ||
+                !parse_setting(salt, length, &info)) {
+            return NULL;
+        }
+    } else if (strspn(salt, ENGINE_SALT_CHARS) != ENGINE_SALT_LEN) {
+        return NULL; // salt not exclusively plaintext
+    }
+    const char* encrypted = crypt_r(key, salt, data);
+    // crypt_r() answers a setting it cannot use with a token starting '*'
+    return encrypted != NULL && encrypted[0] != '*' ? encrypted : NULL;
+}
+
+/* engine_parse_hash()
+ * -------------------
+ * Works out which scheme made a hash, and how much testing a word against it
+ * costs, from its setting. Costs are in DES hashes, so that a cost of 500
+ * means that 500 DES words could be tested in the time of one of these.
+ *
+ * hash: The hash
+ *
+ * info: Where to store its scheme and cost
+ *
+ * Returns: false if the hash is not one any scheme could have made
+ */
+bool engine_parse_hash(const char* hash, HashInfo* info) {
+    size_t length = strlen(hash);
+    if (hash[0] != '$') {
+        info->scheme = SCHEME_DES;
+        info->cost = COST_DES;
+        return length == ENGINE_HASH_LEN &&
+                strspn(hash, ENGINE_SALT_CHARS) >= ENGINE_SALT_LEN;
+    }
+    const char* text = strrchr(hash, '$') + 1;
+    if (length > ENGINE_MAX_HASH_LEN || *text == '\0' ||
+            strspn(text, ENGINE_SALT_CHARS) != strlen(text)) {
+        return false;
+    }
+    return parse_setting(hash, text - 1 - hash, info);
+}
+
+/* parse_setting()
+ * ---------------
+ * Reads the setting of a modular crypt hash: its scheme's prefix, then any
+ * parameters followed by a '$', then its salt.
+ *
+ * setting: The setting
+ *
+ * length: The length of the setting, which need not be terminated there
+ *
+ * info: Where to store its scheme and cost
+ *
+ * Returns: false if the scheme is unknown or the setting is not valid for it
+ */
+bool parse_setting(const char* setting, size_t length, HashInfo* info) {
+    int scheme = SCHEME_MD5;
+    while (scheme < NUM_SCHEMES && strncmp(setting, schemePrefixes[scheme],
+            strlen(schemePrefixes[scheme])) != 0) {
+        scheme++;
+    }
+    if (scheme == NUM_SCHEMES || length <= strlen(schemePrefixes[scheme])) {
+        return false;
+    }
+    info->scheme = scheme;
+    const char* params = setting + strlen(schemePrefixes[scheme]);
+    const char* end = setting + length;
+    const char* dollar = memchr(params, '$', end - params);
+    const char* salt = dollar != NULL ? dollar + 1 : params;
+    if (salt == end || memchr(salt, '$', end - salt) != NULL) {
+        return false; // no salt, or more parameters than any scheme takes
+    }
+    if (scheme == SCHEME_MD5) {
+        info->cost = COST_MD5;
+        return dollar == NULL;
+    } else if (scheme == SCHEME_YESCRYPT) {
+        info->cost = dollar != NULL ? yescrypt_cost(params, dollar) : 0;
+        return dollar != NULL;
+    }
+    info->cost = sha_cost(scheme, dollar != NULL ? params : NULL, dollar);
+    return info->cost > 0;
+}
+
+/* sha_cost()
+ * ----------
+ * Works out the cost of a SHA-crypt hash from its rounds.
+ *
+ * scheme: SCHEME_SHA256 or SCHEME_SHA512
+ *
+ * params: The hash's parameters, or NULL if it has none
+ *
+ * end: The '$' after the parameters
+ *
+ * Returns: The cost, or 0 if the parameters are not valid
+ */
+long sha_cost(HashScheme scheme, const char* params, const char* end) {
+    long rounds = SHA_DEFAULT_ROUNDS;
+    if (params != NULL) {
+        const char* digits = params + strlen(ROUNDS_PARAM);
+        char* digitsEnd;
+        if (strncmp(params, ROUNDS_PARAM, strlen(ROUNDS_PARAM)) != 0 ||
+                !isdigit(*digits)) {
+            return 0;
+        }
+        rounds = strtol(digits, &digitsEnd, 10);
+        if (digitsEnd != end) {
+            return 0;
+        }
+        // crypt_r() quietly clamps the rounds, so this does too
+        rounds = rounds < SHA_MIN_ROUNDS ? SHA_MIN_ROUNDS :
+                rounds > SHA_MAX_ROUNDS ? SHA_MAX_ROUNDS : rounds;
+    }
+    return rounds * (scheme == SCHEME_SHA256 ? COST_SHA256_PER_1000 :
+            COST_SHA512_PER_1000) / 1000;
+}
+
+/* yescrypt_cost()
+ * ---------------
+ * Works out the cost of a yescrypt hash, which is proportional to its N times
+ * its r. Its parameters start with a flavour character, then N's power of 2
+ * less 1 and r less 1, each as a base 64 digit. Parameters which cannot be
+ * read are taken to be the defaults.
+ *
+ * params: The hash's parameters
+ *
+ * end: The '$' after the parameters
+ *
+ * Returns: The cost
+ */
+long yescrypt_cost(const char* params, const char* end) {
+    int nLog2 = YESCRYPT_DEFAULT_N_LOG2;
+    int r = YESCRYPT_DEFAULT_R;
+    if (end - params >= 3) { // none of these can be '\0' or '$'
+        const char* nDigit = strchr(ASCII64, params[1]);
+        const char* rDigit = strchr(ASCII64, params[2]);
+        if (nDigit != NULL && rDigit != NULL &&
+                nDigit - ASCII64 < YESCRYPT_MAX_N_LOG2) {
+            nLog2 = nDigit - ASCII64 + 1;
+            r = rDigit - ASCII64 + 1;
+        }
+    }
+    long cost = ((long)r << nLog2) / YESCRYPT_COST_UNIT;
+    return cost > 0 ? cost : 1;
+}
+
+/* engine_scheme_name()
+ * --------------------
+ * Names a hash scheme, for logs and statistics.
+ *
+ * scheme: The scheme
+ *
+ * Returns: Its name
+ */
+const char* engine_scheme_name(HashScheme scheme) {
+    return schemeNames[scheme];
+}
+
+/* engine_now_us()
+ * ---------------
+ * Reads the monotonic clock which job times are measured on.
+ *
+ * Returns: The time in microseconds
+ */
+long long engine_now_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * US_PER_SEC + now.tv_nsec / NS_PER_US;
+}
@@ -0,0 +1,209 @@
+/*
+ * crackengine.h
+ *      CSSE2310 - Assignment Four
+ *
+ *      Written by Alex Viller, a.viller@uqconnect.edu.au
+ *
+ * The crack engine behind crackserver, built as libcrackengine.a so that
+ * other programs can crack hashes in-process without running a server.
+ *
+ * An engine holds a dictionary, laid out over the NUMA nodes as its
+ * Placement asks, and the cpus its threads run on. Jobs are submitted to it
+ * and run on their own threads in the background:
+ *
+ *      CrackEngine* engine = engine_create(dict, NULL, PLACE_NONE, 0);
+ *      CrackJob* job = engine_submit(engine, hash, 4, 0,
+ *              engine->dict.numWords, NULL, 0, NULL);
+ *      while (!engine_wait(job, 100)) {
+ *          ... engine_tested(job) words tested so far ...
+ *      }
+ *      const char* word = engine_finish(job, NULL, NULL);
+ *
+ * Hashes may be traditional DES ones or, in the modular crypt format, MD5
+ * ($1$), SHA-256 ($5$), SHA-512 ($6$) or yescrypt ($y$) ones.
+ * engine_parse_hash() tells which, and estimates how much each word tested
+ * against the hash costs, in DES hashes, from its scheme and its rounds, so
+ * that callers can size and schedule jobs accordingly.
+ *
+ * A job's fd may instead be added to the caller's own poll() loop, with
+ * engine_poll() called whenever it is readable. engine_cancel() stops a job
+ * early from any thread. Every job must be finished exactly once.
+ *
+ * Jobs hash DES words with the engine's own DES (see descrypt.h) unless
+ * crypt is set to CRYPT_LIBC, in which case they use crypt_r() as before.
+ * Every other scheme always uses crypt_r().
+ *
+ * cpu_set_t needs _GNU_SOURCE to be defined before anything is included.
+ *
+ */
+#ifndef CRACKENGINE_H
+#define CRACKENGINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sched.h>
+#include <pthread.h>
+#include <crypt.h>
+#include "bloom.h"
+#include "descrypt.h"
+
+// crypt can only encrypt the first 8 characters of a word, so longer words
+//      are left out of dictionaries. Only DES stops at 8 characters, but
+//      every scheme is cracked from the same dictionary, so a $1$, $5$, $6$
+//      or $y$ password longer than this can never be found
+#define ENGINE_MAX_WORD_LEN 8
+// The length of a salt
+#define ENGINE_SALT_LEN 2
+// The length of a hash, including its salt
+#define ENGINE_HASH_LEN 13
+// The longest hash of any scheme a job may crack
+#define ENGINE_MAX_HASH_LEN 256
+// The characters a salt may be made of
+#define ENGINE_SALT_CHARS "abcdefghijklmnopqrstuvwxyz"\
+                          "ABCDEFGHIJKLMNOPQRSTUVWXYZ"\
+                          "0123456789./"
+// The most threads a single job may use
+#define ENGINE_MAX_THREADS 64
+// The most NUMA nodes an engine will look for
+#define ENGINE_MAX_NODES 64
+// The size of a cache line, which each thread's counters are padded to and
+//      which memory given to engine_submit() must be aligned to
+#define ENGINE_CACHE_LINE 64
+
+// enum containing where crack threads and the dictionary they scan are placed
+typedef enum {
+    PLACE_NONE = 0,
+    PLACE_PIN = 1,
+    PLACE_REPLICATE = 2,
+    PLACE_INTERLEAVE = 3
+} Placement;
+
+// enum containing the schemes a hash may have been made with
+typedef enum {
+    SCHEME_DES = 0,
+    SCHEME_MD5 = 1,
+    SCHEME_SHA256 = 2,
+    SCHEME_SHA512 = 3,
+    SCHEME_YESCRYPT = 4,
+    NUM_SCHEMES = 5
+} HashScheme;
+
+// struct for containing what a hash says about how it was made: its scheme
+// and how many DES hashes testing one word against it costs
+typedef struct {
+    HashScheme scheme;
+    long cost;
+} HashInfo;
+
+// enum containing which implementation of crypt jobs hash words with
+typedef enum {
+    CRYPT_BUILTIN = 0,
+    CRYPT_LIBC = 1
+} CryptImpl;
+
+// struct for containing the dictionary. A copy made by copy_dict() keeps its
+// words and their pointers together in the one mapping, packed.
+typedef struct {
+    char** words;
+    int numWords;
+    char* packed;
+    size_t packedSize;
+} Dictionary;
+
+// struct for containing a NUMA node and the dictionary replica local to it
+typedef struct {
+    int id;
+    cpu_set_t cpus;
+    Dictionary dict;
+} NumaNode;
+
+// struct for containing an engine. Threads run on cpus, each on its own one
+// unless placement is PLACE_NONE, at the nice value nice, and hash words with
+// crypt, which engine_create() sets to CRYPT_BUILTIN.
+typedef struct {
+    Dictionary dict;
+    bool pinned;
+    cpu_set_t cpus;
+    Placement placement;
+    NumaNode nodes[ENGINE_MAX_NODES];
+    int numNodes;
+    int nice;
+    CryptImpl crypt;
+} CrackEngine;
+
+// struct for containing where the time of a job went. startUs is when it was
+// submitted, spawnUs how long until the last of its threads was running and
+// computeUs how long until they had all finished. Each thread's rate is in
+// hashes per second.
+typedef struct {
+    long tested;
+    int numThreads;
+    long long startUs;
+    long long spawnUs;
+    long long computeUs;
+    long rates[ENGINE_MAX_THREADS];
+} CrackProfile;
+
+// struct for containing thread information for a job. Each one is aligned to
+// its own cache line since tested is updated on every word. If builtin is
+// set, words are hashed with the engine's DES and compared to target.
+typedef struct {
+    const char* encrypted;
+    const char* salt;
+    int start;
+    int end;
+    Dictionary dict;
+    char* result;
+    volatile int* stopFlag;
+    int doneFd;
+    int nice;
+    long tested;
+    long long startUs;
+    long long endUs;
+    BloomFilter* bloom;
+    bool builtin;
+    uint32_t saltBits;
+    DesBlock target;
+} __attribute__((aligned(ENGINE_CACHE_LINE))) CrackThreadData;
+
+// struct for containing a job. Its threads and their data are kept in the
+// same block of memory, straight after it. finished counts the threads which
+// have finished so far.
+typedef struct {
+    char encrypted[ENGINE_MAX_HASH_LEN + 1];
+    char salt[ENGINE_SALT_LEN + 1];
+    HashInfo info;
+    int numThreads;
+    volatile int stopFlag;
+    int doneFd;
+    int finished;
+    bool ownsMemory;
+    long long startUs;
+    pthread_t* threads;
+    CrackThreadData* threadData;
+} __attribute__((aligned(ENGINE_CACHE_LINE))) CrackJob;
+
+/* Function Prototypes */
+bool engine_load_dict(const char* path, Dictionary* dict);
+void engine_free_dict(Dictionary dict);
+CrackEngine* engine_create(Dictionary dict, const cpu_set_t* cpus,
+        Placement placement, int nice);
+void engine_destroy(CrackEngine* engine);
+size_t engine_job_size(int numThreads);
+CrackJob* engine_submit(const CrackEngine* engine, const char* encrypted,
+        int numThreads, int start, int end, BloomFilter* bloom, int nice,
+        void* memory);
+int engine_job_fd(const CrackJob* job);
+bool engine_poll(CrackJob* job);
+bool engine_wait(CrackJob* job, int timeoutMs);
+long engine_tested(const CrackJob* job);
+void engine_cancel(CrackJob* job);
+bool engine_stopped(const CrackJob* job);
+const char* engine_finish(CrackJob* job, long* tested, CrackProfile* profile);
+const char* engine_crypt(const char* key, const char* salt,
+        struct crypt_data* data);
+bool engine_parse_hash(const char* hash, HashInfo* info);
+const char* engine_scheme_name(HashScheme scheme);
+long long engine_now_us(void);
+
+#endif
@@ -0,0 +1,319 @@
+/*
+ * cracklog.c
+ *      CSSE2310 - Assignment Four
+ *
+ *      Written by Alex Viller, a.viller@uqconnect.edu.au
+ *
+ * Asynchronous logging for crackserver, see cracklog.h
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <strings.h>
+#include <time.h>
+#include <pthread.h>
+#include "cracklog.h"
+
+// The number of nanoseconds in a second and a microsecond
+#define NS_PER_SEC 1000000000L
+#define NS_PER_US 1000L
+// The length of a formatted timestamp, without its fraction
+#define TIMESTAMP_LEN 20
+// The longest a formatted record can be
+#define LOG_LINE_LEN 256
+// The most bytes of records written to the log stream at once
+#define LOG_BATCH_SIZE 65536
+
+/* Function Prototypes */
+LogRing* thread_ring(void);
+void release_ring(void* arg);
+int format_record(const LogRecord* record, char* line);
+void drain_rings(void);
+void* writer_thread(void* arg);
+
+// The names of the log levels, by level
+static const char* const levelNames[] = {"off", "error", "warn", "info",
+        "debug"};
+
+// The least severe level being logged, LOG_OFF until logging is started
+static LogLevel logLevel = LOG_OFF;
+// Where records are written to
+static FILE* logStream;
+// Every ring there has been, newest first. Rings are only ever pushed.
+static LogRing* rings;
+// The number of rings there have been, used to number them
+static int numRings;
+// The number of records dropped because their ring was full
+static unsigned long dropped;
+// Whether the writer should drain one last time and exit
+static int stopping;
+// The writer thread
+static pthread_t writer;
+// Used to give rings back when their thread exits
+static pthread_key_t ringKey;
+// The calling thread's ring, NULL until it first logs
+static __thread LogRing* myRing;
+
+/* log_parse_level()
+ * -----------------
+ * Finds the level with a given name.
+ *
+ * name: The name, one of off, error, warn, info or debug
+ *
+ * level: Where to store the level
+ *
+ * Returns: false if there is no level with that name
+ */
+bool log_parse_level(const char* name, LogLevel* level) {
+    for (int i = LOG_OFF; i <= LOG_DEBUG; i++) {
+        if (strcasecmp(name, levelNames[i]) == 0) {
+            *level = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* log_start()
+ * -----------
+ * Starts logging records at or above a level, and the thread which writes
+ * them. Must be called at most once, before any other threads log.
+ *
+ * level: The least severe level to log, or LOG_OFF to log nothing
+ *
+ * stream: Where to write records to
+ *
+ * Returns: void
+ */
+void log_start(LogLevel level, FILE* stream) {
+    if (level == LOG_OFF) {
+        return;
+    }
+    logStream = stream;
+    pthread_key_create(&ringKey, release_ring);
+    pthread_create(&writer, NULL, writer_thread, NULL);
+    __atomic_store_n(&logLevel, level, __ATOMIC_RELEASE);
+}
+
+/* log_stop()
+ * ----------
+ * Stops logging, waiting for every record logged so far to be written.
+ *
+ * Returns: void
+ */
+void log_stop(void) {
+    if (__atomic_exchange_n(&logLevel, LOG_OFF, __ATOMIC_ACQ_REL) ==
+            LOG_OFF) {
+        return;
+    }
+    __atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+    pthread_join(writer, NULL);
+}
+
+/* log_enabled()
+ * -------------
+ * Checks whether records at a level are being logged, so that callers can
+ * skip working out what to log.
+ *
+ * level: The level to check
+ *
+ * Returns: true if records at the level are logged
+ */
+bool log_enabled(LogLevel level) {
+    return level != LOG_OFF &&
+            level <= __atomic_load_n(&logLevel, __ATOMIC_ACQUIRE);
+}
+
+/* thread_ring()
+ * -------------
+ * Finds the calling thread's ring, taking one given back by an exited thread
+ * or making a new one the first time the thread logs.
+ *
+ * Returns: The ring, or NULL if a new one was needed but could not be made
+ */
+LogRing* thread_ring(void) {
+    if (myRing != NULL) {
+        return myRing;
+    }
+    for (LogRing* ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+            ring != NULL && myRing == NULL; ring = ring->next) {
+        int unused = 0;
+        if (__atomic_compare_exchange_n(&ring->inUse, &unused, 1, false,
+                __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            myRing = ring;
+        }
+    }
+    if (myRing == NULL) {
+        LogRing* ring = calloc(1, sizeof(LogRing));
+        if (ring == NULL) {
+            return NULL;
+        }
+        ring->inUse = 1;
+        ring->id = __atomic_fetch_add(&numRings, 1, __ATOMIC_RELAXED);
+        ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&rings, &ring->next, ring, true,
+                __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+        myRing = ring;
+    }
+    pthread_setspecific(ringKey, myRing);
+    return myRing;
+}
+
+/* release_ring()
+ * --------------
+ * Gives an exiting thread's ring back for another thread to take. Any records
+ * still in it are written as normal.
+ *
+ * arg: The ring
+ *
+ * Returns: void
+ */
+void release_ring(void* arg) {
+    LogRing* ring = arg;
+    __atomic_store_n(&ring->inUse, 0, __ATOMIC_RELEASE);
+}
+
+/* log_event()
+ * -----------
+ * Logs a record, if its level is being logged. This never blocks: if the
+ * calling thread's ring is full the record is dropped.
+ *
+ * level: How severe the record is
+ *
+ * requestId: The request the record is about, or 0 if none
+ *
+ * durationUs: How long what is being logged took, or -1 if not timed
+ *
+ * format: The printf() format of the message, which is cut short at
+ *      LOG_MESSAGE_LEN - 1 characters
+ *
+ * Returns: void
+ */
+void log_event(LogLevel level, uint64_t requestId, long long durationUs,
+        const char* format, ...) {
+    if (!log_enabled(level)) {
+        return;
+    }
+    LogRing* ring = thread_ring();
+    if (ring == NULL) {
+        __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    unsigned long tail = ring->tail;
+    if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) >=
+            LOG_RING_SIZE) {
+        __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    LogRecord* record = &ring->records[tail % LOG_RING_SIZE];
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    record->timeNs = now.tv_sec * NS_PER_SEC + now.tv_nsec;
+    record->level = level;
+    record->threadId = ring->id;
+    record->requestId = requestId;
+    record->durationUs = durationUs;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(record->message, LOG_MESSAGE_LEN, format, args);
+    va_end(args);
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/* format_record()
+ * ---------------
+ * Formats one record as a line of the form
+ *      2024-05-01 12:00:00.000000 info t3 req 42 120us: message
+ * where the request and duration are left out if the record has none. The
+ * date and time are only worked out again when the second changes.
+ *
+ * record: The record to format
+ *
+ * line: Where to store the line, LOG_LINE_LEN bytes
+ *
+ * Returns: The length of the line
+ */
+int format_record(const LogRecord* record, char* line) {
+    static time_t lastSeconds = -1;
+    static char timestamp[TIMESTAMP_LEN];
+    time_t seconds = record->timeNs / NS_PER_SEC;
+    if (seconds != lastSeconds) {
+        struct tm local;
+        localtime_r(&seconds, &local);
+        strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &local);
+        lastSeconds = seconds;
+    }
+    int length = snprintf(line, LOG_LINE_LEN, "%s.%06ld %s t%d", timestamp,
+            (long)(record->timeNs % NS_PER_SEC / NS_PER_US),
+            levelNames[record->level], record->threadId);
+    if (record->requestId != 0) {
+        length += snprintf(line + length, LOG_LINE_LEN - length, " req %llu",
+                (unsigned long long)record->requestId);
+    }
+    if (record->durationUs >= 0) {
+        length += snprintf(line + length, LOG_LINE_LEN - length, " %lldus",
+                record->durationUs);
+    }
+    length += snprintf(line + length, LOG_LINE_LEN - length, ": %s\n",
+            record->message);
+    return length;
+}
+
+/* drain_rings()
+ * -------------
+ * Writes out every record waiting in every ring, then notes how many records
+ * have been dropped since it last did so. Lines are gathered into batches of
+ * up to LOG_BATCH_SIZE bytes so that an unbuffered stream such as stderr is
+ * written once per batch rather than once per record.
+ *
+ * Returns: void
+ */
+void drain_rings(void) {
+    static unsigned long reportedDropped = 0;
+    static char batch[LOG_BATCH_SIZE];
+    size_t used = 0;
+    for (LogRing* ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+            ring != NULL; ring = ring->next) {
+        unsigned long head = ring->head;
+        unsigned long tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            if (LOG_BATCH_SIZE - used < LOG_LINE_LEN) {
+                fwrite(batch, 1, used, logStream);
+                used = 0;
+            }
+            used += format_record(&ring->records[head % LOG_RING_SIZE],
+                    batch + used);
+        }
+        __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+    }
+    unsigned long nowDropped = __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+    if (nowDropped != reportedDropped) {
+        used += snprintf(batch + used, LOG_BATCH_SIZE - used,
+                "log: %lu records dropped\n", nowDropped - reportedDropped);
+        reportedDropped = nowDropped;
+    }
+    fwrite(batch, 1, used, logStream);
+    fflush(logStream);
+}
+
+/* writer_thread()
+ * ---------------
+ * Drains the rings every LOG_FLUSH_MS until logging is stopped.
+ *
+ * arg: Unused
+ *
+ * Returns: NULL
+ */
+void* writer_thread(void* arg) {
+    (void)arg;
+    struct timespec interval = {.tv_sec = 0,
+            .tv_nsec = LOG_FLUSH_MS * (NS_PER_SEC / 1000)};
+    while (!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE)) {
+        nanosleep(&interval, NULL);
+        drain_rings();
+    }
+    drain_rings();
+    return NULL;
+}
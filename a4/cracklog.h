@@ -0,0 +1,70 @@
+/*
+ * cracklog.h
+ *      CSSE2310 - Assignment Four
+ *
+ *      Written by Alex Viller, a.viller@uqconnect.edu.au
+ *
+ * Asynchronous logging for crackserver. Each thread formats its records into
+ * its own single producer, single consumer ring, which a background thread
+ * drains to the log stream every LOG_FLUSH_MS, so logging threads never wait
+ * on each other or on stdio. Records which do not fit because a ring is full
+ * are dropped and counted rather than waited for.
+ *
+ * A ring is kept for reuse by a later thread once its thread exits, so there
+ * are only ever as many rings as there have been threads logging at once.
+ *
+ */
+#ifndef CRACKLOG_H
+#define CRACKLOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// The number of records each thread's ring can hold
+#define LOG_RING_SIZE 1024
+// The longest message a record can hold, including its terminator
+#define LOG_MESSAGE_LEN 96
+// How often, in milliseconds, the rings are drained
+#define LOG_FLUSH_MS 10
+
+// enum containing the levels of log record, most severe first. Records less
+// severe than the level logging was started at are skipped.
+typedef enum {
+    LOG_OFF = 0,
+    LOG_ERROR = 1,
+    LOG_WARN = 2,
+    LOG_INFO = 3,
+    LOG_DEBUG = 4
+} LogLevel;
+
+// struct for containing one log record
+typedef struct {
+    long long timeNs;
+    LogLevel level;
+    int threadId;
+    uint64_t requestId;
+    long long durationUs;
+    char message[LOG_MESSAGE_LEN];
+} LogRecord;
+
+// struct for containing one thread's ring of records. Only the owning thread
+// moves tail and only the writer moves head.
+typedef struct LogRing {
+    LogRecord records[LOG_RING_SIZE];
+    unsigned long head;
+    unsigned long tail;
+    int id;
+    int inUse;
+    struct LogRing* next;
+} LogRing;
+
+/* Function Prototypes */
+bool log_parse_level(const char* name, LogLevel* level);
+void log_start(LogLevel level, FILE* stream);
+void log_stop(void);
+bool log_enabled(LogLevel level);
+void log_event(LogLevel level, uint64_t requestId, long long durationUs,
+        const char* format, ...) __attribute__((format(printf, 4, 5)));
+
+#endif
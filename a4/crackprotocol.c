@@ -0,0 +1,94 @@
+/*
+ * crackprotocol.c
+ *      CSSE2310 - Assignment Four
+ *
+ *      Written by Alex Viller, a.viller@uqconnect.edu.au
+ *
+ * Packing and unpacking of binary protocol frame headers and request
+ * payloads, see crackprotocol.h
+ *
+ */
+#include <string.h>
+#include <arpa/inet.h>
+#include "crackprotocol.h"
+
+/* pack_header()
+ * -------------
+ * Writes a frame header into a buffer in its wire format.
+ *
+ * buffer: Where to write the header, at least FRAME_HEADER_LEN bytes
+ *
+ * header: The header to be packed
+ *
+ * Returns: void
+ */
+void pack_header(unsigned char* buffer, const FrameHeader* header) {
+    uint16_t length = htons(header->length);
+    uint32_t requestId = htonl(header->requestId);
+    buffer[0] = header->opcode;
+    buffer[1] = header->flags;
+    memcpy(buffer + 2, &length, sizeof(length));
+    memcpy(buffer + 4, &requestId, sizeof(requestId));
+}
+
+/* unpack_header()
+ * ---------------
+ * Reads a frame header from a buffer in its wire format. The buffer does not
+ * need to be aligned.
+ *
+ * buffer: Where to read the header from, at least FRAME_HEADER_LEN bytes
+ *
+ * header: The header to be filled in
+ *
+ * Returns: void
+ */
+void unpack_header(const unsigned char* buffer, FrameHeader* header) {
+    uint16_t length;
+    uint32_t requestId;
+    memcpy(&length, buffer + 2, sizeof(length));
+    memcpy(&requestId, buffer + 4, sizeof(requestId));
+    header->opcode = buffer[0];
+    header->flags = buffer[1];
+    header->length = ntohs(length);
+    header->requestId = ntohl(requestId);
+}
+
+/* unpack_request()
+ * ----------------
+ * Finds the fields of an OP_CRACK or OP_CRYPT request payload, with or
+ * without SETTING_FLAG, checking that they fit in the payload. The default
+ * hash and salt lengths are those of DES.
+ *
+ * header: The request frame's header
+ *
+ * payload: The request frame's payload
+ *
+ * fields: The fields to be filled in, pointing into the payload
+ *
+ * Returns: false if the frame is not a well formed crack or crypt request
+ */
+bool unpack_request(const FrameHeader* header, const unsigned char* payload,
+        RequestFields* fields) {
+    if (header->opcode != OP_CRACK && header->opcode != OP_CRYPT) {
+        return false;
+    }
+    // a crack's thread count comes first
+    int offset = header->opcode == OP_CRACK ? 1 : 0;
+    if (header->flags & SETTING_FLAG) {
+        if (offset >= header->length) {
+            return false;
+        }
+        fields->settingLength = payload[offset++];
+    } else {
+        fields->settingLength = header->opcode == OP_CRACK ?
+                FRAME_HASH_LEN : FRAME_SALT_LEN;
+    }
+    if (offset + fields->settingLength > header->length) {
+        return false;
+    }
+    fields->setting = payload + offset;
+    fields->rest = fields->setting + fields->settingLength;
+    fields->restLength = header->length - offset - fields->settingLength;
+    return header->opcode == OP_CRYPT || fields->restLength == 0 ||
+            fields->restLength == CRACK_OPTIONS_LEN;
+}
@@ -0,0 +1,143 @@
+/*
+ * crackprotocol.h
+ *      CSSE2310 - Assignment Four
+ *
+ *      Written by Alex Viller, a.viller@uqconnect.edu.au
+ *
+ * Definitions for the optional binary protocol shared by crackclient and
+ * crackserver. A client switches a connection to the binary protocol by
+ * sending BINARY_MAGIC as its very first byte (text commands always start
+ * with a letter), which the server acknowledges by sending the same byte
+ * back. After that every request and response is a frame: a fixed size
+ * header followed by length bytes of payload.
+ *
+ * Request payloads:
+ *  OP_CRACK    1 byte thread count, followed by the raw 13 byte hash,
+ *              optionally followed by a 4 byte timeout and a 4 byte progress
+ *              interval (both milliseconds, 0 for none). Setting
+ *              PROFILE_FLAG in the header's flags asks for an OP_PROFILE.
+ *  OP_CRYPT    2 byte salt, followed by the plain text
+ *  OP_NONE     anything, always answered with OP_INVALID
+ *
+ * Setting SETTING_FLAG in the header's flags puts a 1 byte length in front
+ * of the hash (OP_CRACK) or salt (OP_CRYPT), which may then be up to 255
+ * bytes long, such as a modular crypt hash or setting ("$6$salt"). Clients
+ * only set it for those, so DES requests still reach servers which predate
+ * it.
+ * unpack_request() finds the fields of either layout.
+ *
+ * Response payloads:
+ *  OP_RESULT   the plain text (crack) or hash (crypt), no terminator
+ *  OP_FAILED   empty
+ *  OP_INVALID  empty
+ *  OP_TIMEOUT  empty
+ *  OP_PROGRESS 4 byte count of words tested, 4 byte count of words in total.
+ *              Sent any number of times before the final response to a crack
+ *              which asked for progress, with the same request ID.
+ *  OP_PROFILE  the crack's profile as text, no terminator, in the same form
+ *              as the text protocol's ":profile" line. Sent just before the
+ *              final response to a crack which asked for it, with the same
+ *              request ID.
+ *
+ * All multi-byte numbers are in network byte order.
+ *
+ * Clients connected over the server's Unix domain socket may instead move
+ * their requests into shared memory. The client creates a ShmRing with
+ * shm_open(), named SHM_NAME_PREFIX followed by anything, and sends the text
+ * command "shm <name>". The server answers SHM_RESPONSE once it has mapped
+ * the ring, after which the socket is only used to notice either side going
+ * away. Request n (counting from 0) goes in slot n % SHM_RING_SLOTS, the
+ * client posts requests, the server answers in the same slot and posts
+ * responses. The client never has more than SHM_RING_SLOTS requests
+ * outstanding.
+ *
+ */
+#ifndef CRACKPROTOCOL_H
+#define CRACKPROTOCOL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <semaphore.h>
+
+// The first byte sent on a connection by a client wanting the binary protocol
+#define BINARY_MAGIC 0xB1
+// The number of bytes in a packed frame header
+#define FRAME_HEADER_LEN 8
+// The largest payload either side will accept in a single frame
+#define MAX_FRAME_PAYLOAD 4096
+// The length of the hash and salt of a request without SETTING_FLAG
+#define FRAME_HASH_LEN 13
+#define FRAME_SALT_LEN 2
+// The length of the options at the end of an OP_CRACK payload
+#define CRACK_OPTIONS_LEN 8
+// The OP_CRACK header flag asking for the crack to be profiled
+#define PROFILE_FLAG 0x01
+// The OP_CRACK and OP_CRYPT header flag for a length prefixed hash or salt
+#define SETTING_FLAG 0x02
+
+// enum containing the frame opcodes. Responses have the top bit set.
+typedef enum {
+    OP_NONE = 0x00,
+    OP_CRACK = 0x01,
+    OP_CRYPT = 0x02,
+    OP_RESULT = 0x81,
+    OP_FAILED = 0x82,
+    OP_INVALID = 0x83,
+    OP_TIMEOUT = 0x84,
+    OP_PROGRESS = 0x85,
+    OP_PROFILE = 0x86
+} Opcode;
+
+// struct for containing an unpacked frame header. On the wire the fields are
+// packed in this order.
+typedef struct {
+    uint8_t opcode;
+    uint8_t flags;
+    uint16_t length;
+    uint32_t requestId;
+} FrameHeader;
+
+// struct for containing where the fields of an OP_CRACK or OP_CRYPT payload
+// are. The setting is the hash (OP_CRACK) or salt (OP_CRYPT), and the rest is
+// the options (OP_CRACK, if any) or plain text (OP_CRYPT). None of them are
+// null terminated.
+typedef struct {
+    const unsigned char* setting;
+    int settingLength;
+    const unsigned char* rest;
+    int restLength;
+} RequestFields;
+
+// The number of requests a shared memory ring can hold at once
+#define SHM_RING_SLOTS 64
+// The size of each request and response in a shared memory ring, including
+//      the null terminator
+#define SHM_SLOT_SIZE 128
+// The prefix every shared memory ring name must start with
+#define SHM_NAME_PREFIX "/crackclient."
+// The command which moves a connection to a shared memory ring
+#define SHM_COMMAND "shm "
+// The server's answer once it has moved a connection to a shared memory ring
+#define SHM_RESPONSE ":shm"
+
+// struct for containing one request and its response in a shared memory ring
+typedef struct {
+    char request[SHM_SLOT_SIZE];
+    char response[SHM_SLOT_SIZE];
+} ShmSlot;
+
+// struct for containing a shared memory ring, see the top of this file. Both
+// semaphores are process shared.
+typedef struct {
+    sem_t requests;
+    sem_t responses;
+    ShmSlot slots[SHM_RING_SLOTS];
+} ShmRing;
+
+/* Function Prototypes */
+void pack_header(unsigned char* buffer, const FrameHeader* header);
+void unpack_header(const unsigned char* buffer, FrameHeader* header);
+bool unpack_request(const FrameHeader* header, const unsigned char* payload,
+        RequestFields* fields);
+
+#endif
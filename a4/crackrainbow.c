@@ -0,0 +1,387 @@
+/*
+ * crackrainbow.c
+ *      CSSE2310 - Assignment Four
+ *
+ *      Written by Alex Viller, a.viller@uqconnect.edu.au
+ *
+ * Usage:
+ *  crackrainbow [--charset chars] [--maxlen length] [--chainlen steps]
+ *          [--chains count] [--threads num] [--bench lookups] salts tablefile
+ *
+ *  Makes a rainbow table (see rainbow.h) for each of the comma separated
+ *  salts and writes them to tablefile, for crackserver --rainbow. The table
+ *  size against success rate trade-off is set by --chains and --chainlen;
+ *  the expected success rate of each table is printed once it is made.
+ *
+ *  --bench then cracks that many random plain texts from the keyspace using
+ *  the tables, and compares the time taken with that of a brute force sweep
+ *  of the keyspace.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <math.h>
+#include <time.h>
+#include "rainbow.h"
+
+/* Global Definitions */
+// The defaults for each of the table options
+#define DEFAULT_CHARSET "abcdefghijklmnopqrstuvwxyz"
+#define DEFAULT_MAX_LEN 4
+#define DEFAULT_CHAIN_LEN 200
+#define DEFAULT_CHAINS 5000
+#define DEFAULT_THREADS 1
+// The most threads that may make a table
+#define MAX_THREADS 64
+// The most digits accepted in a numeric option
+#define MAX_OPTION_DIGITS 9
+// Characters a salt may be made of
+#define SALT_CHARS "abcdefghijklmnopqrstuvwxyz"\
+                   "ABCDEFGHIJKLMNOPQRSTUVWXYZ"\
+                   "0123456789./"
+// The number of encryptions timed to estimate the brute force rate
+#define BENCH_SAMPLE 20000
+// The number of nanoseconds in a second and in a millisecond
+#define NS_PER_SEC 1000000000.0
+#define NS_PER_MS 1000000.0
+
+/* New Type Creations */
+// enum containing all the error codes
+typedef enum {
+    OK = 0,
+    USAGE_ERR = 1,
+    TABLE_ERR = 2
+} ErrorCodes;
+
+// enum containing the values to be used for getopt_long
+typedef enum {
+    CHARSET_ARG = 1,
+    MAX_LEN_ARG = 2,
+    CHAIN_LEN_ARG = 3,
+    CHAINS_ARG = 4,
+    THREADS_ARG = 5,
+    BENCH_ARG = 6
+} ArgType;
+
+// struct for containing everything given on the command line
+typedef struct {
+    const char* charset;
+    int maxLen;
+    int chainLen;
+    int numChains;
+    int numThreads;
+    int benchLookups;
+    char* salts;
+    const char* tablePath;
+} Options;
+
+// struct for containing the part of a table one generating thread makes
+typedef struct {
+    const RainbowSet* set;
+    RainbowTable* table;
+    uint64_t first;
+    uint64_t last;
+} ChainsParams;
+
+/* Function Prototypes */
+int main(int argc, char* argv[]);
+Options get_args(int argc, char* argv[]);
+int parse_count(const char* value);
+void print_usage(void);
+void make_table(RainbowSet* set, const char* salt, const Options* options);
+void* chains_thread(void* arg);
+double expected_success(const RainbowSet* set, uint64_t numChains);
+void bench(const RainbowSet* set, int lookups);
+double now_seconds(void);
+
+/* main()
+ * ------
+ * Makes a table for each salt, writes them out and optionally benchmarks
+ * them.
+ *
+ * Returns: OK -> 0
+ * Errors: For invalid arguments -> USAGE_ERR
+ *         If the table file cannot be written -> TABLE_ERR
+ */
+int main(int argc, char* argv[]) {
+    Options options = get_args(argc, argv);
+    RainbowSet set;
+    if (!rainbow_init(&set, options.charset, options.maxLen,
+            options.chainLen)) {
+        print_usage();
+    }
+    int numSalts = (strlen(options.salts) + 1) / (RAINBOW_SALT_LEN + 1);
+    set.tables = malloc(sizeof(RainbowTable) * numSalts);
+    char* savePtr;
+    for (char* salt = strtok_r(options.salts, ",", &savePtr); salt != NULL;
+            salt = strtok_r(NULL, ",", &savePtr)) {
+        make_table(&set, salt, &options);
+    }
+    if (!rainbow_save(&set, options.tablePath)) {
+        fprintf(stderr, "crackrainbow: unable to write table file \"%s\"\n",
+                options.tablePath);
+        exit(TABLE_ERR);
+    }
+    if (options.benchLookups > 0) {
+        bench(&set, options.benchLookups);
+    }
+    rainbow_free(&set);
+    return OK;
+}
+
+/* get_args()
+ * ----------
+ * Processes the command line arguments, checking their validity.
+ *
+ * argc: the number of arguments (including the program itself)
+ *
+ * argv: the arguments themselves
+ *
+ * Returns: The options given, with defaults for any not given
+ * Errors: For any invalid argument, calls print_usage() which will error
+ */
+Options get_args(int argc, char* argv[]) {
+    Options options = {.charset = DEFAULT_CHARSET, .maxLen = DEFAULT_MAX_LEN,
+            .chainLen = DEFAULT_CHAIN_LEN, .numChains = DEFAULT_CHAINS,
+            .numThreads = DEFAULT_THREADS, .benchLookups = 0};
+    static struct option longOpts[] = {
+        {"charset", required_argument, NULL, CHARSET_ARG},
+        {"maxlen", required_argument, NULL, MAX_LEN_ARG},
+        {"chainlen", required_argument, NULL, CHAIN_LEN_ARG},
+        {"chains", required_argument, NULL, CHAINS_ARG},
+        {"threads", required_argument, NULL, THREADS_ARG},
+        {"bench", required_argument, NULL, BENCH_ARG},
+        {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, ":", longOpts, NULL)) != -1) {
+        if (opt == CHARSET_ARG) {
+            options.charset = optarg;
+        } else if (opt == MAX_LEN_ARG) {
+            options.maxLen = parse_count(optarg);
+        } else if (opt == CHAIN_LEN_ARG) {
+            options.chainLen = parse_count(optarg);
+        } else if (opt == CHAINS_ARG) {
+            options.numChains = parse_count(optarg);
+        } else if (opt == THREADS_ARG) {
+            options.numThreads = parse_count(optarg);
+            if (options.numThreads > MAX_THREADS) {
+                print_usage();
+            }
+        } else if (opt == BENCH_ARG) {
+            options.benchLookups = parse_count(optarg);
+        } else {
+            print_usage();
+        }
+    }
+    if (argc - optind != 2) {
+        print_usage();
+    }
+    options.salts = argv[optind];
+    options.tablePath = argv[optind + 1];
+    // every salt must be exactly two salt characters
+    for (char* salt = options.salts; ; salt += RAINBOW_SALT_LEN + 1) {
+        if (strspn(salt, SALT_CHARS) != RAINBOW_SALT_LEN) {
+            print_usage();
+        } else if (salt[RAINBOW_SALT_LEN] == '\0') {
+            break;
+        } else if (salt[RAINBOW_SALT_LEN] != ',') {
+            print_usage();
+        }
+    }
+    return options;
+}
+
+/* parse_count()
+ * -------------
+ * Parses a numeric option, which must be a positive number.
+ *
+ * value: The option's argument
+ *
+ * Returns: The number
+ * Errors: If it is not a positive number, calls print_usage() which will
+ *      error
+ */
+int parse_count(const char* value) {
+    size_t length = strlen(value);
+    if (length == 0 || length > MAX_OPTION_DIGITS ||
+            strspn(value, "0123456789") != length || atoi(value) < 1) {
+        print_usage();
+    }
+    return atoi(value);
+}
+
+/* print_usage()
+ * -------------
+ * Prints the usage message to standard error and exits.
+ *
+ * Returns: void
+ * Errors: Always exits with USAGE_ERR
+ */
+void print_usage(void) {
+    fprintf(stderr, "Usage: crackrainbow [--charset chars] [--maxlen length] "
+            "[--chainlen steps] [--chains count] [--threads num] "
+            "[--bench lookups] salts tablefile\n");
+    exit(USAGE_ERR);
+}
+
+/* make_table()
+ * ------------
+ * Makes the table for one salt, sharing its chains between the threads.
+ * Chains are started at evenly spaced numbers, and once sorted by end any
+ * chains which have merged into the same end are dropped, since only one of
+ * them can ever be walked.
+ *
+ * set: The set to add the table to
+ *
+ * salt: The salt to make the table for
+ *
+ * options: The options given on the command line
+ *
+ * Returns: void
+ */
+void make_table(RainbowSet* set, const char* salt, const Options* options) {
+    RainbowTable* table = &set->tables[set->numTables++];
+    strcpy(table->salt, salt);
+    uint64_t numChains = (uint64_t)options->numChains < set->keyspace ?
+            (uint64_t)options->numChains : set->keyspace;
+    table->numChains = numChains;
+    table->chains = malloc(sizeof(RainbowChain) * numChains);
+    double start = now_seconds();
+
+    pthread_t threads[MAX_THREADS];
+    ChainsParams params[MAX_THREADS];
+    for (int i = 0; i < options->numThreads; i++) {
+        params[i].set = set;
+        params[i].table = table;
+        params[i].first = numChains * i / options->numThreads;
+        params[i].last = numChains * (i + 1) / options->numThreads;
+        pthread_create(&threads[i], NULL, chains_thread, &params[i]);
+    }
+    for (int i = 0; i < options->numThreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    qsort(table->chains, numChains, sizeof(RainbowChain), compare_chains);
+    uint64_t unique = 0;
+    for (uint64_t i = 0; i < numChains; i++) {
+        if (unique == 0 || table->chains[unique - 1].end !=
+                table->chains[i].end) {
+            table->chains[unique++] = table->chains[i];
+        }
+    }
+    table->numChains = unique;
+    printf("Salt %s: %lu chains of %d (%lu merged), %lu bytes, "
+            "expected success %.1f%%, made in %.1f s\n", salt,
+            (unsigned long)unique, options->chainLen,
+            (unsigned long)(numChains - unique),
+            (unsigned long)(sizeof(RainbowChain) * unique),
+            100 * expected_success(set, unique), now_seconds() - start);
+    fflush(stdout);
+}
+
+/* chains_thread()
+ * ---------------
+ * The thread which walks one part of a table's chains from start to end.
+ *
+ * arg: The ChainsParams saying which chains to walk
+ *
+ * Returns: void*
+ */
+void* chains_thread(void* arg) {
+    ChainsParams* params = (ChainsParams*)arg;
+    const RainbowSet* set = params->set;
+    RainbowTable* table = params->table;
+    struct crypt_data data;
+    data.initialized = 0;
+    for (uint64_t i = params->first; i < params->last; i++) {
+        // spread the starts evenly over the keyspace
+        uint64_t start = (uint64_t)((double)set->keyspace * i /
+                table->numChains);
+        table->chains[i].start = start;
+        table->chains[i].end = rainbow_walk(set, table->salt, start, 0,
+                set->header.chainLen, &data);
+    }
+    return NULL;
+}
+
+/* expected_success()
+ * ------------------
+ * Estimates the chance that a table finds a plain text chosen at random from
+ * the keyspace. Once merged chains are dropped no two of the chains left
+ * share a string at the same step, so every step covers numChains distinct
+ * strings; those of different steps are taken to be independent. The strings
+ * only the dropped chains reached are not counted, as no lookup can find
+ * them.
+ *
+ * set: The set whose keyspace and chain length to use
+ *
+ * numChains: The number of chains the table kept after dropping merged ones
+ *
+ * Returns: The chance, from 0 to 1
+ */
+double expected_success(const RainbowSet* set, uint64_t numChains) {
+    double missedPerStep = 1 - (double)numChains / set->keyspace;
+    return 1 - pow(missedPerStep, set->header.chainLen);
+}
+
+/* bench()
+ * -------
+ * Cracks random plain texts from the keyspace with the tables, and compares
+ * the mean time with that expected of a brute force sweep, which on average
+ * searches half the keyspace. The sweep's rate is measured by timing
+ * BENCH_SAMPLE encryptions.
+ *
+ * set: The tables to benchmark
+ *
+ * lookups: The number of plain texts to crack
+ *
+ * Returns: void
+ */
+void bench(const RainbowSet* set, int lookups) {
+    struct crypt_data data;
+    data.initialized = 0;
+    char plaintext[RAINBOW_MAX_LEN + 1];
+    char found[RAINBOW_MAX_LEN + 1];
+    char hash[RAINBOW_HASH_LEN + 1];
+    srand(time(NULL));
+    int hits = 0;
+    double start = now_seconds();
+    for (int i = 0; i < lookups; i++) {
+        const RainbowTable* table = &set->tables[i % set->numTables];
+        uint64_t index = (((uint64_t)rand() << 31) ^ rand()) % set->keyspace;
+        rainbow_plaintext(set, index, plaintext);
+        strcpy(hash, crypt_r(plaintext, table->salt, &data));
+        hits += rainbow_lookup(set, hash, found, &data) &&
+                strcmp(crypt_r(found, table->salt, &data), hash) == 0;
+    }
+    double lookupSecs = (now_seconds() - start) / lookups;
+
+    start = now_seconds();
+    for (int i = 0; i < BENCH_SAMPLE; i++) {
+        rainbow_plaintext(set, i % set->keyspace, plaintext);
+        crypt_r(plaintext, set->tables[0].salt, &data);
+    }
+    double rate = BENCH_SAMPLE / (now_seconds() - start);
+    printf("Rainbow: %d/%d found, mean %.1f ms per lookup\n", hits, lookups,
+            lookupSecs * NS_PER_SEC / NS_PER_MS);
+    printf("Brute force: %.0f hashes/sec, mean %.1f ms per sweep of half "
+            "the %lu strings\n", rate, set->keyspace / 2.0 / rate *
+            NS_PER_SEC / NS_PER_MS, (unsigned long)set->keyspace);
+}
+
+/* now_seconds()
+ * -------------
+ * Reads the monotonic clock.
+ *
+ * Returns: The time in seconds
+ */
+double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / NS_PER_SEC;
+}
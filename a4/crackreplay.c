@@ -0,0 +1,592 @@
+/*
+ * crackreplay.c
+ *      CSSE2310 - Assignment Four
+ *
+ *      Written by Alex Viller, a.viller@uqconnect.edu.au
+ *
+ * Usage:
+ *  crackreplay [--speed factor] portnum recording
+ *  crackreplay --compare recording recording
+ *
+ *  Plays a recording made by crackserver --record (see traffic.h) back
+ *  against the server listening on portnum, which may be the path of a Unix
+ *  domain socket. Each recorded connection gets a connection of its own, and
+ *  each request is sent when it arrived in the recording, with the gaps
+ *  between requests divided by --speed (default 1, so 2 replays twice as
+ *  fast), whether or not the responses to earlier requests have arrived.
+ *  The latency distribution of each lane is then printed for both the
+ *  recording and the replay.
+ *
+ *  Replayed latencies are measured by the client, from when each request
+ *  was due to be sent until its response arrived, so a slow response also
+ *  counts against the requests held up behind it. Recorded latencies were
+ *  measured by the server, so for a like for like comparison record the
+ *  replay too (crackserver --record) and use --compare, which prints the
+ *  distributions of two recordings side by side.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "traffic.h"
+
+/* Global Definitions */
+// The host the server is on
+#define HOST "localhost"
+// The default replay speed
+#define DEFAULT_SPEED 1.0
+// The number of lanes a request can be recorded in, and their names
+#define NUM_LANES 2
+#define LANE_NAMES {"latency", "throughput"}
+// The longest response line that is expected
+#define MAX_RESPONSE_LEN 4096
+// The prefixes of the lines a server sends before a crack's final response
+#define PROGRESS_RESPONSE ":progress"
+#define PROFILE_RESPONSE ":profile"
+// The number of microseconds in a second and nanoseconds in a microsecond
+#define US_PER_SEC 1000000LL
+#define NS_PER_US 1000LL
+
+/* New Type Creations */
+// enum containing all the error codes
+typedef enum {
+    OK = 0,
+    USAGE_ERR = 1,
+    RECORDING_ERR = 2,
+    CONNECTION_ERR = 3
+} ErrorCodes;
+
+// enum containing the values to be used for getopt_long
+typedef enum {
+    SPEED_ARG = 1,
+    COMPARE_ARG = 2
+} ArgType;
+
+// struct for containing everything given on the command line
+typedef struct {
+    double speed;
+    bool compare;
+    const char* first;
+    const char* second;
+} Options;
+
+// struct for containing one recorded request, when it was due to be sent in
+// the replay and how long it took to answer (-1 if it was not answered)
+typedef struct {
+    TrafficEntry entry;
+    char* request;
+    long long dueUs;
+    long long replayUs;
+} Request;
+
+// struct for containing every request of a recording
+typedef struct {
+    Request* requests;
+    int numRequests;
+    long long durationUs;
+} Recording;
+
+// struct for containing the requests of one connection, in arrival order,
+// and where to replay them. The responses are read from from by a thread of
+// their own.
+typedef struct {
+    const char* port;
+    double speed;
+    long long startUs;
+    Request** requests;
+    int numRequests;
+    FILE* from;
+    bool failed;
+} ConnectionParams;
+
+// struct for containing a summary of a set of latencies, in microseconds
+typedef struct {
+    int count;
+    long long mean;
+    long long p50;
+    long long p90;
+    long long p99;
+    long long max;
+} Summary;
+
+/* Function Prototypes */
+int main(int argc, char* argv[]);
+Options get_args(int argc, char* argv[]);
+void print_usage(void);
+Recording load_recording(const char* path);
+int compare_requests(const void* a, const void* b);
+int compare_latencies(const void* a, const void* b);
+bool replay(Recording* recording, const char* port, double speed);
+void* connection_thread(void* arg);
+void* response_thread(void* arg);
+FILE* open_connection(const char* port, FILE** from);
+bool read_final_response(FILE* from);
+Summary summarise(const Recording* recording, int lane, bool replayed);
+void print_header(void);
+void print_summary(const char* label, const char* lane, Summary summary);
+long long now_us(void);
+
+/* main()
+ * ------
+ * Replays a recording and compares its latencies, or compares two
+ * recordings.
+ *
+ * Returns: OK -> 0
+ * Errors: For invalid arguments -> USAGE_ERR
+ *         If a recording cannot be read -> RECORDING_ERR
+ *         If a connection to the server fails -> CONNECTION_ERR
+ */
+int main(int argc, char* argv[]) {
+    static const char* const laneNames[NUM_LANES] = LANE_NAMES;
+    Options options = get_args(argc, argv);
+    Recording first = load_recording(options.compare ? options.first :
+            options.second);
+    if (options.compare) {
+        Recording second = load_recording(options.second);
+        printf("%s: %d requests over %.3fs\n", options.first,
+                first.numRequests, (double)first.durationUs / US_PER_SEC);
+        printf("%s: %d requests over %.3fs\n", options.second,
+                second.numRequests, (double)second.durationUs / US_PER_SEC);
+        print_header();
+        for (int lane = 0; lane < NUM_LANES; lane++) {
+            print_summary("first", laneNames[lane],
+                    summarise(&first, lane, false));
+            print_summary("second", laneNames[lane],
+                    summarise(&second, lane, false));
+        }
+        return OK;
+    }
+
+    long long startUs = now_us();
+    bool success = replay(&first, options.first, options.speed);
+    printf("Replayed %d requests at %gx in %.3fs (recorded over %.3fs)\n",
+            first.numRequests, options.speed,
+            (double)(now_us() - startUs) / US_PER_SEC,
+            (double)first.durationUs / US_PER_SEC);
+    print_header();
+    for (int lane = 0; lane < NUM_LANES; lane++) {
+        print_summary("recorded", laneNames[lane],
+                summarise(&first, lane, false));
+        print_summary("replayed", laneNames[lane],
+                summarise(&first, lane, true));
+    }
+    if (!success) {
+        fprintf(stderr, "crackreplay: server connection failed\n");
+        exit(CONNECTION_ERR);
+    }
+    return OK;
+}
+
+/* get_args()
+ * ----------
+ * Processes the command line arguments, checking their validity.
+ *
+ * argc: the number of arguments (including the program itself)
+ *
+ * argv: the arguments themselves
+ *
+ * Returns: The options given, with defaults for any not given
+ * Errors: For any invalid argument, calls print_usage() which will error
+ */
+Options get_args(int argc, char* argv[]) {
+    Options options = {.speed = DEFAULT_SPEED, .compare = false};
+    bool speedFlag = false;
+    static struct option longOpts[] = {
+        {"speed", required_argument, NULL, SPEED_ARG},
+        {"compare", no_argument, NULL, COMPARE_ARG},
+        {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, ":", longOpts, NULL)) != -1) {
+        if (opt == SPEED_ARG && !speedFlag) {
+            speedFlag = true;
+            char* end;
+            options.speed = strtod(optarg, &end);
+            if (*end != '\0' || end == optarg || !(options.speed > 0)) {
+                print_usage();
+            }
+        } else if (opt == COMPARE_ARG && !options.compare) {
+            options.compare = true;
+        } else {
+            print_usage();
+        }
+    }
+    if (argc - optind != 2 || (options.compare && speedFlag)) {
+        print_usage();
+    }
+    options.first = argv[optind];
+    options.second = argv[optind + 1];
+    return options;
+}
+
+/* print_usage()
+ * -------------
+ * Prints the usage message and exits.
+ *
+ * Returns: void
+ * Errors: with USAGE_ERR
+ */
+void print_usage(void) {
+    fprintf(stderr, "Usage: crackreplay [--speed factor] portnum recording\n"
+            "       crackreplay --compare recording recording\n");
+    exit(USAGE_ERR);
+}
+
+/* load_recording()
+ * ----------------
+ * Reads every request of a recording, sorted by connection and then by
+ * arrival.
+ *
+ * path: The recording file
+ *
+ * Returns: The requests
+ * Errors: If the file is not a recording -> RECORDING_ERR
+ */
+Recording load_recording(const char* path) {
+    FILE* file = fopen(path, "r");
+    TrafficHeader header;
+    if (file == NULL || !traffic_read_header(file, &header)) {
+        fprintf(stderr, "crackreplay: unable to read recording \"%s\"\n",
+                path);
+        exit(RECORDING_ERR);
+    }
+    Recording recording = {.requests = NULL, .numRequests = 0,
+            .durationUs = 0};
+    int capacity = 0;
+    char request[TRAFFIC_MAX_REQUEST + 1];
+    TrafficEntry entry;
+    while (traffic_read(file, &entry, request)) {
+        if (recording.numRequests == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            recording.requests = realloc(recording.requests,
+                    sizeof(Request) * capacity);
+        }
+        Request* next = &recording.requests[recording.numRequests++];
+        next->entry = entry;
+        next->request = strdup(request);
+        next->replayUs = -1;
+        if (entry.arrivalUs + entry.latencyUs > recording.durationUs) {
+            recording.durationUs = entry.arrivalUs + entry.latencyUs;
+        }
+    }
+    fclose(file);
+    qsort(recording.requests, recording.numRequests, sizeof(Request),
+            compare_requests);
+    return recording;
+}
+
+/* compare_requests()
+ * ------------------
+ * qsort() comparison of two requests by connection, then arrival.
+ *
+ * a: The first request
+ *
+ * b: The second request
+ *
+ * Returns: Less than, equal to or greater than 0 as a comes before, with or
+ *      after b
+ */
+int compare_requests(const void* a, const void* b) {
+    const TrafficEntry* entryA = &((const Request*)a)->entry;
+    const TrafficEntry* entryB = &((const Request*)b)->entry;
+    if (entryA->connection != entryB->connection) {
+        return entryA->connection < entryB->connection ? -1 : 1;
+    }
+    return entryA->arrivalUs < entryB->arrivalUs ? -1 :
+            entryA->arrivalUs > entryB->arrivalUs;
+}
+
+/* compare_latencies()
+ * -------------------
+ * qsort() comparison of two latencies.
+ *
+ * a: The first latency
+ *
+ * b: The second latency
+ *
+ * Returns: Less than, equal to or greater than 0 as a is less than, equal to
+ *      or greater than b
+ */
+int compare_latencies(const void* a, const void* b) {
+    long long latencyA = *(const long long*)a;
+    long long latencyB = *(const long long*)b;
+    return latencyA < latencyB ? -1 : latencyA > latencyB;
+}
+
+/* replay()
+ * --------
+ * Replays a recording, one thread per recorded connection, storing how long
+ * each request took.
+ *
+ * recording: The recording, sorted by connection
+ *
+ * port: The server's port or socket path
+ *
+ * speed: How many times faster than recorded to send the requests
+ *
+ * Returns: false if any connection failed
+ */
+bool replay(Recording* recording, const char* port, double speed) {
+    int numConnections = 0;
+    for (int i = 0; i < recording->numRequests; i++) {
+        if (i == 0 || recording->requests[i].entry.connection !=
+                recording->requests[i - 1].entry.connection) {
+            numConnections++;
+        }
+    }
+    ConnectionParams* params = calloc(numConnections,
+            sizeof(ConnectionParams));
+    pthread_t* threads = malloc(sizeof(pthread_t) * numConnections);
+    Request** requests = malloc(sizeof(Request*) * recording->numRequests);
+    long long startUs = now_us();
+    int connection = -1;
+    for (int i = 0; i < recording->numRequests; i++) {
+        requests[i] = &recording->requests[i];
+        if (i == 0 || requests[i]->entry.connection !=
+                requests[i - 1]->entry.connection) {
+            connection++;
+            params[connection] = (ConnectionParams){.port = port,
+                    .speed = speed, .startUs = startUs,
+                    .requests = &requests[i], .numRequests = 0};
+        }
+        params[connection].numRequests++;
+    }
+    for (int i = 0; i < numConnections; i++) {
+        pthread_create(&threads[i], NULL, connection_thread, &params[i]);
+    }
+    bool success = true;
+    for (int i = 0; i < numConnections; i++) {
+        pthread_join(threads[i], NULL);
+        success = success && !params[i].failed;
+    }
+    free(requests);
+    free(threads);
+    free(params);
+    return success;
+}
+
+/* connection_thread()
+ * -------------------
+ * Replays the requests of one recorded connection over a connection of its
+ * own, opened when its first request is due. Each request is sent when it is
+ * due, while response_thread() collects the responses.
+ *
+ * arg: The ConnectionParams of the connection
+ *
+ * Returns: NULL
+ */
+void* connection_thread(void* arg) {
+    ConnectionParams* params = (ConnectionParams*)arg;
+    FILE* to = NULL;
+    pthread_t reader;
+    for (int i = 0; i < params->numRequests; i++) {
+        Request* request = params->requests[i];
+        long long dueUs = params->startUs +
+                (long long)(request->entry.arrivalUs / params->speed);
+        long long waitUs = dueUs - now_us();
+        if (waitUs > 0) {
+            struct timespec wait = {.tv_sec = waitUs / US_PER_SEC,
+                    .tv_nsec = waitUs % US_PER_SEC * NS_PER_US};
+            nanosleep(&wait, NULL);
+        }
+        if (to == NULL) {
+            if ((to = open_connection(params->port, &params->from)) == NULL) {
+                params->failed = true;
+                return NULL;
+            }
+            pthread_create(&reader, NULL, response_thread, params);
+        }
+        __atomic_store_n(&request->dueUs, dueUs, __ATOMIC_RELEASE);
+        fprintf(to, "%s\n", request->request);
+        if (fflush(to) != 0) {
+            break; // the reader will notice the server has gone
+        }
+    }
+    if (to != NULL) {
+        pthread_join(reader, NULL);
+        fclose(to);
+        fclose(params->from);
+    }
+    return NULL;
+}
+
+/* response_thread()
+ * -----------------
+ * Reads the responses to a connection's requests, in order, timing each
+ * from when its request was due.
+ *
+ * arg: The ConnectionParams of the connection
+ *
+ * Returns: NULL
+ */
+void* response_thread(void* arg) {
+    ConnectionParams* params = (ConnectionParams*)arg;
+    for (int i = 0; i < params->numRequests; i++) {
+        if (!read_final_response(params->from)) {
+            params->failed = true;
+            break;
+        }
+        Request* request = params->requests[i];
+        request->replayUs = now_us() - __atomic_load_n(&request->dueUs,
+                __ATOMIC_ACQUIRE);
+    }
+    return NULL;
+}
+
+/* open_connection()
+ * -----------------
+ * Connects to the server.
+ *
+ * port: The server's port, or the path of its Unix domain socket if it
+ *      contains a '/'
+ *
+ * from: Where to store the stream to read responses from
+ *
+ * Returns: The stream to send requests to, or NULL if the server could not
+ *      be reached
+ */
+FILE* open_connection(const char* port, FILE** from) {
+    int fd = -1;
+    if (strchr(port, '/') != NULL) {
+        struct sockaddr_un local = {.sun_family = AF_UNIX};
+        strncpy(local.sun_path, port, sizeof(local.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (connect(fd, (struct sockaddr*)&local, sizeof(local)) == -1) {
+            close(fd);
+            return NULL;
+        }
+    } else {
+        struct addrinfo hints = {.ai_family = AF_INET,
+                .ai_socktype = SOCK_STREAM};
+        struct addrinfo* ai;
+        if (getaddrinfo(HOST, port, &hints, &ai) != 0) {
+            return NULL;
+        }
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        bool connected = connect(fd, ai->ai_addr, ai->ai_addrlen) == 0;
+        freeaddrinfo(ai);
+        if (!connected) {
+            close(fd);
+            return NULL;
+        }
+        // requests are sent ahead of their responses, so Nagle's algorithm
+        // would hold them back
+        int optVal = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &optVal, sizeof(optVal));
+    }
+    *from = fdopen(dup(fd), "r");
+    return fdopen(fd, "w");
+}
+
+/* read_final_response()
+ * ---------------------
+ * Reads the response to a request, skipping any progress reports and
+ * profile which come before it.
+ *
+ * from: The stream to read from
+ *
+ * Returns: false if the server closed the connection
+ */
+bool read_final_response(FILE* from) {
+    char line[MAX_RESPONSE_LEN];
+    while (fgets(line, sizeof(line), from) != NULL) {
+        if (strncmp(line, PROGRESS_RESPONSE, strlen(PROGRESS_RESPONSE)) != 0
+                && strncmp(line, PROFILE_RESPONSE,
+                strlen(PROFILE_RESPONSE)) != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* summarise()
+ * -----------
+ * Works out the distribution of the latencies of one lane's requests.
+ *
+ * recording: The recording
+ *
+ * lane: The lane whose requests to include
+ *
+ * replayed: Whether to use the replayed latencies rather than the recorded
+ *      ones. Requests which were not answered are left out.
+ *
+ * Returns: The summary
+ */
+Summary summarise(const Recording* recording, int lane, bool replayed) {
+    Summary summary = {0};
+    long long* latencies = malloc(sizeof(long long) *
+            (recording->numRequests + 1));
+    long long total = 0;
+    for (int i = 0; i < recording->numRequests; i++) {
+        const Request* request = &recording->requests[i];
+        long long latency = replayed ? request->replayUs :
+                request->entry.latencyUs;
+        if (request->entry.lane == lane && latency >= 0) {
+            latencies[summary.count++] = latency;
+            total += latency;
+        }
+    }
+    if (summary.count > 0) {
+        qsort(latencies, summary.count, sizeof(long long),
+                compare_latencies);
+        summary.mean = total / summary.count;
+        summary.p50 = latencies[(summary.count - 1) * 50 / 100];
+        summary.p90 = latencies[(summary.count - 1) * 90 / 100];
+        summary.p99 = latencies[(summary.count - 1) * 99 / 100];
+        summary.max = latencies[summary.count - 1];
+    }
+    free(latencies);
+    return summary;
+}
+
+/* print_header()
+ * --------------
+ * Prints the column headings of the latency table.
+ *
+ * Returns: void
+ */
+void print_header(void) {
+    printf("%-9s %-10s %8s %10s %10s %10s %10s %10s\n", "", "lane",
+            "requests", "mean(us)", "p50(us)", "p90(us)", "p99(us)",
+            "max(us)");
+}
+
+/* print_summary()
+ * ---------------
+ * Prints one row of the latency table.
+ *
+ * label: Which latencies these are
+ *
+ * lane: The name of the lane
+ *
+ * summary: The latencies
+ *
+ * Returns: void
+ */
+void print_summary(const char* label, const char* lane, Summary summary) {
+    printf("%-9s %-10s %8d %10lld %10lld %10lld %10lld %10lld\n", label,
+            lane, summary.count, summary.mean, summary.p50, summary.p90,
+            summary.p99, summary.max);
+}
+
+/* now_us()
+ * --------
+ * Gets the current time from a clock which is never set back.
+ *
+ * Returns: The time in microseconds
+ */
+long long now_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * US_PER_SEC + now.tv_nsec / NS_PER_US;
+}
@@ -6,25 +6,142 @@
  *
  * Usage:
  *  crackserver [--maxconn connections] [--port portnum]
- *          [--dictionary filename]
+ *          [--dictionary filename] [--coordinator workers] [--reserve cores]
+ *          [--unix path] [--placement pin|replicate|interleave]
+ *          [--potfile filename] [--rainbow tablefile]
+ *          [--bloom rate] [--bloom-budget megabytes]
+ *          [--log level] [--record file] [--acceptors count]
+ *          [--precompute dir] [--precompute-budget megabytes]
+ *          [--crypt builtin|libc]
+ *
+ *  crack requests may have trailing options:
+ *      timeout=ms      give up after ms milliseconds and answer :timeout
+ *      progress=ms     send ":progress tested/total" every ms milliseconds
+ *      range=from-to   only search dictionary words from (inclusive) to to
+ *      profile         send ":profile ..." before the result, saying how
+ *                      many words were tested by how many threads, how long
+ *                      the request waited before its threads were running,
+ *                      how long the sweep took and each thread's hash rate
+ *      eta             send ":eta ms" before sweeping the dictionary on this
+ *                      server, estimating how long the sweep will take
+ *
+ *  crack takes traditional DES hashes and MD5 ($1$), SHA-256 ($5$),
+ *  SHA-512 ($6$) and yescrypt ($y$) ones, which crypt also takes settings of
+ *  (e.g. crypt word $6$rounds=10000$salt). Binary frames carry them with
+ *  SETTING_FLAG (see crackprotocol.h). Those schemes cost anything from tens
+ *  to thousands of times as much per word as DES, so each crack's cost is
+ *  estimated from its scheme and rounds (see engine_parse_hash()). A heavy
+ *  crack, costing HEAVY_COST DES hashes a word or more, has its threads
+ *  taken from a budget of half the throughput lane's cores shared by every
+ *  heavy crack, and runs at a lower priority than DES sweeps, so that one
+ *  SHA-512 crack cannot hold up DES traffic. ETAs use the hash rate the
+ *  server has measured so far.
+ *
+ *  --coordinator takes a comma separated list of host:port addresses of other
+ *  crackservers. Crack requests are then split into dictionary ranges which
+ *  are sent to those workers, so every worker must have been started with the
+ *  same dictionary file as the coordinator.
+ *
+ *  Requests run in one of two lanes. crypt (and anything else answered
+ *  without a dictionary sweep) runs straight away on the client's thread, the
+ *  latency lane. Crack sweeps run on their own threads at a lower priority,
+ *  the throughput lane. --reserve keeps that many cores for the latency lane
+ *  only. Sending the server SIGHUP prints statistics for each lane to stderr.
+ *
+ *  --unix also listens on a Unix domain socket at path, for clients on the
+ *  same host. Those clients may move their requests into shared memory, see
+ *  crackprotocol.h.
+ *
+ *  --placement pins each crack thread to its own throughput lane core
+ *  instead of letting it float. replicate also gives each NUMA node its own
+ *  copy of the dictionary, which the threads on that node scan, and
+ *  interleave spreads a single copy evenly over every node. The crack rate is
+ *  included in the SIGHUP statistics so the modes can be compared.
+ *
+ *  --potfile keeps every hash the server cracks in filename (see potfile.h),
+ *  and answers any crack of a hash already in it straight away, in the
+ *  latency lane, without searching the dictionary.
+ *
+ *  --rainbow loads rainbow tables made by crackrainbow (see rainbow.h). A
+ *  crack whose hash is not found in the dictionary is then looked up in the
+ *  table for its salt, if there is one.
+ *
+ *  --bloom remembers, for each salt the whole dictionary has been swept with,
+ *  a Bloom filter of every hash in the dictionary with that salt, with the
+ *  given false positive rate (e.g. 0.01). Later cracks with that salt whose
+ *  hash is not in the filter fail without a sweep. The filters together use
+ *  at most --bloom-budget megabytes (default 64). SIGHUP also reports how
+ *  many sweeps the filters have saved.
+ *
+ *  --log writes a line to stderr for each record at or above level (one of
+ *  error, warn, info or debug) without holding up the thread which logged
+ *  it, see cracklog.h. info records every connection and every request with
+ *  its lane and how long it took; debug adds how each crack was answered.
+ *  Every request is numbered so its records can be told apart.
+ *
+ *  --record writes every request, with when it arrived, which connection it
+ *  came on and how long it took, to file (see traffic.h). crackreplay plays
+ *  a recording back against a server and compares the latencies. SIGHUP
+ *  also flushes the recording.
+ *
+ *  --acceptors accepts TCP connections on count threads (default 1), each
+ *  with its own listening socket bound to the same port with SO_REUSEPORT,
+ *  so the kernel spreads new connections between them. Unix domain socket
+ *  connections are still accepted by the first of them only.
+ *
+ *  --precompute counts the crack requests for each salt and, whenever the
+ *  server has been idle for a while, makes a salt table (see salttable.h)
+ *  of the whole dictionary for the most requested salt without one, in the
+ *  background at idle priority. It stops as soon as a request arrives and
+ *  carries on where it left off once the server is idle again. Tables and
+ *  the request counts are kept in dir, and loaded again on start up. Any
+ *  crack with a salt that has a table is answered from it in the latency
+ *  lane. The tables together use at most --precompute-budget megabytes
+ *  (default 256).
+ *
+ *  --crypt chooses how crack sweeps hash each word: builtin (the default)
+ *  uses the engine's own DES, which works out the salt and the hash being
+ *  cracked once per sweep instead of once per word (see descrypt.h), and
+ *  libc uses crypt_r() as before. crackverify checks that the two agree.
  *
  */
+#define _GNU_SOURCE // for thread affinity
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
 #include <getopt.h>
 #include <ctype.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <time.h>
 #include <pthread.h>
 #include <semaphore.h>
 #include <crypt.h>
 #include <csse2310a3.h>
 #include <csse2310a4.h>
+#include "crackprotocol.h"
+#include "potfile.h"
+#include "rainbow.h"
+#include "bloom.h"
+#include "cracklog.h"
+#include "traffic.h"
+#include "crackengine.h"
+#include "salttable.h"
 
 /* Global Definitions */
 // The maximum value a valid port number can be
@@ -57,74 +174,397 @@
                         "ABCDEFGHIJKLMNOPQRSTUVWXYZ"\
                         "0123456789./"
 
+// The size of each of the per-connection input and output buffers. No valid
+//      request line comes close to this length.
+#define CONN_BUFFER_SIZE 8192
+// The response sent to the client for an invalid command
+#define INVALID_RESPONSE ":invalid"
+// The response sent to the client when a crack finds no match
+#define FAILED_RESPONSE ":failed"
+// The response sent to the client when a crack reaches its deadline
+#define TIMEOUT_RESPONSE ":timeout"
+// The prefix of each progress line sent during a crack
+#define PROGRESS_RESPONSE ":progress"
+// The prefix of the profile line sent before a profiled crack's result
+#define PROFILE_RESPONSE ":profile"
+// The maximum number of space separated fields in a request. crack takes
+//      optional trailing options after its first MAX_COMMAND_ARGS fields.
+#define MAX_REQUEST_FIELDS 8
+// The prefix of the crack option restricting it to a range of the dictionary
+#define RANGE_OPTION "range="
+// The prefix of the crack option giving it a deadline in milliseconds
+#define TIMEOUT_OPTION "timeout="
+// The prefix of the crack option asking for progress every so many
+//      milliseconds
+#define PROGRESS_OPTION "progress="
+// The crack option asking for the crack to be profiled
+#define PROFILE_OPTION "profile"
+// The crack option asking for an estimate of how long the sweep will take
+#define ETA_OPTION "eta"
+// The prefix of the line giving that estimate
+#define ETA_RESPONSE ":eta"
+// The most digits accepted in a numeric option, keeping atoi well inside the
+//      range of an int
+#define MAX_OPTION_DIGITS 9
+// The size of a cache line, which the per-thread crack counters are padded
+//      to so that publishing them does not slow down neighbouring threads
+#define CACHE_LINE 64
+// The most separate allocations a request makes from its connection's arena
+#define ARENA_ALLOCATIONS 10
+// The longest a crack's profile can be once formatted: its counts and times,
+//      then one hash rate per thread
+#define PROFILE_LEN (128 + MAX_THREADS * 12)
+// The number of nanoseconds in a millisecond
+#define NS_PER_MS 1000000
+// The number of nanoseconds in a microsecond
+#define NS_PER_US 1000
+// The number of microseconds in a second
+#define US_PER_SEC 1000000
+// How many times the server checks a shared memory ring for a new request
+//      before going to sleep on it
+#define SHM_SPINS 100
+// How often, in milliseconds, a server waiting on a shared memory ring checks
+//      that its client is still there
+#define SHM_POLL_MS 100
+// The number of possible salts, each character being one of the 64
+//      PLAINTEXT_CHARS
+#define NUM_SALTS 4096
+// The default memory budget of the Bloom filters, in megabytes
+#define DEFAULT_BLOOM_BUDGET 64
+// The number of bytes in a megabyte
+#define BYTES_PER_MB (1024 * 1024)
+// The nice value crack threads run at so that they always give way to the
+//      latency lane
+#define CRACK_NICE 10
+// The cost per word, in DES hashes, from which a crack is heavy, and the
+//      nice value heavy cracks run at so that they give way to DES sweeps
+#define HEAVY_COST 16
+#define HEAVY_NICE 19
+// The hash rate, in DES hashes per second per thread, ETAs assume until a
+//      sweep has been timed
+#define DEFAULT_HASH_RATE 100000
+// The number of milliseconds in a second
+#define MS_PER_SEC 1000
+// The number of dictionary ranges a coordinator makes for each worker, so
+//      that faster workers take on more of the work
+#define SHARDS_PER_WORKER 4
+// The most threads which may accept connections at once
+#define MAX_ACCEPTORS 64
+// The default memory budget of the salt tables, in megabytes
+#define DEFAULT_PRECOMPUTE_BUDGET 256
+// How long, in milliseconds, the server must see no requests before it
+//      makes salt tables
+#define PRECOMPUTE_IDLE_MS 200
+// How many words are hashed into a salt table between checks that the
+//      server is still idle
+#define PRECOMPUTE_CHUNK 64
+// How often, in seconds, the salt request counts are saved at most
+#define PRECOMPUTE_SAVE_SECS 60
+// Where each salt table is kept in the --precompute directory, by salt number
+#define SALT_TABLE_FILE "%s/salt-%04d.tbl"
+// Where the salt request counts are kept in the --precompute directory
+#define SALT_COUNTS_FILE "%s/salts.cnt"
+// How often, in nanoseconds, a coordinator checks if its client has gone
+#define COORDINATOR_POLL_NS 100000000
+// The number of nanoseconds in a second
+#define NS_PER_SEC 1000000000
+
 /* New Type Creations */
 // enum containing the values to be used for getopt_long
 typedef enum {
     MAXCONN_ARG = 1,
     PORT_ARG = 2,
-    DICT_ARG = 3
+    DICT_ARG = 3,
+    COORDINATOR_ARG = 4,
+    RESERVE_ARG = 5,
+    UNIX_ARG = 6,
+    PLACEMENT_ARG = 7,
+    POTFILE_ARG = 8,
+    RAINBOW_ARG = 9,
+    BLOOM_ARG = 10,
+    BLOOM_BUDGET_ARG = 11,
+    LOG_ARG = 12,
+    RECORD_ARG = 13,
+    ACCEPTORS_ARG = 14,
+    PRECOMPUTE_ARG = 15,
+    PRECOMPUTE_BUDGET_ARG = 16,
+    CRYPT_ARG = 17
 } ArgType;
 
+// enum containing the lanes requests are executed in
+typedef enum {
+    LATENCY_LANE = 0,
+    THROUGHPUT_LANE = 1,
+    NUM_LANES = 2
+} Lane;
+
 // enum containing the exit codes
 typedef enum {
     OK = 0,
     USAGE_ERR = 1,
     DICT_OPEN_ERR = 2,
     EMPTY_DICT = 3,
-    PORTNUM_ERR = 4
+    PORTNUM_ERR = 4,
+    POTFILE_ERR = 5,
+    RAINBOW_ERR = 6,
+    RECORD_ERR = 7,
+    PRECOMPUTE_ERR = 8
 } ErrorCodes;
 
-// struct for containing the dictionary
+// struct for containing the address of a worker crackserver
 typedef struct {
-    char** words;
-    int numWords;
-    pthread_mutex_t* dictMutex;
-} Dictionary;
+    char* host;
+    char* port;
+} Worker;
 
-// struct for containing thread information for client threads
+// struct for containing the latency statistics of one lane. Updated with
+// atomics by every client thread.
 typedef struct {
-    int fd;
-    int* currCount;
-    sem_t* semaphore;
-    Dictionary dict;
-} ThreadParams;
+    long requests;
+    long long totalUs;
+    long long maxUs;
+} LaneStats;
 
-// struct for containing thread information for crack requests
+// struct for containing a connection's request-scoped bump allocator. It is
+// allocated once, at the size every request fits in, and emptied at the
+// start of each request, so nothing taken from it is ever freed on its own.
 typedef struct {
-    char* encrypted;
-    char* salt;
-    int threadId;
-    int numThreads;
-    Dictionary dict;
-    char* result;
-    volatile int* stopFlag;
-} CrackThreadData;
+    char* base;
+    size_t size;
+    size_t used;
+} Arena;
 
-// struct for containing all parameters for proper running of the server
+// struct for containing all parameters for proper running of the server.
+// The connection counts are updated with atomics, and admission counts the
+// connections still allowed when maxConnections is set. heavyFree counts the
+// heavyThreads which no heavy crack is using. desHashes and threadUs total
+// the work of every sweep, in DES hashes, and the thread time it took.
 typedef struct {
     char* dictPath;
-    Dictionary dict;
+    CrackEngine* engine;
     const char* port;
-    int socketfd;
+    int numAcceptors;
+    int socketfds[MAX_ACCEPTORS];
+    const char* unixPath;
+    int unixfd;
     int maxConnections;
     int currentNumConns;
     int totalConns;
-    sem_t countSemaphore;
+    sem_t admission;
+    Worker* workers;
+    int numWorkers;
+    int reservedCores;
+    cpu_set_t latencyCpus;
+    cpu_set_t throughputCpus;
+    LaneStats lanes[NUM_LANES];
+    Placement placement;
+    CryptImpl crypt;
+    long hashes;
+    long long hashUs;
+    size_t arenaSize;
+    const char* potPath;
+    Potfile* pot;
+    const char* rainbowPath;
+    RainbowSet rainbow;
+    double bloomRate;
+    size_t bloomBudget;
+    size_t bloomUsed;
+    BloomFilter* blooms[NUM_SALTS];
+    long sweepsAvoided;
+    LogLevel logLevel;
+    uint64_t numRequests;
+    const char* recordPath;
+    TrafficLog* traffic;
+    const char* precomputeDir;
+    size_t precomputeBudget;
+    size_t precomputeUsed;
+    uint64_t dictHash;
+    SaltTable* saltTables[NUM_SALTS];
+    uint32_t saltRequests[NUM_SALTS];
+    int activeSweeps;
+    long tableLookups;
+    int heavyThreads;
+    int heavyFree;
+    long heavyCracks;
+    long long desHashes;
+    long long threadUs;
 } ServerParams;
 
+// struct for containing thread information for client threads. id numbers
+// the connection, counting from 1.
+typedef struct {
+    int fd;
+    uint32_t id;
+    bool local;
+    ServerParams* server;
+} ThreadParams;
+
+// struct for containing thread information for acceptor threads
+typedef struct {
+    int fd;
+    ServerParams* server;
+} AcceptorParams;
+
+// struct for containing the buffered state of a single client connection.
+// Request lines are parsed in place from the input buffer and responses are
+// gathered in the output buffer so that several can be sent with one write.
+// When recording, each request is copied to recorded before it is handled,
+// since handling it may change it.
+typedef struct {
+    int fd;
+    uint32_t id;
+    bool local;
+    ShmRing* ring;
+    ServerParams* server;
+    char in[CONN_BUFFER_SIZE];
+    size_t inStart;
+    size_t inEnd;
+    bool discarding;
+    bool protocolError;
+    char out[CONN_BUFFER_SIZE];
+    size_t outLen;
+    struct crypt_data cryptData;
+    Arena arena;
+    uint32_t currentId;
+    uint64_t requestId;
+    long long requestStartUs;
+    Lane lane;
+    char* recorded;
+    size_t recordedLength;
+} Connection;
+
+// struct for containing a single crack request once it has been decoded.
+// timeoutMs and progressMs are 0 when not requested. Progress is reported by
+// calling onProgress with progressContext. crack() leaves the number of
+// words it tested in tested, and takes its engine job from arena. requestId
+// is the server's number for the request, used in log records. If onProfile
+// is set, crack() also fills in profile, which do_crack() then reports by
+// calling onProfile with progressContext, and likewise for onEta. info is the
+// scheme and cost of the hash, and local_crack() sets nice and heavyThreads,
+// the threads taken from the heavy crack budget.
+typedef struct {
+    uint64_t requestId;
+    char* encrypted;
+    HashInfo info;
+    int numThreads;
+    int nice;
+    int heavyThreads;
+    int start;
+    int end;
+    int cancelFd;
+    int timeoutMs;
+    int progressMs;
+    void (*onProgress)(void* context, long tested, long total);
+    void (*onProfile)(void* context, const char* profile);
+    void (*onEta)(void* context, long long etaMs);
+    void* progressContext;
+    CrackProfile* profile;
+    long tested;
+    Arena* arena;
+    BloomFilter* bloom;
+} CrackRequest;
+
+// enum containing the states a coordinator's dictionary range can be in
+typedef enum {
+    SHARD_PENDING = 0,
+    SHARD_RUNNING = 1,
+    SHARD_DONE = 2
+} ShardState;
+
+// struct for containing the state of a crack being shared between workers
+typedef struct {
+    CrackRequest* request;
+    int numShards;
+    int* shardStarts;
+    ShardState* shards;
+    int shardsDone;
+    int liveWorkers;
+    int cancelFd;
+    bool stopped;
+    bool found;
+    char result[MAX_WORD_LEN + 1];
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} Coordination;
+
+// struct for containing thread information for coordinator worker threads
+typedef struct {
+    Coordination* coord;
+    Worker* worker;
+    int index;
+} WorkerParams;
+
 /* Function Prototypes */
 void print_usage();
 ServerParams initialise(int argc, char* argv[]);
 bool is_digits(char* input);
 Dictionary process_dict(char* dictPath);
-void free_dict(Dictionary dict);
-int process_port(const char* portNum);
-void process_connections(int fdServer, ServerParams* params);
+int process_port(const char* portNum, bool reusePort, int* port);
+bool open_acceptors(ServerParams* params);
+int process_unix(const char* path);
+void start_acceptors(ServerParams* params);
+void* acceptor_thread(void* arg);
+void process_connections(int fdServer, int fdUnix, ServerParams* params);
+void parse_workers(char* list, ServerParams* params);
+void reserve_cores(ServerParams* params);
+void* stats_thread(void* arg);
+void print_stats(ServerParams* params);
+void record_latency(Connection* conn, long long startUs);
+void next_request_id(Connection* conn);
+void keep_request(Connection* conn, const char* request, size_t length);
+void keep_frame(Connection* conn, const FrameHeader* header,
+        const unsigned char* payload);
+size_t request_arena_size(const ServerParams* params);
+void* arena_alloc(Arena* arena, size_t size);
+void arena_reset(Arena* arena);
 void* client_thread(void* fdPtr);
-void add_new_line(char** line);
-char* do_command(char* command, Dictionary dict);
-char* crack(char* encrypted, int numThreads, Dictionary dict);
-void* crack_thread(void* arg);
+void text_session(Connection* conn);
+void binary_session(Connection* conn);
+bool attach_shm(Connection* conn, const char* name);
+void shm_session(Connection* conn);
+bool wait_for_request(Connection* conn);
+char* next_line(Connection* conn);
+unsigned char* next_frame(Connection* conn, FrameHeader* header);
+bool fill_input(Connection* conn);
+void queue_response(Connection* conn, const char* response);
+void queue_frame(Connection* conn, const FrameHeader* header,
+        const char* payload);
+bool flush_output(Connection* conn);
+int split_command(char* command, char** arguments);
+const char* do_command(char* command, Connection* conn);
+const char* do_text_request(char* request, Connection* conn);
+void do_frame(Connection* conn, const FrameHeader* header,
+        const unsigned char* payload);
+bool parse_crack_option(char* option, CrackRequest* request);
+bool parse_number(const char* value, int* number);
+void text_progress(void* context, long tested, long total);
+void binary_progress(void* context, long tested, long total);
+void text_profile(void* context, const char* profile);
+void binary_profile(void* context, const char* profile);
+void text_eta(void* context, long long etaMs);
+void send_profile(CrackRequest* request, Connection* conn);
+long long now_ms(void);
+long long now_us(void);
+const char* do_crack(CrackRequest* request, Connection* conn);
+const char* local_crack(CrackRequest* request, Connection* conn);
+bool bloom_rules_out(CrackRequest* request, ServerParams* server);
+void schedule_crack(CrackRequest* request, ServerParams* server);
+void finish_sweep(CrackRequest* request, ServerParams* server,
+        long long sweepUs);
+int salt_index(const char* encrypted);
+BloomFilter* reserve_bloom(ServerParams* server);
+const char* table_crack(CrackRequest* request, Connection* conn);
+bool load_salt_tables(ServerParams* params);
+void save_salt_counts(ServerParams* params);
+void* precompute_thread(void* arg);
+bool server_idle(ServerParams* params, uint64_t* seenRequests);
+int popular_salt(ServerParams* params);
+const char* do_crypt(const char* key, const char* salt, Connection* conn);
+const char* crack(CrackRequest* request, const CrackEngine* engine);
+bool client_gone(int fd);
+const char* coordinate_crack(CrackRequest* request, Connection* conn);
+void* worker_thread(void* arg);
+int connect_worker(Worker* worker);
 
 /* main()
  * ------
@@ -137,19 +577,81 @@ void* crack_thread(void* arg);
  */
 int main(int argc, char* argv[]) {
     ServerParams params = initialise(argc, argv);
-    sem_init(&(params.countSemaphore), 0, 1);
+    sem_init(&params.admission, 0, params.maxConnections);
     params.currentNumConns = 0;
     params.totalConns = 0;
-    params.dict = process_dict(params.dictPath);
-    params.socketfd = process_port(params.port);
-    if (params.socketfd == -1) {
-        free_dict(params.dict);
+    memset(params.lanes, 0, sizeof(params.lanes));
+    reserve_cores(&params);
+    params.heavyThreads = CPU_COUNT(&params.throughputCpus) / 2;
+    if (params.heavyThreads == 0) {
+        params.heavyThreads = 1;
+    }
+    params.heavyFree = params.heavyThreads;
+    params.arenaSize = request_arena_size(&params);
+    // SIGHUP is only handled by the stats thread, so every other thread
+    // (which all inherit this mask) must block it
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    signal(SIGPIPE, SIG_IGN); // a vanished worker must not kill a coordinator
+    pthread_t statsThreadId;
+    pthread_create(&statsThreadId, NULL, stats_thread, &params);
+    pthread_detach(statsThreadId);
+    log_start(params.logLevel, stderr);
+    params.engine = engine_create(process_dict(params.dictPath),
+            &params.throughputCpus, params.placement, CRACK_NICE);
+    params.engine->crypt = params.crypt;
+    if (params.potPath && !(params.pot = potfile_open(params.potPath))) {
+        engine_destroy(params.engine);
+        fprintf(stderr, "crackserver: unable to open pot file \"%s\"\n",
+                params.potPath);
+        exit(POTFILE_ERR);
+    }
+    if (params.rainbowPath && !rainbow_load(&params.rainbow,
+            params.rainbowPath)) {
+        engine_destroy(params.engine);
+        fprintf(stderr, "crackserver: unable to load rainbow tables \"%s\"\n",
+                params.rainbowPath);
+        exit(RAINBOW_ERR);
+    }
+    if (params.precomputeDir && !load_salt_tables(&params)) {
+        engine_destroy(params.engine);
+        fprintf(stderr, "crackserver: unable to precompute in \"%s\"\n",
+                params.precomputeDir);
+        exit(PRECOMPUTE_ERR);
+    }
+    bool listening = open_acceptors(&params);
+    params.unixfd = params.unixPath ? process_unix(params.unixPath) : -1;
+    if (params.recordPath && !(params.traffic =
+            traffic_open(params.recordPath, now_us()))) {
+        engine_destroy(params.engine);
+        fprintf(stderr, "crackserver: unable to record to \"%s\"\n",
+                params.recordPath);
+        exit(RECORD_ERR);
+    }
+    if (!listening || (params.unixPath && params.unixfd == -1)) {
+        engine_destroy(params.engine);
         fprintf(stderr, "crackserver: unable to open socket for listening\n");
         exit(PORTNUM_ERR);
     }
-    process_connections(params.socketfd, &params);
+    if (params.precomputeDir) {
+        pthread_t precomputeThreadId;
+        pthread_create(&precomputeThreadId, NULL, precompute_thread, &params);
+        pthread_detach(precomputeThreadId);
+    }
+    start_acceptors(&params);
+    process_connections(params.socketfds[0], params.unixfd, &params);
 
-    free_dict(params.dict);
+    if (params.pot) {
+        potfile_close(params.pot);
+    }
+    if (params.traffic) {
+        traffic_close(params.traffic);
+    }
+    rainbow_free(&params.rainbow);
+    engine_destroy(params.engine);
+    log_stop();
     return OK;
 }
 
@@ -162,27 +664,16 @@ int main(int argc, char* argv[]) {
  */
 void print_usage() {
     fprintf(stderr, "Usage: crackserver [--maxconn connections] "\
-            "[--port portnum] [--dictionary filename]\n");
+            "[--port portnum] [--dictionary filename] "\
+            "[--coordinator workers] [--reserve cores] [--unix path] "
+            "[--placement pin|replicate|interleave] [--potfile filename] "
+            "[--rainbow tablefile] [--bloom rate] "
+            "[--bloom-budget megabytes] [--log level] [--record file] "
+            "[--acceptors count] [--precompute dir] "
+            "[--precompute-budget megabytes] [--crypt builtin|libc]\n");
     exit(USAGE_ERR);
 }
 
-/* free_dict()
- * -----------
- * A program that goes through and frees the dictionary. Although server
- * shouldn't close under normal circumstances, makes sure that memory is freed
- * if it does.
- *
- * dict: The dictionary to be freed
- *
- * Returns: void
- */
-void free_dict(Dictionary dict) {
-    for (int i = 0; i < dict.numWords; i++) {
-        free(dict.words[i]);
-    }
-    free(dict.words);
-}
-
 /* initialise()
  * ------------
  * The function which gets all the arguments from the command line and ensures
@@ -197,12 +688,33 @@ void free_dict(Dictionary dict) {
  */
 ServerParams initialise(int argc, char* argv[]) {
     bool maxconnFlag = false, portFlag = false, dictFlag = false;
+    bool coordinatorFlag = false, reserveFlag = false;
     ServerParams params = {.port = ANY_PORTNUM, .dictPath = DEFAULT_DICT,
-            .maxConnections = UNLIMITED_CONNECTIONS};
+            .maxConnections = UNLIMITED_CONNECTIONS,
+            .bloomBudget = (size_t)DEFAULT_BLOOM_BUDGET * BYTES_PER_MB,
+            .precomputeBudget = (size_t)DEFAULT_PRECOMPUTE_BUDGET *
+            BYTES_PER_MB};
+    bool budgetFlag = false, logFlag = false, precomputeBudgetFlag = false;
+    bool cryptFlag = false;
     static struct option longOpts[] = {
         {"maxconn", required_argument, NULL, MAXCONN_ARG},
         {"port", required_argument, NULL, PORT_ARG},
         {"dictionary", required_argument, NULL, DICT_ARG},
+        {"coordinator", required_argument, NULL, COORDINATOR_ARG},
+        {"reserve", required_argument, NULL, RESERVE_ARG},
+        {"unix", required_argument, NULL, UNIX_ARG},
+        {"placement", required_argument, NULL, PLACEMENT_ARG},
+        {"potfile", required_argument, NULL, POTFILE_ARG},
+        {"rainbow", required_argument, NULL, RAINBOW_ARG},
+        {"bloom", required_argument, NULL, BLOOM_ARG},
+        {"bloom-budget", required_argument, NULL, BLOOM_BUDGET_ARG},
+        {"log", required_argument, NULL, LOG_ARG},
+        {"record", required_argument, NULL, RECORD_ARG},
+        {"acceptors", required_argument, NULL, ACCEPTORS_ARG},
+        {"precompute", required_argument, NULL, PRECOMPUTE_ARG},
+        {"precompute-budget", required_argument, NULL,
+                PRECOMPUTE_BUDGET_ARG},
+        {"crypt", required_argument, NULL, CRYPT_ARG},
         {0, 0, 0, 0}
     };
 
@@ -235,6 +747,73 @@ ServerParams initialise(int argc, char* argv[]) {
             dictFlag = true;
             params.dictPath = optarg;
             continue;
+        } else if (opt == COORDINATOR_ARG && !coordinatorFlag) {
+            coordinatorFlag = true;
+            parse_workers(optarg, &params);
+            continue;
+        } else if (opt == RESERVE_ARG && !reserveFlag) {
+            reserveFlag = true;
+            // at least one core must be left over for the throughput lane
+            if (is_digits(optarg) && strlen(optarg) <= MAX_OPTION_DIGITS &&
+                    atoi(optarg) < sysconf(_SC_NPROCESSORS_ONLN)) {
+                params.reservedCores = atoi(optarg);
+                continue;
+            }
+            print_usage();
+        } else if (opt == UNIX_ARG && !params.unixPath && strlen(optarg) > 0 &&
+                strlen(optarg) < sizeof(((struct sockaddr_un*)0)->sun_path)) {
+            params.unixPath = optarg;
+        } else if (opt == PLACEMENT_ARG && params.placement == PLACE_NONE) {
+            static const char* const modes[] = {"pin", "replicate",
+                    "interleave"};
+            for (int i = 0; i < (int)(sizeof(modes) / sizeof(*modes)); i++) {
+                if (strcmp(optarg, modes[i]) == 0) {
+                    params.placement = PLACE_PIN + i;
+                }
+            }
+            if (params.placement == PLACE_NONE) {
+                print_usage();
+            }
+        } else if (opt == POTFILE_ARG && !params.potPath &&
+                strlen(optarg) > 0) {
+            params.potPath = optarg;
+        } else if (opt == RAINBOW_ARG && !params.rainbowPath &&
+                strlen(optarg) > 0) {
+            params.rainbowPath = optarg;
+        } else if (opt == BLOOM_ARG && params.bloomRate == 0) {
+            char* end;
+            params.bloomRate = strtod(optarg, &end);
+            if (*end != '\0' || end == optarg || !(params.bloomRate > 0 &&
+                    params.bloomRate < 1)) {
+                print_usage();
+            }
+        } else if (opt == BLOOM_BUDGET_ARG && !budgetFlag &&
+                is_digits(optarg) && strlen(optarg) <= MAX_OPTION_DIGITS) {
+            budgetFlag = true;
+            params.bloomBudget = (size_t)atoi(optarg) * BYTES_PER_MB;
+        } else if (opt == LOG_ARG && !logFlag &&
+                log_parse_level(optarg, &params.logLevel)) {
+            logFlag = true;
+        } else if (opt == RECORD_ARG && !params.recordPath &&
+                strlen(optarg) > 0) {
+            params.recordPath = optarg;
+        } else if (opt == ACCEPTORS_ARG && !params.numAcceptors &&
+                is_digits(optarg) && strlen(optarg) <= MAX_OPTION_DIGITS &&
+                atoi(optarg) > 0 && atoi(optarg) <= MAX_ACCEPTORS) {
+            params.numAcceptors = atoi(optarg);
+        } else if (opt == PRECOMPUTE_ARG && !params.precomputeDir &&
+                strlen(optarg) > 0) {
+            params.precomputeDir = optarg;
+        } else if (opt == PRECOMPUTE_BUDGET_ARG && !precomputeBudgetFlag &&
+                is_digits(optarg) && strlen(optarg) <= MAX_OPTION_DIGITS) {
+            precomputeBudgetFlag = true;
+            params.precomputeBudget = (size_t)atoi(optarg) * BYTES_PER_MB;
+        } else if (opt == CRYPT_ARG && !cryptFlag &&
+                (strcmp(optarg, "builtin") == 0 ||
+                strcmp(optarg, "libc") == 0)) {
+            cryptFlag = true;
+            params.crypt = strcmp(optarg, "libc") == 0 ? CRYPT_LIBC :
+                    CRYPT_BUILTIN;
         } else {
             print_usage();
         }
@@ -242,10 +821,347 @@ ServerParams initialise(int argc, char* argv[]) {
     if (optind < argc) {
         print_usage();
     }
+    if (params.numAcceptors == 0) {
+        params.numAcceptors = 1;
+    }
 
     return params;
 }
 
+/* parse_workers()
+ * ---------------
+ * Splits the --coordinator argument into the list of worker addresses. Each
+ * comma separated entry is host:port, or just port for a worker on localhost.
+ *
+ * list: The argument to be split, modified in place
+ *
+ * params: The server parameters to store the workers in
+ *
+ * Returns: void
+ * Errors: For an empty list or entry, calls print_usage() which will error
+ */
+void parse_workers(char* list, ServerParams* params) {
+    params->numWorkers = 0;
+    params->workers = NULL;
+    char* savePtr;
+    for (char* entry = strtok_r(list, ",", &savePtr); entry != NULL;
+            entry = strtok_r(NULL, ",", &savePtr)) {
+        Worker worker = {.host = "localhost", .port = entry};
+        char* colon = strrchr(entry, ':');
+        if (colon != NULL) {
+            *colon = '\0';
+            worker.host = entry;
+            worker.port = colon + 1;
+        }
+        if (strlen(worker.host) == 0 || !is_digits(worker.port)) {
+            print_usage();
+        }
+        params->workers = realloc(params->workers,
+                sizeof(Worker) * (params->numWorkers + 1));
+        params->workers[params->numWorkers++] = worker;
+    }
+    if (params->numWorkers == 0) {
+        print_usage();
+    }
+}
+
+/* reserve_cores()
+ * ---------------
+ * Works out which cores each lane may run on. The first reservedCores online
+ * cores are kept for the latency lane and the rest are given to the
+ * throughput lane. With nothing reserved both lanes may use every core.
+ *
+ * params: The server parameters containing reservedCores, which the two cpu
+ *      sets are stored in
+ *
+ * Returns: void
+ */
+void reserve_cores(ServerParams* params) {
+    CPU_ZERO(&params->latencyCpus);
+    CPU_ZERO(&params->throughputCpus);
+    cpu_set_t online;
+    sched_getaffinity(0, sizeof(online), &online);
+    int seen = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &online)) {
+            continue;
+        }
+        if (seen++ < params->reservedCores) {
+            CPU_SET(cpu, &params->latencyCpus);
+        } else {
+            CPU_SET(cpu, &params->throughputCpus);
+            if (params->reservedCores == 0) {
+                CPU_SET(cpu, &params->latencyCpus);
+            }
+        }
+    }
+}
+
+/* stats_thread()
+ * --------------
+ * The thread which waits for SIGHUP and prints the server statistics, and
+ * flushes the recording and saves the salt request counts, each time it
+ * arrives.
+ *
+ * arg: The ServerParams of the server
+ *
+ * Returns: void* (never returns)
+ */
+void* stats_thread(void* arg) {
+    ServerParams* params = (ServerParams*)arg;
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGHUP);
+    while (true) {
+        int signal;
+        if (sigwait(&signals, &signal) == 0) {
+            print_stats(params);
+            if (params->traffic) {
+                traffic_flush(params->traffic);
+            }
+            if (params->precomputeDir) {
+                save_salt_counts(params);
+            }
+        }
+    }
+    return NULL;
+}
+
+/* print_stats()
+ * -------------
+ * Prints the connection counts and the latency of each request lane to
+ * stderr.
+ *
+ * params: The ServerParams of the server
+ *
+ * Returns: void
+ */
+void print_stats(ServerParams* params) {
+    static const char* const laneNames[NUM_LANES] = {"Latency", "Throughput"};
+    int current = __atomic_load_n(&params->currentNumConns, __ATOMIC_RELAXED);
+    int completed = __atomic_load_n(&params->totalConns, __ATOMIC_RELAXED) -
+            current;
+    fprintf(stderr, "Connected clients: %d\n", current);
+    fprintf(stderr, "Completed clients: %d\n", completed);
+    for (int i = 0; i < NUM_LANES; i++) {
+        LaneStats* lane = &params->lanes[i];
+        long requests = __atomic_load_n(&lane->requests, __ATOMIC_RELAXED);
+        long long totalUs = __atomic_load_n(&lane->totalUs, __ATOMIC_RELAXED);
+        fprintf(stderr, "%s lane: %ld requests, mean %lld us, max %lld us\n",
+                laneNames[i], requests, requests ? totalUs / requests : 0,
+                __atomic_load_n(&lane->maxUs, __ATOMIC_RELAXED));
+    }
+    long hashes = __atomic_load_n(&params->hashes, __ATOMIC_RELAXED);
+    long long hashUs = __atomic_load_n(&params->hashUs, __ATOMIC_RELAXED);
+    // hashUs is summed over concurrent cracks, so this is per crack
+    fprintf(stderr, "Crack rate: %ld hashes, %lld hashes/sec\n", hashes,
+            hashUs ? hashes * US_PER_SEC / hashUs : 0);
+    long long desHashes = __atomic_load_n(&params->desHashes,
+            __ATOMIC_RELAXED);
+    long long threadUs = __atomic_load_n(&params->threadUs, __ATOMIC_RELAXED);
+    fprintf(stderr, "Heavy cracks: %ld, %d of %d threads free, "
+            "%lld DES hashes/sec per thread\n",
+            __atomic_load_n(&params->heavyCracks, __ATOMIC_RELAXED),
+            __atomic_load_n(&params->heavyFree, __ATOMIC_RELAXED),
+            params->heavyThreads, threadUs ? desHashes * US_PER_SEC /
+            threadUs : DEFAULT_HASH_RATE);
+    if (params->bloomRate > 0) {
+        int numBlooms = 0;
+        for (int i = 0; i < NUM_SALTS; i++) {
+            numBlooms += __atomic_load_n(&params->blooms[i],
+                    __ATOMIC_RELAXED) != NULL;
+        }
+        fprintf(stderr, "Bloom filters: %d salts, %zu bytes, %ld sweeps "
+                "avoided\n", numBlooms,
+                __atomic_load_n(&params->bloomUsed, __ATOMIC_RELAXED),
+                __atomic_load_n(&params->sweepsAvoided, __ATOMIC_RELAXED));
+    }
+    if (params->precomputeDir) {
+        int numTables = 0;
+        for (int i = 0; i < NUM_SALTS; i++) {
+            numTables += __atomic_load_n(&params->saltTables[i],
+                    __ATOMIC_RELAXED) != NULL;
+        }
+        fprintf(stderr, "Salt tables: %d salts, %zu bytes, %ld lookups\n",
+                numTables,
+                __atomic_load_n(&params->precomputeUsed, __ATOMIC_RELAXED),
+                __atomic_load_n(&params->tableLookups, __ATOMIC_RELAXED));
+    }
+    fflush(stderr);
+}
+
+/* record_latency()
+ * ----------------
+ * Adds a finished request to the statistics of the lane it ran in, logs it
+ * and adds it to the recording, if there is one.
+ *
+ * conn: The connection the request arrived on, whose lane says which lane
+ *      the request ran in
+ *
+ * startUs: When the request started being handled, from now_us()
+ *
+ * Returns: void
+ */
+void record_latency(Connection* conn, long long startUs) {
+    LaneStats* lane = &conn->server->lanes[conn->lane];
+    long long latency = now_us() - startUs;
+    __atomic_add_fetch(&lane->requests, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&lane->totalUs, latency, __ATOMIC_RELAXED);
+    long long max = __atomic_load_n(&lane->maxUs, __ATOMIC_RELAXED);
+    while (latency > max && !__atomic_compare_exchange_n(&lane->maxUs, &max,
+            latency, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        // max has been reloaded, try again while we are still bigger
+    }
+    log_event(LOG_INFO, conn->requestId, latency, "fd %d %s lane", conn->fd,
+            conn->lane == LATENCY_LANE ? "latency" : "throughput");
+    if (conn->recorded != NULL) {
+        traffic_add(conn->server->traffic, conn->id, startUs, latency,
+                conn->lane, conn->recorded, conn->recordedLength);
+    }
+}
+
+/* keep_request()
+ * --------------
+ * Keeps a copy of a text protocol request for the recording, if there is
+ * one, before it is handled.
+ *
+ * conn: The connection the request arrived on
+ *
+ * request: The request line
+ *
+ * length: The length of the request line, without any new line
+ *
+ * Returns: void
+ */
+void keep_request(Connection* conn, const char* request, size_t length) {
+    if (conn->recorded != NULL) {
+        conn->recordedLength = length < TRAFFIC_MAX_REQUEST ? length :
+                TRAFFIC_MAX_REQUEST;
+        memcpy(conn->recorded, request, conn->recordedLength);
+    }
+}
+
+/* keep_frame()
+ * ------------
+ * Keeps a copy of a binary protocol request for the recording, if there is
+ * one, as the text protocol request which would have done the same. Frames
+ * with no text equivalent are kept as an empty (so invalid) request.
+ *
+ * conn: The connection the request arrived on
+ *
+ * header: The request frame's header
+ *
+ * payload: The request frame's payload
+ *
+ * Returns: void
+ */
+void keep_frame(Connection* conn, const FrameHeader* header,
+        const unsigned char* payload) {
+    if (conn->recorded == NULL) {
+        return;
+    }
+    int length = 0;
+    RequestFields fields;
+    if (!unpack_request(header, payload, &fields)) {
+        // kept as an empty request
+    } else if (header->opcode == OP_CRACK) {
+        length = snprintf(conn->recorded, TRAFFIC_MAX_REQUEST,
+                "crack %.*s %u", fields.settingLength, fields.setting,
+                payload[0]);
+        uint32_t options[2] = {0, 0};
+        if (fields.restLength == CRACK_OPTIONS_LEN) {
+            memcpy(options, fields.rest, sizeof(options));
+        }
+        if (options[0] != 0) {
+            length += snprintf(conn->recorded + length,
+                    TRAFFIC_MAX_REQUEST - length, " %s%u", TIMEOUT_OPTION,
+                    ntohl(options[0]));
+        }
+        if (options[1] != 0) {
+            length += snprintf(conn->recorded + length,
+                    TRAFFIC_MAX_REQUEST - length, " %s%u", PROGRESS_OPTION,
+                    ntohl(options[1]));
+        }
+        if (header->flags & PROFILE_FLAG) {
+            length += snprintf(conn->recorded + length,
+                    TRAFFIC_MAX_REQUEST - length, " %s", PROFILE_OPTION);
+        }
+    } else {
+        length = snprintf(conn->recorded, TRAFFIC_MAX_REQUEST,
+                "crypt %.*s %.*s", fields.restLength, fields.rest,
+                fields.settingLength, fields.setting);
+    }
+    conn->recordedLength = length < TRAFFIC_MAX_REQUEST ? length :
+            TRAFFIC_MAX_REQUEST - 1;
+}
+
+/* next_request_id()
+ * -----------------
+ * Numbers a new request on a connection, for its log records, and notes when
+ * it started being handled, for its profile.
+ *
+ * conn: The connection the request arrived on
+ *
+ * Returns: void
+ */
+void next_request_id(Connection* conn) {
+    conn->requestId = __atomic_add_fetch(&conn->server->numRequests, 1,
+            __ATOMIC_RELAXED);
+    conn->requestStartUs = now_us();
+}
+
+/* request_arena_size()
+ * --------------------
+ * Works out how big each connection's arena must be for any request to fit:
+ * the bookkeeping of a crack with the most threads, plus that of sharing it
+ * out between every worker when coordinating, plus three copies of the answer
+ * and a profile.
+ *
+ * params: The server parameters, containing the workers
+ *
+ * Returns: The arena size in bytes
+ */
+size_t request_arena_size(const ServerParams* params) {
+    size_t numShards = (size_t)params->numWorkers * SHARDS_PER_WORKER;
+    size_t size = engine_job_size(MAX_THREADS) + 3 * (MAX_WORD_LEN + 1) +
+            sizeof(CrackProfile) + PROFILE_LEN;
+    size += sizeof(int) * (numShards + 1) + sizeof(ShardState) * numShards +
+            (sizeof(pthread_t) + sizeof(WorkerParams)) * params->numWorkers;
+    return size + ARENA_ALLOCATIONS * CACHE_LINE; // room for alignment
+}
+
+/* arena_alloc()
+ * -------------
+ * Takes memory from an arena, aligned to a cache line. It is only valid until
+ * the arena is next reset.
+ *
+ * arena: The arena to take the memory from
+ *
+ * size: The number of bytes needed
+ *
+ * Returns: The memory, or NULL if the arena does not have enough left
+ */
+void* arena_alloc(Arena* arena, size_t size) {
+    size_t start = (arena->used + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1);
+    if (start + size > arena->size) {
+        return NULL;
+    }
+    arena->used = start + size;
+    return arena->base + start;
+}
+
+/* arena_reset()
+ * -------------
+ * Empties an arena, at the start of a new request.
+ *
+ * arena: The arena to be emptied
+ *
+ * Returns: void
+ */
+void arena_reset(Arena* arena) {
+    arena->used = 0;
+}
+
 /* is_digits()
  * -----------
  * A method which goes over a string and ensures that every character is a
@@ -267,9 +1183,8 @@ bool is_digits(char* input) {
 
 /* process_dict()
  * --------------
- * A method which goes line by line through the provided dictionary file and
- * checks each word to be less than or equal to 8 characters in length, then
- * adds the words to a dictionary struct which is then returned.
+ * Loads the provided dictionary file with the crack engine, which keeps only
+ * the words that are less than or equal to 8 characters in length.
  *
  * dictPath: The path to the dictionary to be read
  *
@@ -278,31 +1193,15 @@ bool is_digits(char* input) {
  *         If after processing dictionary is empty EMPTY_DICT -> 3
  */
 Dictionary process_dict(char* dictPath) {
-    Dictionary dictionary = {.numWords = 0};
-    FILE* dictFile = fopen(dictPath, "r");
-    if (dictFile == NULL) {
+    Dictionary dictionary;
+    if (!engine_load_dict(dictPath, &dictionary)) {
         fprintf(stderr, "crackserver: unable to open dictionary file \"%s\"\n",
                 dictPath);
         exit(DICT_OPEN_ERR);
     }
-    dictionary.words = malloc(sizeof(char*));
-    char* currentLine;
-    while ((currentLine = read_line(dictFile))) {
-        int wordLen = strlen(currentLine);
-        if (wordLen > MAX_WORD_LEN || wordLen == 0) {
-            continue; // skip over this word if not the right length
-        }
-        // increase dictionary size for each word. Not very efficient but only
-        // called once at the start, so not too important at run time.
-        dictionary.words = realloc(dictionary.words, sizeof(char*) *
-                dictionary.numWords + 1);
-        dictionary.words[dictionary.numWords] = currentLine;
-        dictionary.numWords++;
-    }
-    fclose(dictFile);
     // either no words in dict or none the right length.
     if (dictionary.numWords == 0) {
-        free(dictionary.words);
+        engine_free_dict(dictionary);
         fprintf(stderr, "crackserver: no plain text words to test\n");
         exit(EMPTY_DICT);
     }
@@ -317,11 +1216,16 @@ Dictionary process_dict(char* dictPath) {
  * 
  * portNum: The string value of the port number to listen on
  *
+ * reusePort: Whether other sockets may listen on the same port, each being
+ *      given a share of the new connections
+ *
+ * port: Where to store the actual port number, or NULL
+ *
  * Returns: A file descripter of the port after being opened for listening
  * Errors: If there are any socketing or address errors. Error is passed up to
  *      The function which called it.
  */
-int process_port(const char* portNum) {
+int process_port(const char* portNum, bool reusePort, int* port) {
     struct addrinfo* ai = 0;
     struct addrinfo hints;
 
@@ -340,7 +1244,8 @@ int process_port(const char* portNum) {
 
     int optVal = 1;
     if (setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, 
-            &optVal, sizeof(int)) < 0) {
+            &optVal, sizeof(int)) < 0 || (reusePort && setsockopt(listenfd,
+            SOL_SOCKET, SO_REUSEPORT, &optVal, sizeof(int)) < 0)) {
         freeaddrinfo(ai);
         return -1;
     }
@@ -357,63 +1262,181 @@ int process_port(const char* portNum) {
         return -1;
     }
 
-    if (listen(listenfd, 0) < 0) {
+    if (listen(listenfd, SOMAXCONN) < 0) {
         freeaddrinfo(ai);
         return -1;
     }
 
-    int port = ntohs(addr.sin_port); // find actual port number
+    freeaddrinfo(ai);
+    if (port != NULL) {
+        *port = ntohs(addr.sin_port); // find actual port number
+    }
+    return listenfd;
+}
+
+/* open_acceptors()
+ * ----------------
+ * Opens a listening socket for each acceptor. The first is bound to the
+ * requested port and the rest to whichever port that turned out to be, all
+ * with SO_REUSEPORT if there is more than one. The port is then printed.
+ *
+ * params: The server parameters containing the port and number of acceptors,
+ *      which the sockets are stored in
+ *
+ * Returns: false if any of the sockets could not be opened
+ */
+bool open_acceptors(ServerParams* params) {
+    bool reusePort = params->numAcceptors > 1;
+    int port;
+    params->socketfds[0] = process_port(params->port, reusePort, &port);
+    if (params->socketfds[0] == -1) {
+        return false;
+    }
+    char portText[MAX_OPTION_DIGITS + 1];
+    snprintf(portText, sizeof(portText), "%d", port);
+    for (int i = 1; i < params->numAcceptors; i++) {
+        params->socketfds[i] = process_port(portText, true, NULL);
+        if (params->socketfds[i] == -1) {
+            return false;
+        }
+    }
     fprintf(stderr, "%d\n", port);
     fflush(stderr);
+    return true;
+}
+
+/* process_unix()
+ * --------------
+ * Opens a Unix domain socket for listening at the given path, replacing any
+ * socket left there by a previous server.
+ *
+ * path: Where in the file system to create the socket
+ *
+ * Returns: A file descriptor of the socket after being opened for listening,
+ *      or -1 if it could not be created
+ */
+int process_unix(const char* path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    struct stat info;
+    if (stat(path, &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(path); // never remove anything that is not a socket
+    }
+    int listenfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenfd < 0 || bind(listenfd, (struct sockaddr*)&addr,
+            sizeof(addr)) < 0 || listen(listenfd, SOMAXCONN) < 0) {
+        if (listenfd >= 0) {
+            close(listenfd);
+        }
+        return -1;
+    }
     return listenfd;
 }
 
+/* start_acceptors()
+ * -----------------
+ * Starts a thread accepting connections on each listening socket but the
+ * first, which is left for the main thread.
+ *
+ * params: The server parameters containing the sockets
+ *
+ * Returns: void
+ */
+void start_acceptors(ServerParams* params) {
+    for (int i = 1; i < params->numAcceptors; i++) {
+        AcceptorParams* acceptor = malloc(sizeof(AcceptorParams));
+        acceptor->fd = params->socketfds[i];
+        acceptor->server = params;
+        pthread_t threadId;
+        pthread_create(&threadId, NULL, acceptor_thread, acceptor);
+        pthread_detach(threadId);
+    }
+}
+
+/* acceptor_thread()
+ * -----------------
+ * The thread which accepts connections on one of the extra listening sockets.
+ *
+ * arg: The AcceptorParams of the socket
+ *
+ * Returns: void* (never returns)
+ */
+void* acceptor_thread(void* arg) {
+    AcceptorParams* acceptor = (AcceptorParams*)arg;
+    process_connections(acceptor->fd, -1, acceptor->server);
+    return NULL;
+}
+
 /* process_connections()
  * ---------------------
  * A function which listens and waits for clients to attempt to connect. If we
  * have reached maxConnections, then the client is to be held potentially
- * indefinitely until a space becomes free for it.
+ * indefinitely until a space becomes free for it. Clients are accepted from
+ * the Unix domain socket as well, if there is one. Several of these may run
+ * at once, one per acceptor.
  *
  * fdServer: The file descripter that the server is listening on
  *
+ * fdUnix: The Unix domain socket to also accept clients from, or -1
+ *
  * params: The server parameters containing important information like the
  *          dictionary and maximum connections
  * 
  * Returns: void
  * Errors: If there are any connection errors
  */
-void process_connections(int fdServer, ServerParams* params) {
+void process_connections(int fdServer, int fdUnix, ServerParams* params) {
     int fd;
-    struct sockaddr_in fromAddr;
-    socklen_t fromAddrSize;
+    struct pollfd listeners[2] = {{.fd = fdServer, .events = POLLIN},
+            {.fd = fdUnix, .events = POLLIN}};
+    int numListeners = fdUnix >= 0 ? 2 : 1;
+    bool takeLocal = false;
 
     while (1) {
-        fromAddrSize = sizeof(struct sockaddr_in);
-        fd = accept(fdServer, (struct sockaddr*)&fromAddr, &fromAddrSize);
+        if (poll(listeners, numListeners, -1) < 0) {
+            continue; // interrupted
+        }
+        // take turns when both are ready so neither can starve the other
+        bool local = numListeners == 2 && listeners[1].revents != 0 &&
+                (listeners[0].revents == 0 || takeLocal);
+        takeLocal = !takeLocal;
+        fd = accept(listeners[local].fd, NULL, NULL);
         if (fd < 0) {
+            if (errno == EAGAIN || errno == ECONNABORTED || errno == EINTR) {
+                continue; // the client went away before we got to it
+            }
             perror("Error accepting connection");
             exit(1);
         }
 
-        sem_wait(&(params->countSemaphore));
-        if (params->maxConnections != 0) { // check for and wait if > max conns
-            while (params->currentNumConns >= params->maxConnections) {
-                sem_post(&(params->countSemaphore));
-                sem_wait(&(params->countSemaphore));
+        if (params->maxConnections != 0) { // wait if at max conns
+            while (sem_wait(&params->admission) < 0) {
             }
         }
-        (params->currentNumConns)++;
-        (params->totalConns)++;
-        sem_post(&(params->countSemaphore));
+        __atomic_add_fetch(&params->currentNumConns, 1, __ATOMIC_RELAXED);
+        uint32_t id = __atomic_add_fetch(&params->totalConns, 1,
+                __ATOMIC_RELAXED);
+
+        // responses are batched by the client thread, so Nagle's algorithm
+        // would only delay them
+        int optVal = 1;
+        if (!local) {
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &optVal, sizeof(int));
+        }
 
-        ThreadParams threadParams;
-        threadParams.fd = fd;
-        threadParams.semaphore = &params->countSemaphore;
-        threadParams.currCount = &params->currentNumConns;
-        threadParams.dict = (*params).dict;
+        // each thread gets its own copy, freed by the thread, so that a
+        // quick succession of connections cannot overwrite another's fd
+        ThreadParams* threadParams = malloc(sizeof(ThreadParams));
+        threadParams->fd = fd;
+        threadParams->id = id;
+        threadParams->local = local;
+        threadParams->server = params;
 
         pthread_t threadId;
-	    pthread_create(&threadId, NULL, client_thread, &threadParams);
+        pthread_create(&threadId, NULL, client_thread, threadParams);
         pthread_detach(threadId);
     }
 }
@@ -422,7 +1445,8 @@ void process_connections(int fdServer, ServerParams* params) {
  * ---------------
  * A method to handle the processes to be run and processing of requests from a
  * client. This is the method called by the server to create a thread for each
- * incoming connection.
+ * incoming connection. The first byte received decides whether the client is
+ * using the text or the binary protocol for the rest of the connection.
  * 
  * arg: The thread parameters structure containing important information for
  *      each client
@@ -432,226 +1456,1681 @@ void process_connections(int fdServer, ServerParams* params) {
  */
 void* client_thread(void* arg) {
     ThreadParams* params = (ThreadParams*)arg;
-    int fd = params->fd;
-    FILE* to = fdopen(fd, "w");
-    FILE* from = fdopen(dup(fd), "r");
-
-    char* currentIn;
-    while ((currentIn = read_line(from)) != NULL) {
-        char* response;
-        response = do_command(currentIn, params->dict);
-        if (response[0] != ':') {
-            response = strdup(response);
-            add_new_line(&response);
-        }
-        fprintf(to, "%s", response);
-        fflush(to);
-        free(currentIn);
+    Connection* conn = malloc(sizeof(Connection));
+    conn->fd = params->fd;
+    conn->id = params->id;
+    conn->local = params->local;
+    conn->ring = NULL;
+    conn->server = params->server;
+    conn->inStart = conn->inEnd = conn->outLen = 0;
+    conn->discarding = conn->protocolError = false;
+    conn->cryptData.initialized = 0;
+    conn->requestId = 0;
+    conn->recorded = params->server->traffic ?
+            malloc(TRAFFIC_MAX_REQUEST) : NULL;
+    conn->recordedLength = 0;
+    // the arena must be cache line aligned for the crack thread data in it
+    posix_memalign((void**)&conn->arena.base, CACHE_LINE,
+            conn->server->arenaSize);
+    conn->arena.size = conn->server->arenaSize;
+    conn->arena.used = 0;
+    // crypt runs on this thread, so it belongs on the latency lane's cores
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
+            &conn->server->latencyCpus);
+
+    log_event(LOG_INFO, 0, -1, "fd %d connected over %s", conn->fd,
+            conn->local ? "unix socket" : "tcp");
+    long long connectedUs = now_us();
+
+    if (fill_input(conn)) {
+        if ((unsigned char)conn->in[0] == BINARY_MAGIC) {
+            conn->inStart++;
+            // acknowledge the switch to the binary protocol
+            conn->out[conn->outLen++] = (char)BINARY_MAGIC;
+            binary_session(conn);
+        } else {
+            text_session(conn);
+        }
     }
 
-    sem_wait(params->semaphore);
-    (*params->currCount)--;
-    sem_post(params->semaphore);
-    close(fd);
-    fclose(to);
-    fclose(from);
+    __atomic_sub_fetch(&params->server->currentNumConns, 1, __ATOMIC_RELAXED);
+    if (params->server->maxConnections != 0) {
+        sem_post(&params->server->admission); // let a waiting client in
+    }
+    if (conn->ring != NULL) {
+        munmap(conn->ring, sizeof(ShmRing));
+    }
+    log_event(LOG_INFO, 0, now_us() - connectedUs, "fd %d disconnected",
+            conn->fd);
+    close(conn->fd);
+    free(conn->recorded);
+    free(conn->arena.base);
+    free(conn);
+    free(params);
     return NULL;
 }
 
-/* add_new_line()
+/* text_session()
  * --------------
- * A helper function to add an extra new line at the end of a malloced string
- * in place. Important for sending messages to the client as they are expecting
- * a new line to terminate each response.
+ * Serves a client using the newline terminated text protocol until it closes
+ * the connection.
  *
- * line: A pointer to the string requiring a new line
- * 
- * Returns: void, as edits the string in place
- * Errors: for any mallocing errors
+ * Every complete request line already received is answered before anything is
+ * sent, so a client that pipelines requests gets all of their responses in a
+ * single write. Pending responses are always sent before waiting for more
+ * input or starting a (potentially long) crack.
+ *
+ * conn: The connection to serve, with its first input already read
+ *
+ * Returns: void
  */
-void add_new_line(char** line) {
-    // Increase the string size by 2 (1 for '\n' and 1 for '\0')
-    size_t length = strlen(*line);
-    *line = (char*) realloc(*line, length + 2); 
-    if (*line == NULL) {
-        // Handle realloc error
-        fprintf(stderr, "Memory allocation failed\n");
+void text_session(Connection* conn) {
+    bool open = true;
+    while (open) {
+        char* currentIn;
+        while ((currentIn = next_line(conn)) != NULL) {
+            if (strncmp(currentIn, "crack", strlen("crack")) == 0 &&
+                    !flush_output(conn)) {
+                break;
+            }
+            if (strncmp(currentIn, SHM_COMMAND, strlen(SHM_COMMAND)) == 0 &&
+                    conn->local) {
+                bool attached = attach_shm(conn,
+                        currentIn + strlen(SHM_COMMAND));
+                queue_response(conn, attached ? SHM_RESPONSE :
+                        INVALID_RESPONSE);
+                if (attached && flush_output(conn)) {
+                    shm_session(conn);
+                    return; // only the ring is used from now on
+                }
+                continue;
+            }
+            queue_response(conn, do_text_request(currentIn, conn));
+        }
+        open = flush_output(conn) && fill_input(conn);
+    }
+    if (conn->inEnd > conn->inStart && !conn->discarding) {
+        // the client closed its end with an unterminated final request
+        conn->in[conn->inEnd] = '\0';
+        queue_response(conn, do_text_request(conn->in + conn->inStart, conn));
+        flush_output(conn);
     }
-    (*line)[length] = '\n';
-    (*line)[length + 1] = '\0';
 }
 
-/* num_places()
- * ------------
- * A recursive function to calculate the number of decimal places a value takes
+/* do_text_request()
+ * -----------------
+ * Carries out one text protocol request from either text_session() or
+ * shm_session(), starting it in the latency lane and keeping it for the
+ * recording and the lane stats, as binary_session() does for frames.
  *
- * n: the input number to see how many places it takes up
+ * request: The request line, without its new line
  *
- * Returns: The number of places taken by the number
+ * conn: The connection the request arrived on
+ *
+ * Returns: The response to send back to the client, see do_command()
  */
-int num_places(int n) {
-    if (n < 10) {
-        return 1;
-    } else {
-        return 1 + num_places(n / 10);
-    }
+const char* do_text_request(char* request, Connection* conn) {
+    long long startUs = now_us();
+    conn->lane = LATENCY_LANE;
+    keep_request(conn, request, strlen(request));
+    const char* response = do_command(request, conn);
+    record_latency(conn, startUs);
+    return response;
 }
 
-/* do_command()
- * ------------
- * A method to be called by the client thread which handles the incoming
+/* binary_session()
+ * ----------------
+ * Serves a client using the binary protocol (see crackprotocol.h) until it
+ * closes the connection or sends a frame which is too large, batching
+ * responses in the same way as text_session().
+ *
+ * conn: The connection to serve, with the protocol switch byte consumed
+ *
+ * Returns: void
+ */
+void binary_session(Connection* conn) {
+    bool open = true;
+    while (open) {
+        FrameHeader header;
+        unsigned char* payload;
+        while ((payload = next_frame(conn, &header)) != NULL) {
+            if (header.opcode == OP_CRACK && !flush_output(conn)) {
+                break;
+            }
+            long long startUs = now_us();
+            conn->lane = LATENCY_LANE;
+            keep_frame(conn, &header, payload);
+            do_frame(conn, &header, payload);
+            record_latency(conn, startUs);
+        }
+        open = !conn->protocolError && flush_output(conn) && fill_input(conn);
+    }
+}
+
+/* attach_shm()
+ * ------------
+ * Maps the shared memory ring a local client has created for this
+ * connection.
+ *
+ * conn: The connection the client asked on
+ *
+ * name: The name the client created the ring with
+ *
+ * Returns: true if the ring was mapped, false if it is not a valid ring
+ */
+bool attach_shm(Connection* conn, const char* name) {
+    if (strncmp(name, SHM_NAME_PREFIX, strlen(SHM_NAME_PREFIX)) != 0 ||
+            strchr(name + 1, '/') != NULL) {
+        return false;
+    }
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(ShmRing)) {
+        conn->ring = mmap(NULL, sizeof(ShmRing), PROT_READ | PROT_WRITE,
+                MAP_SHARED, fd, 0);
+        if (conn->ring == MAP_FAILED) {
+            conn->ring = NULL;
+        }
+    }
+    close(fd);
+    return conn->ring != NULL;
+}
+
+/* shm_session()
+ * -------------
+ * Serves a local client through its shared memory ring until it closes its
+ * socket. Requests are text protocol lines and are handled exactly as they
+ * are in text_session(), except that progress reports are not sent.
+ *
+ * conn: The connection to serve, with its ring attached
+ *
+ * Returns: void
+ */
+void shm_session(Connection* conn) {
+    for (unsigned long next = 0; wait_for_request(conn); next++) {
+        ShmSlot* slot = &conn->ring->slots[next % SHM_RING_SLOTS];
+        slot->request[SHM_SLOT_SIZE - 1] = '\0'; // never trust the client
+        snprintf(slot->response, SHM_SLOT_SIZE, "%s",
+                do_text_request(slot->request, conn));
+        sem_post(&conn->ring->responses);
+    }
+}
+
+/* wait_for_request()
+ * ------------------
+ * Waits for the client to post a request to the shared memory ring. The ring
+ * is checked a few times before sleeping on it, and while asleep the socket
+ * is checked now and then in case the client has gone.
+ *
+ * conn: The connection whose ring is to be waited on
+ *
+ * Returns: true once a request is ready, false if the client has closed its
+ *      socket (or sent anything on it, which it must not do)
+ */
+bool wait_for_request(Connection* conn) {
+    for (int i = 0; i < SHM_SPINS; i++) {
+        if (sem_trywait(&conn->ring->requests) == 0) {
+            return true;
+        }
+    }
+    while (true) {
+        struct timespec wake;
+        clock_gettime(CLOCK_REALTIME, &wake);
+        wake.tv_nsec += SHM_POLL_MS * NS_PER_MS;
+        wake.tv_sec += wake.tv_nsec / NS_PER_SEC;
+        wake.tv_nsec %= NS_PER_SEC;
+        if (sem_timedwait(&conn->ring->requests, &wake) == 0) {
+            return true;
+        } else if (errno != ETIMEDOUT && errno != EINTR) {
+            return false;
+        }
+        struct pollfd pollFd = {.fd = conn->fd, .events = POLLIN};
+        if (poll(&pollFd, 1, 0) != 0) {
+            return false;
+        }
+    }
+}
+
+/* next_line()
+ * -----------
+ * Finds the next complete line in the connection's input buffer and null
+ * terminates it in place. Lines that do not fit in the buffer are dropped and
+ * answered as invalid.
+ *
+ * conn: The connection to take the line from
+ *
+ * Returns: A pointer to the line within the input buffer (valid until the
+ *          next call to fill_input()), or NULL if no complete line is buffered
+ */
+char* next_line(Connection* conn) {
+    char* start = conn->in + conn->inStart;
+    char* newLine = memchr(start, '\n', conn->inEnd - conn->inStart);
+    if (newLine == NULL) {
+        return NULL;
+    }
+    *newLine = '\0';
+    conn->inStart = newLine - conn->in + 1;
+    if (conn->discarding) { // tail end of a line that was too long
+        conn->discarding = false;
+        queue_response(conn, INVALID_RESPONSE);
+        return next_line(conn);
+    }
+    return start;
+}
+
+/* next_frame()
+ * ------------
+ * Finds the next complete frame in the connection's input buffer.
+ *
+ * conn: The connection to take the frame from
+ *
+ * header: Filled in with the frame's unpacked header
+ *
+ * Returns: A pointer to the frame's payload within the input buffer (valid
+ *          until the next call to fill_input()), or NULL if no complete frame
+ *          is buffered. Sets protocolError if the frame could never fit.
+ */
+unsigned char* next_frame(Connection* conn, FrameHeader* header) {
+    unsigned char* start = (unsigned char*)conn->in + conn->inStart;
+    size_t available = conn->inEnd - conn->inStart;
+    if (available < FRAME_HEADER_LEN) {
+        return NULL;
+    }
+    unpack_header(start, header);
+    if (header->length > MAX_FRAME_PAYLOAD) {
+        conn->protocolError = true;
+        return NULL;
+    }
+    if (available < FRAME_HEADER_LEN + header->length) {
+        return NULL;
+    }
+    conn->inStart += FRAME_HEADER_LEN + header->length;
+    return start + FRAME_HEADER_LEN;
+}
+
+/* fill_input()
+ * ------------
+ * Blocks until more data is read from the client into the input buffer,
+ * first moving any partial line to the start of the buffer to make space.
+ *
+ * conn: The connection to read for
+ *
+ * Returns: false if the client has closed the connection, true otherwise
+ */
+bool fill_input(Connection* conn) {
+    if (conn->inStart > 0) {
+        memmove(conn->in, conn->in + conn->inStart,
+                conn->inEnd - conn->inStart);
+        conn->inEnd -= conn->inStart;
+        conn->inStart = 0;
+    }
+    // keep one byte spare so a final unterminated line can be terminated
+    if (conn->inEnd == CONN_BUFFER_SIZE - 1) {
+        conn->discarding = true; // line too long, throw away what we have
+        conn->inEnd = 0;
+    }
+    ssize_t numRead;
+    do {
+        numRead = read(conn->fd, conn->in + conn->inEnd,
+                CONN_BUFFER_SIZE - 1 - conn->inEnd);
+    } while (numRead < 0 && errno == EINTR);
+    if (numRead <= 0) {
+        return false;
+    }
+    conn->inEnd += numRead;
+    return true;
+}
+
+/* queue_response()
+ * ----------------
+ * Copies a response, followed by a new line, into the connection's output
+ * buffer to be sent by the next flush_output(). The buffer is flushed early
+ * if it would otherwise overflow.
+ *
+ * conn: The connection to respond on
+ *
+ * response: The response to send, without a trailing new line
+ *
+ * Returns: void
+ */
+void queue_response(Connection* conn, const char* response) {
+    size_t length = strlen(response);
+    if (conn->outLen + length + 1 > CONN_BUFFER_SIZE) {
+        flush_output(conn);
+    }
+    if (length + 1 > CONN_BUFFER_SIZE) { // cannot happen for valid responses
+        response = INVALID_RESPONSE;
+        length = strlen(response);
+    }
+    memcpy(conn->out + conn->outLen, response, length);
+    conn->out[conn->outLen + length] = '\n';
+    conn->outLen += length + 1;
+}
+
+/* queue_frame()
+ * -------------
+ * Copies a response frame into the connection's output buffer to be sent by
+ * the next flush_output(), flushing early if it would otherwise overflow.
+ *
+ * conn: The connection to respond on
+ *
+ * header: The header of the frame, with length set to the payload length
+ *
+ * payload: The payload of the frame
+ *
+ * Returns: void
+ */
+void queue_frame(Connection* conn, const FrameHeader* header,
+        const char* payload) {
+    if (conn->outLen + FRAME_HEADER_LEN + header->length > CONN_BUFFER_SIZE) {
+        flush_output(conn);
+    }
+    pack_header((unsigned char*)conn->out + conn->outLen, header);
+    memcpy(conn->out + conn->outLen + FRAME_HEADER_LEN, payload,
+            header->length);
+    conn->outLen += FRAME_HEADER_LEN + header->length;
+}
+
+/* flush_output()
+ * --------------
+ * Sends every queued response to the client.
+ *
+ * conn: The connection to flush
+ *
+ * Returns: false if the client can no longer be written to, true otherwise
+ */
+bool flush_output(Connection* conn) {
+    size_t sent = 0;
+    while (sent < conn->outLen) {
+        // MSG_NOSIGNAL so a vanished client cannot SIGPIPE the whole server
+        ssize_t numSent = send(conn->fd, conn->out + sent,
+                conn->outLen - sent, MSG_NOSIGNAL);
+        if (numSent < 0 && errno == EINTR) {
+            continue;
+        } else if (numSent <= 0) {
+            conn->outLen = 0;
+            return false;
+        }
+        sent += numSent;
+    }
+    conn->outLen = 0;
+    return true;
+}
+
+/* num_places()
+ * ------------
+ * A recursive function to calculate the number of decimal places a value takes
+ *
+ * n: the input number to see how many places it takes up
+ *
+ * Returns: The number of places taken by the number
+ */
+int num_places(int n) {
+    if (n < 10) {
+        return 1;
+    } else {
+        return 1 + num_places(n / 10);
+    }
+}
+
+/* split_command()
+ * ---------------
+ * Splits a command into its space separated arguments in place. The final
+ * argument holds the rest of the line if there are more than
+ * MAX_REQUEST_FIELDS arguments.
+ *
+ * command: The command to be split, modified in place
+ *
+ * arguments: An array of at least MAX_REQUEST_FIELDS + 1 pointers which is
+ *          filled with the arguments followed by NULLs
+ *
+ * Returns: The number of arguments found
+ */
+int split_command(char* command, char** arguments) {
+    int numArgs = 1;
+    arguments[0] = command;
+    while (numArgs < MAX_REQUEST_FIELDS &&
+            (command = strchr(command, ' ')) != NULL) {
+        *command++ = '\0';
+        arguments[numArgs++] = command;
+    }
+    for (int i = numArgs; i <= MAX_REQUEST_FIELDS; i++) {
+        arguments[i] = NULL;
+    }
+    return numArgs;
+}
+
+/* do_command()
+ * ------------
+ * A method to be called by the client thread which handles the incoming
  * command and acts appropriately.
  *
- * command: The line of input received from the client.
+ * command: The line of input received from the client, modified in place.
  *
- * dict: The server dictionary to use for crack
+ * conn: The connection the command arrived on
  *
- * Returns: The response to send back to the client
+ * Returns: The response to send back to the client, without a new line. Only
+ *          valid until the next command on this connection.
  * Errors: If any subsequent calls error
  */
-char* do_command(char* command, Dictionary dict) {
-    char** arguments = split_by_char(command, ' ', MAX_COMMAND_ARGS);
-    char* result;
+const char* do_command(char* command, Connection* conn) {
+    arena_reset(&conn->arena); // the previous response has been queued
+    next_request_id(conn);
+    char* arguments[MAX_REQUEST_FIELDS + 1];
+    int numArgs = split_command(command, arguments);
     if (arguments[2] == NULL ) { // less than 2 commands found
-        return ":invalid\n";
+        return INVALID_RESPONSE;
     }
     if (strcmp(arguments[0], "crack") == 0) {
         // checking num threads is a valid number and that the number is not a
         // greater order of magnitude
         if (strlen(arguments[2]) > num_places(MAX_THREADS)||
                 !is_digits(arguments[2])) {
-            return ":invalid\n";
+            return INVALID_RESPONSE;
         }
-        int crackThreads = atoi(arguments[2]);
-        if (crackThreads > MAX_THREADS || crackThreads <= 0) {
-            return ":invalid\n"; // invalid value for num threads
+        CrackRequest request = {.encrypted = arguments[1],
+                .numThreads = atoi(arguments[2]), .start = 0,
+                .end = conn->server->engine->dict.numWords,
+                .cancelFd = conn->fd,
+                .onProgress = text_progress, .progressContext = conn,
+                .arena = &conn->arena};
+        for (int i = MAX_COMMAND_ARGS; i < numArgs; i++) {
+            if (!parse_crack_option(arguments[i], &request)) {
+                return INVALID_RESPONSE;
+            }
         }
-        return crack(arguments[1], crackThreads, dict);
+        return do_crack(&request, conn);
     } else if (strcmp(arguments[0], "crypt") == 0) {
-        if (strlen(arguments[2]) != 2) {
-            return ":invalid\n"; // invalid salt length
-        } else if (strspn(arguments[2], PLAINTEXT_CHARS) != 2) {
-            return ":invalid\n"; // salt not exclusively plaintext
+        if (numArgs != MAX_COMMAND_ARGS) {
+            return INVALID_RESPONSE;
+        }
+        return do_crypt(arguments[1], arguments[2], conn);
+    }
+    return INVALID_RESPONSE; // not a valid command
+}
+
+/* parse_crack_option()
+ * --------------------
+ * Applies one of the optional trailing options of a crack request:
+ *      range=start-end limits the crack to dictionary indices start
+ *              (inclusive) to end (exclusive), which is how a coordinator
+ *              hands out work to its workers
+ *      timeout=ms      gives the crack a deadline
+ *      progress=ms     asks for progress lines every ms milliseconds
+ *      profile         asks for a profile line before the result
+ *      eta             asks for an estimate of how long the sweep will take
+ *
+ * option: The option field from the request, modified in place
+ *
+ * request: The request to apply the option to
+ *
+ * Returns: false if the option is not valid, true otherwise
+ */
+bool parse_crack_option(char* option, CrackRequest* request) {
+    if (strcmp(option, PROFILE_OPTION) == 0) {
+        request->onProfile = text_profile;
+        return true;
+    } else if (strcmp(option, ETA_OPTION) == 0) {
+        request->onEta = text_eta;
+        return true;
+    } else if (strncmp(option, TIMEOUT_OPTION, strlen(TIMEOUT_OPTION)) == 0) {
+        return parse_number(option + strlen(TIMEOUT_OPTION),
+                &request->timeoutMs) && request->timeoutMs > 0;
+    } else if (strncmp(option, PROGRESS_OPTION, strlen(PROGRESS_OPTION))
+            == 0) {
+        return parse_number(option + strlen(PROGRESS_OPTION),
+                &request->progressMs) && request->progressMs > 0;
+    } else if (strncmp(option, RANGE_OPTION, strlen(RANGE_OPTION)) != 0) {
+        return false;
+    }
+    char* start = option + strlen(RANGE_OPTION);
+    char* end = strchr(start, '-');
+    if (end == NULL) {
+        return false;
+    }
+    *end++ = '\0';
+    int rangeStart, rangeEnd;
+    if (!parse_number(start, &rangeStart) || !parse_number(end, &rangeEnd) ||
+            rangeStart >= rangeEnd || rangeEnd > request->end) {
+        return false;
+    }
+    request->start = rangeStart;
+    request->end = rangeEnd;
+    return true;
+}
+
+/* parse_number()
+ * --------------
+ * Converts the value of a numeric option, making sure it is entirely digits
+ * and short enough that atoi cannot overflow.
+ *
+ * value: The string to be converted
+ *
+ * number: Where to store the result
+ *
+ * Returns: false if the value is not a valid number, true otherwise
+ */
+bool parse_number(const char* value, int* number) {
+    if (strlen(value) > MAX_OPTION_DIGITS || !is_digits((char*)value)) {
+        return false;
+    }
+    *number = atoi(value);
+    return true;
+}
+
+/* text_progress()
+ * ---------------
+ * Progress callback for cracks on text connections. Sends a progress line to
+ * the client straight away.
+ *
+ * context: The Connection the crack request arrived on
+ *
+ * tested: The number of words tested so far
+ *
+ * total: The number of words to be tested
+ *
+ * Returns: void
+ */
+void text_progress(void* context, long tested, long total) {
+    Connection* conn = (Connection*)context;
+    if (conn->ring != NULL) {
+        return; // a ring slot only has room for the final response
+    }
+    char line[sizeof(PROGRESS_RESPONSE) + 2 * 20 + 2];
+    snprintf(line, sizeof(line), "%s %ld/%ld", PROGRESS_RESPONSE, tested,
+            total);
+    queue_response(conn, line);
+    flush_output(conn);
+}
+
+/* binary_progress()
+ * -----------------
+ * Progress callback for cracks on binary connections. Sends an OP_PROGRESS
+ * frame, with the request's ID, to the client straight away.
+ *
+ * context: The Connection the crack request arrived on, whose currentId is
+ *      the request's ID
+ *
+ * tested: The number of words tested so far
+ *
+ * total: The number of words to be tested
+ *
+ * Returns: void
+ */
+void binary_progress(void* context, long tested, long total) {
+    Connection* conn = (Connection*)context;
+    uint32_t counts[2] = {htonl(tested), htonl(total)};
+    FrameHeader header = {.opcode = OP_PROGRESS, .flags = 0,
+            .length = sizeof(counts), .requestId = conn->currentId};
+    queue_frame(conn, &header, (const char*)counts);
+    flush_output(conn);
+}
+
+/* text_profile()
+ * --------------
+ * Profile callback for cracks on text connections. Queues the profile line,
+ * to go out with the result which follows it.
+ *
+ * context: The Connection the crack request arrived on
+ *
+ * profile: The formatted profile, see send_profile()
+ *
+ * Returns: void
+ */
+void text_profile(void* context, const char* profile) {
+    Connection* conn = (Connection*)context;
+    if (conn->ring != NULL) {
+        return; // a ring slot only has room for the final response
+    }
+    char line[sizeof(PROFILE_RESPONSE) + PROFILE_LEN];
+    snprintf(line, sizeof(line), "%s %s", PROFILE_RESPONSE, profile);
+    queue_response(conn, line);
+}
+
+/* text_eta()
+ * ----------
+ * ETA callback for cracks on text connections. Sends the estimate to the
+ * client straight away, since the sweep it is for may take a while.
+ *
+ * context: The Connection the crack request arrived on
+ *
+ * etaMs: How long the sweep is expected to take, in milliseconds
+ *
+ * Returns: void
+ */
+void text_eta(void* context, long long etaMs) {
+    Connection* conn = (Connection*)context;
+    if (conn->ring != NULL) {
+        return; // a ring slot only has room for the final response
+    }
+    char line[sizeof(ETA_RESPONSE) + 20 + 1];
+    snprintf(line, sizeof(line), "%s %lld", ETA_RESPONSE, etaMs);
+    queue_response(conn, line);
+    flush_output(conn);
+}
+
+/* binary_profile()
+ * ----------------
+ * Profile callback for cracks on binary connections. Queues an OP_PROFILE
+ * frame, with the request's ID, to go out with the result which follows it.
+ *
+ * context: The Connection the crack request arrived on, whose currentId is
+ *      the request's ID
+ *
+ * profile: The formatted profile, see send_profile()
+ *
+ * Returns: void
+ */
+void binary_profile(void* context, const char* profile) {
+    Connection* conn = (Connection*)context;
+    FrameHeader header = {.opcode = OP_PROFILE, .flags = 0,
+            .length = strlen(profile), .requestId = conn->currentId};
+    queue_frame(conn, &header, profile);
+}
+
+/* do_frame()
+ * ----------
+ * The binary protocol equivalent of do_command(). Decodes a request frame,
+ * carries it out and queues the response frame on the connection.
+ *
+ * conn: The connection the request arrived on
+ *
+ * header: The request frame's header
+ *
+ * payload: The request frame's payload
+ *
+ * Returns: void
+ */
+void do_frame(Connection* conn, const FrameHeader* header,
+        const unsigned char* payload) {
+    arena_reset(&conn->arena); // the previous response has been queued
+    next_request_id(conn);
+    // the payload is not null terminated, so copy the strings out of it
+    char key[MAX_FRAME_PAYLOAD + 1];
+    char setting[UINT8_MAX + 1];
+    const char* response = INVALID_RESPONSE;
+    RequestFields fields;
+    if (!unpack_request(header, payload, &fields)) {
+        // answered as invalid
+    } else if (header->opcode == OP_CRACK) {
+        memcpy(key, fields.setting, fields.settingLength);
+        key[fields.settingLength] = '\0';
+        CrackRequest request = {.encrypted = key, .numThreads = payload[0],
+                .start = 0, .end = conn->server->engine->dict.numWords,
+                .cancelFd = conn->fd, .onProgress = binary_progress,
+                .progressContext = conn, .arena = &conn->arena};
+        if (fields.restLength == CRACK_OPTIONS_LEN) {
+            uint32_t options[2];
+            memcpy(options, fields.rest, sizeof(options));
+            request.timeoutMs = ntohl(options[0]);
+            request.progressMs = ntohl(options[1]);
+        }
+        if (header->flags & PROFILE_FLAG) {
+            request.onProfile = binary_profile;
+        }
+        conn->currentId = header->requestId;
+        response = do_crack(&request, conn);
+    } else {
+        memcpy(setting, fields.setting, fields.settingLength);
+        setting[fields.settingLength] = '\0';
+        memcpy(key, fields.rest, fields.restLength);
+        key[fields.restLength] = '\0';
+        response = do_crypt(key, setting, conn);
+    }
+
+    FrameHeader reply = {.opcode = OP_RESULT, .flags = 0, .length = 0,
+            .requestId = header->requestId};
+    if (strcmp(response, INVALID_RESPONSE) == 0) {
+        reply.opcode = OP_INVALID;
+    } else if (strcmp(response, FAILED_RESPONSE) == 0) {
+        reply.opcode = OP_FAILED;
+    } else if (strcmp(response, TIMEOUT_RESPONSE) == 0) {
+        reply.opcode = OP_TIMEOUT;
+    } else {
+        reply.length = strlen(response);
+    }
+    queue_frame(conn, &reply, response);
+}
+
+/* do_crack()
+ * ----------
+ * Validates the hash and thread count of a crack request and carries it out,
+ * sharing it between the workers if this server is a coordinator. Shared by
+ * both protocols once they have decoded the request. Hashes in the pot file
+ * are answered from it, and anything newly cracked is added to it. Hashes
+ * with a salt table are answered from that instead of a sweep, and those
+ * ruled out by their salt's Bloom filter fail without one. Whole dictionary
+ * cracks which fail are then tried in the rainbow tables.
+ *
+ * request: The decoded crack request
+ *
+ * conn: The connection the request arrived on
+ *
+ * Returns: The response to send back to the client, see crack()
+ */
+const char* do_crack(CrackRequest* request, Connection* conn) {
+    if (request->numThreads > MAX_THREADS || request->numThreads <= 0 ||
+            request->timeoutMs < 0 || request->progressMs < 0) {
+        return INVALID_RESPONSE; // invalid value for num threads or options
+    }
+    request->requestId = conn->requestId;
+    if (request->onProfile != NULL) {
+        request->profile = arena_alloc(&conn->arena, sizeof(CrackProfile));
+        memset(request->profile, 0, sizeof(CrackProfile));
+    }
+    if (!engine_parse_hash(request->encrypted, &request->info)) {
+        send_profile(request, conn);
+        return INVALID_RESPONSE;
+    }
+    char* known = arena_alloc(&conn->arena, POT_WORD_LEN + 1);
+    if (conn->server->pot && strlen(request->encrypted) == CRYPT_LEN &&
+            potfile_lookup(conn->server->pot, request->encrypted, known)) {
+        log_event(LOG_DEBUG, request->requestId, -1, "crack %s: pot file",
+                request->encrypted);
+        send_profile(request, conn);
+        return known; // no sweep needed, so it stays in the latency lane
+    }
+    const char* result = table_crack(request, conn);
+    if (result == NULL && bloom_rules_out(request, conn->server)) {
+        result = FAILED_RESPONSE; // no sweep needed, so no lane change either
+    }
+    if (result == NULL) { // no table, so it needs a sweep
+        conn->lane = THROUGHPUT_LANE;
+        __atomic_add_fetch(&conn->server->activeSweeps, 1, __ATOMIC_RELAXED);
+        // a range means we are already somebody's worker, so do it ourselves
+        if (conn->server->numWorkers > 0 && request->start == 0 &&
+                request->end == conn->server->engine->dict.numWords) {
+            result = coordinate_crack(request, conn);
         } else {
-            struct crypt_data data;
-            return crypt_r(arguments[1], arguments[2], &data);
+            result = local_crack(request, conn);
+        }
+        __atomic_sub_fetch(&conn->server->activeSweeps, 1, __ATOMIC_RELAXED);
+    }
+    bool wholeDict = request->start == 0 &&
+            request->end == conn->server->engine->dict.numWords;
+    if (strcmp(result, FAILED_RESPONSE) == 0 && wholeDict &&
+            conn->server->rainbow.numTables > 0) {
+        char* plaintext = arena_alloc(&conn->arena, RAINBOW_MAX_LEN + 1);
+        if (rainbow_lookup(&conn->server->rainbow, request->encrypted,
+                plaintext, &conn->cryptData)) {
+            log_event(LOG_DEBUG, request->requestId, -1,
+                    "crack %s: rainbow table", request->encrypted);
+            result = plaintext;
+        }
+    }
+    if (conn->server->pot && result[0] != ':') {
+        potfile_add(conn->server->pot, request->encrypted, result);
+    }
+    send_profile(request, conn);
+    return result;
+}
+
+/* send_profile()
+ * --------------
+ * Reports a crack's profile to the client, if it asked for one, as
+ *      tested=N threads=T wait=Wus spawn=Sus compute=Cus rates=R1,R2,...
+ * where wait is the time from the request starting to be handled until its
+ * sweep began, and the rest are as in CrackProfile. A crack answered without
+ * a sweep by this server, say from the pot file, has no threads, and its wait
+ * is the whole time it took.
+ *
+ * request: The crack request, which has finished
+ *
+ * conn: The connection the request arrived on
+ *
+ * Returns: void
+ */
+void send_profile(CrackRequest* request, Connection* conn) {
+    CrackProfile* profile = request->profile;
+    if (profile == NULL) {
+        return;
+    }
+    long long waitUs = (profile->numThreads > 0 ? profile->startUs :
+            now_us()) - conn->requestStartUs;
+    char* line = arena_alloc(&conn->arena, PROFILE_LEN);
+    int length = snprintf(line, PROFILE_LEN,
+            "tested=%ld threads=%d wait=%lldus spawn=%lldus compute=%lldus "
+            "rates=", profile->tested, profile->numThreads, waitUs,
+            profile->spawnUs, profile->computeUs);
+    for (int i = 0; i < profile->numThreads; i++) {
+        length += snprintf(line + length, PROFILE_LEN - length, "%s%ld",
+                i > 0 ? "," : "", profile->rates[i]);
+    }
+    request->onProfile(request->progressContext, line);
+}
+
+/* bloom_rules_out()
+ * -----------------
+ * Checks a whole dictionary crack against the Bloom filter for its salt, if
+ * there is one yet, to see whether a sweep could possibly find it.
+ *
+ * request: The validated crack request
+ *
+ * server: The server, with its Bloom filters
+ *
+ * Returns: true if the hash is not in the filter, so the crack will fail
+ */
+bool bloom_rules_out(CrackRequest* request, ServerParams* server) {
+    int salt = salt_index(request->encrypted);
+    if (server->bloomRate <= 0 || request->start != 0 ||
+            request->end != server->engine->dict.numWords || salt < 0) {
+        return false;
+    }
+    BloomFilter* known = __atomic_load_n(&server->blooms[salt],
+            __ATOMIC_ACQUIRE);
+    if (known == NULL || bloom_contains(known,
+            request->encrypted + SALT_LENGTH)) {
+        return false;
+    }
+    __atomic_add_fetch(&server->sweepsAvoided, 1, __ATOMIC_RELAXED);
+    log_event(LOG_DEBUG, request->requestId, -1,
+            "crack %s: not in Bloom filter", request->encrypted);
+    return true;
+}
+
+/* local_crack()
+ * -------------
+ * Carries out a crack on this server, once bloom_rules_out() has not ruled
+ * it out. If a whole dictionary crack's salt has no Bloom filter yet, one is
+ * filled in by the sweep, and kept if the sweep tests every word. The sweep
+ * is then scheduled by its cost.
+ *
+ * request: The validated crack request
+ *
+ * conn: The connection the request arrived on
+ *
+ * Returns: The result of cracking the password, as for crack()
+ */
+const char* local_crack(CrackRequest* request, Connection* conn) {
+    ServerParams* server = conn->server;
+    int salt = salt_index(request->encrypted);
+    bool wholeDict = request->start == 0 && request->end ==
+            server->engine->dict.numWords;
+    request->bloom = NULL;
+    if (server->bloomRate > 0 && wholeDict && salt >= 0 &&
+            __atomic_load_n(&server->blooms[salt], __ATOMIC_ACQUIRE) == NULL) {
+        request->bloom = reserve_bloom(server);
+    }
+
+    schedule_crack(request, server);
+    long long startUs = now_us();
+    const char* result = crack(request, server->engine);
+    long long sweepUs = now_us() - startUs;
+    __atomic_add_fetch(&server->hashes, request->tested, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&server->hashUs, sweepUs, __ATOMIC_RELAXED);
+    finish_sweep(request, server, sweepUs);
+    log_event(LOG_DEBUG, request->requestId, sweepUs,
+            "crack %s: swept %ld words with %d threads, %s",
+            request->encrypted, request->tested, request->numThreads,
+            result[0] == ':' ? result + 1 : "found");
+
+    if (request->bloom != NULL) {
+        BloomFilter* none = NULL;
+        // keep it only if it has every word, and nobody beat us to it
+        if (request->tested != server->engine->dict.numWords ||
+                !__atomic_compare_exchange_n(&server->blooms[salt], &none,
+                request->bloom, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            __atomic_sub_fetch(&server->bloomUsed, bloom_size(
+                    server->engine->dict.numWords, server->bloomRate),
+                    __ATOMIC_RELAXED);
+            free(request->bloom);
         }
-    } else { // not a valid command
-        result = ":invalid\n";
     }
     return result;
 }
 
+/* schedule_crack()
+ * ----------------
+ * Sizes a sweep by its cost. A heavy crack takes its threads from the heavy
+ * crack budget, as many as it asked for that are free but always at least
+ * one, and runs at HEAVY_NICE. The time the sweep will take is then
+ * estimated from the measured hash rate and sent, if the client asked.
+ *
+ * request: The validated crack request, which is updated
+ *
+ * server: The server parameters
+ *
+ * Returns: void
+ */
+void schedule_crack(CrackRequest* request, ServerParams* server) {
+    request->nice = 0;
+    request->heavyThreads = 0;
+    if (request->info.cost >= HEAVY_COST) {
+        int free = __atomic_load_n(&server->heavyFree, __ATOMIC_RELAXED);
+        int taken;
+        do {
+            taken = free < request->numThreads ? free : request->numThreads;
+        } while (taken > 0 && !__atomic_compare_exchange_n(&server->heavyFree,
+                &free, free - taken, false, __ATOMIC_RELAXED,
+                __ATOMIC_RELAXED));
+        request->heavyThreads = taken;
+        request->numThreads = taken > 0 ? taken : 1; // slowed, never refused
+        request->nice = HEAVY_NICE;
+        __atomic_add_fetch(&server->heavyCracks, 1, __ATOMIC_RELAXED);
+    }
+    long long desHashes = __atomic_load_n(&server->desHashes,
+            __ATOMIC_RELAXED);
+    long long threadUs = __atomic_load_n(&server->threadUs, __ATOMIC_RELAXED);
+    double rate = threadUs > 0 ? (double)desHashes * US_PER_SEC / threadUs :
+            DEFAULT_HASH_RATE;
+    int cores = CPU_COUNT(&server->throughputCpus);
+    int threads = request->numThreads < cores ? request->numThreads : cores;
+    long long etaMs = (double)(request->end - request->start) *
+            request->info.cost * MS_PER_SEC / (rate * threads);
+    log_event(LOG_DEBUG, request->requestId, -1,
+            "crack %s: %s, cost %ld, %d threads, eta %lld ms",
+            request->encrypted, engine_scheme_name(request->info.scheme),
+            request->info.cost, request->numThreads, etaMs);
+    if (request->onEta != NULL) {
+        request->onEta(request->progressContext, etaMs);
+    }
+}
+
+/* finish_sweep()
+ * --------------
+ * Adds a finished sweep to the measured hash rate, and gives back any
+ * threads it took from the heavy crack budget.
+ *
+ * request: The crack request, whose sweep has finished
+ *
+ * server: The server parameters
+ *
+ * sweepUs: How long the sweep took
+ *
+ * Returns: void
+ */
+void finish_sweep(CrackRequest* request, ServerParams* server,
+        long long sweepUs) {
+    if (request->heavyThreads > 0) {
+        __atomic_add_fetch(&server->heavyFree, request->heavyThreads,
+                __ATOMIC_RELAXED);
+    }
+    int cores = CPU_COUNT(&server->throughputCpus);
+    int threads = request->numThreads < cores ? request->numThreads : cores;
+    if (request->tested > 0 && sweepUs > 0) {
+        __atomic_add_fetch(&server->desHashes,
+                (long long)request->tested * request->info.cost,
+                __ATOMIC_RELAXED);
+        __atomic_add_fetch(&server->threadUs, sweepUs * threads,
+                __ATOMIC_RELAXED);
+    }
+}
+
+/* salt_index()
+ * ------------
+ * Numbers the salt of a hash, for indexing the Bloom filters.
+ *
+ * encrypted: The hash
+ *
+ * Returns: A number less than NUM_SALTS, or -1 if the salt is not valid
+ */
+int salt_index(const char* encrypted) {
+    int index = 0;
+    for (int i = 0; i < SALT_LENGTH; i++) {
+        const char* position = strchr(PLAINTEXT_CHARS, encrypted[i]);
+        if (encrypted[i] == '\0' || position == NULL) {
+            return -1;
+        }
+        index = index * strlen(PLAINTEXT_CHARS) + (position - PLAINTEXT_CHARS);
+    }
+    return index;
+}
+
+/* reserve_bloom()
+ * ---------------
+ * Makes a new, empty Bloom filter for the dictionary, if there is room left
+ * in the budget for it.
+ *
+ * server: The server parameters, containing the budget
+ *
+ * Returns: The filter, or NULL if it would go over the budget
+ */
+BloomFilter* reserve_bloom(ServerParams* server) {
+    size_t size = bloom_size(server->engine->dict.numWords, server->bloomRate);
+    if (__atomic_add_fetch(&server->bloomUsed, size, __ATOMIC_RELAXED) >
+            server->bloomBudget) {
+        __atomic_sub_fetch(&server->bloomUsed, size, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    BloomFilter* filter = bloom_create(server->engine->dict.numWords,
+            server->bloomRate);
+    if (filter == NULL) {
+        __atomic_sub_fetch(&server->bloomUsed, size, __ATOMIC_RELAXED);
+    }
+    return filter;
+}
+
+/* table_crack()
+ * -------------
+ * Answers a crack from the salt table for its salt, if there is one, and
+ * counts the request towards its salt's popularity when precomputing.
+ *
+ * request: The validated crack request
+ *
+ * conn: The connection the request arrived on
+ *
+ * Returns: The word, or :failed if no word in the request's range has the
+ *      hash, or NULL if there is no table for the salt
+ */
+const char* table_crack(CrackRequest* request, Connection* conn) {
+    ServerParams* server = conn->server;
+    int salt = salt_index(request->encrypted);
+    if (!server->precomputeDir || salt < 0 ||
+            strlen(request->encrypted) != CRYPT_LEN) {
+        return NULL;
+    }
+    __atomic_add_fetch(&server->saltRequests[salt], 1, __ATOMIC_RELAXED);
+    SaltTable* table = __atomic_load_n(&server->saltTables[salt],
+            __ATOMIC_ACQUIRE);
+    if (table == NULL) {
+        return NULL;
+    }
+    __atomic_add_fetch(&server->tableLookups, 1, __ATOMIC_RELAXED);
+    int word = salt_table_lookup(table, request->encrypted + SALT_LENGTH);
+    log_event(LOG_DEBUG, request->requestId, -1, "crack %s: salt table",
+            request->encrypted);
+    return word >= request->start && word < request->end ?
+            server->engine->dict.words[word] : FAILED_RESPONSE;
+}
+
+/* load_salt_tables()
+ * ------------------
+ * Loads the salt tables and request counts kept in the --precompute
+ * directory. Tables made from another dictionary, or which would go over the
+ * budget, are left out.
+ *
+ * params: The server parameters, containing the directory and dictionary
+ *
+ * Returns: false if the directory is not a directory that can be written to
+ */
+bool load_salt_tables(ServerParams* params) {
+    struct stat info;
+    if (stat(params->precomputeDir, &info) != 0 || !S_ISDIR(info.st_mode) ||
+            access(params->precomputeDir, W_OK | X_OK) != 0) {
+        return false;
+    }
+    Dictionary* dict = &params->engine->dict;
+    params->dictHash = salt_table_fingerprint(dict->words, dict->numWords);
+    char* path = malloc(strlen(params->precomputeDir) +
+            sizeof(SALT_TABLE_FILE) + MAX_OPTION_DIGITS);
+    for (int i = 0; i < NUM_SALTS; i++) {
+        sprintf(path, SALT_TABLE_FILE, params->precomputeDir, i);
+        SaltTable* table = salt_table_load(path, params->dictHash,
+                dict->numWords);
+        if (table != NULL && params->precomputeUsed + table->size <=
+                params->precomputeBudget) {
+            params->precomputeUsed += table->size;
+            params->saltTables[i] = table;
+        } else if (table != NULL) {
+            salt_table_free(table);
+        }
+    }
+    sprintf(path, SALT_COUNTS_FILE, params->precomputeDir);
+    FILE* counts = fopen(path, "r");
+    if (counts != NULL) {
+        if (fread(params->saltRequests, sizeof(params->saltRequests), 1,
+                counts) != 1) {
+            memset(params->saltRequests, 0, sizeof(params->saltRequests));
+        }
+        fclose(counts);
+    }
+    free(path);
+    return true;
+}
+
+/* save_salt_counts()
+ * ------------------
+ * Saves how many crack requests there have been for each salt to the
+ * --precompute directory, so they are not forgotten on a restart.
+ *
+ * params: The server parameters, containing the counts
+ *
+ * Returns: void
+ */
+void save_salt_counts(ServerParams* params) {
+    static pthread_mutex_t saving = PTHREAD_MUTEX_INITIALIZER;
+    uint32_t counts[NUM_SALTS];
+    for (int i = 0; i < NUM_SALTS; i++) {
+        counts[i] = __atomic_load_n(&params->saltRequests[i],
+                __ATOMIC_RELAXED);
+    }
+    char* path = malloc(strlen(params->precomputeDir) +
+            sizeof(SALT_COUNTS_FILE));
+    sprintf(path, SALT_COUNTS_FILE, params->precomputeDir);
+    pthread_mutex_lock(&saving); // SIGHUP may save at the same time
+    FILE* file = fopen(path, "w");
+    if (file != NULL) {
+        fwrite(counts, sizeof(counts), 1, file);
+        fclose(file);
+    }
+    pthread_mutex_unlock(&saving);
+    free(path);
+}
+
+/* precompute_thread()
+ * -------------------
+ * The thread which makes salt tables while the server is idle, at idle
+ * priority on the throughput lane's cores. A table is made PRECOMPUTE_CHUNK
+ * words at a time, checking between each that nothing else has come in. If
+ * something has, the table is put aside until the server has been idle for
+ * PRECOMPUTE_IDLE_MS again. Each finished table is saved and then used for
+ * any crack with its salt.
+ *
+ * arg: The ServerParams of the server
+ *
+ * Returns: void* (never returns)
+ */
+void* precompute_thread(void* arg) {
+    ServerParams* params = (ServerParams*)arg;
+    struct sched_param priority = {.sched_priority = 0};
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &priority);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
+            &params->throughputCpus);
+    Dictionary* dict = &params->engine->dict;
+    struct crypt_data* cryptData = malloc(sizeof(struct crypt_data));
+    cryptData->initialized = 0;
+    char* path = malloc(strlen(params->precomputeDir) +
+            sizeof(SALT_TABLE_FILE) + MAX_OPTION_DIGITS);
+    struct timespec idle = {.tv_sec = PRECOMPUTE_IDLE_MS / 1000,
+            .tv_nsec = PRECOMPUTE_IDLE_MS % 1000 * NS_PER_MS};
+    uint64_t seenRequests = 0;
+    long long savedUs = now_us();
+    SaltTable* table = NULL;
+    int salt = -1;
+    long long startUs = 0;
+    while (true) {
+        nanosleep(&idle, NULL);
+        if (!server_idle(params, &seenRequests)) {
+            continue;
+        }
+        if (now_us() - savedUs >= PRECOMPUTE_SAVE_SECS * US_PER_SEC) {
+            save_salt_counts(params);
+            savedUs = now_us();
+        }
+        if (table == NULL) {
+            salt = popular_salt(params);
+            if (salt < 0) {
+                continue;
+            }
+            char saltText[SALT_LENGTH + 1] = {PLAINTEXT_CHARS[salt /
+                    strlen(PLAINTEXT_CHARS)], PLAINTEXT_CHARS[salt %
+                    strlen(PLAINTEXT_CHARS)], '\0'};
+            table = salt_table_create(saltText, params->dictHash,
+                    dict->numWords);
+            if (table == NULL) {
+                continue;
+            }
+            startUs = now_us();
+        }
+        bool finished = false;
+        while (!finished && server_idle(params, &seenRequests)) {
+            finished = salt_table_fill(table, dict->words, PRECOMPUTE_CHUNK,
+                    cryptData) == 0;
+        }
+        if (!finished) {
+            continue; // somebody needs the server, so leave it for now
+        }
+        salt_table_finish(table);
+        sprintf(path, SALT_TABLE_FILE, params->precomputeDir, salt);
+        bool saved = salt_table_save(table, path);
+        log_event(saved ? LOG_INFO : LOG_WARN, 0, now_us() - startUs,
+                "salt %s table %s", table->header->salt,
+                saved ? "made" : "made but not saved");
+        __atomic_add_fetch(&params->precomputeUsed, table->size,
+                __ATOMIC_RELAXED);
+        __atomic_store_n(&params->saltTables[salt], table, __ATOMIC_RELEASE);
+        table = NULL;
+        save_salt_counts(params);
+        savedUs = now_us();
+    }
+    return NULL;
+}
+
+/* server_idle()
+ * -------------
+ * Checks whether the server has had no new requests since it was last
+ * checked and has no sweeps running.
+ *
+ * params: The server parameters
+ *
+ * seenRequests: The number of requests there had been when last checked,
+ *      which is updated
+ *
+ * Returns: true if the server is idle
+ */
+bool server_idle(ServerParams* params, uint64_t* seenRequests) {
+    uint64_t requests = __atomic_load_n(&params->numRequests,
+            __ATOMIC_RELAXED);
+    bool idle = requests == *seenRequests &&
+            __atomic_load_n(&params->activeSweeps, __ATOMIC_RELAXED) == 0;
+    *seenRequests = requests;
+    return idle;
+}
+
+/* popular_salt()
+ * --------------
+ * Finds the most requested salt which has no table yet, if there is room in
+ * the budget for another table.
+ *
+ * params: The server parameters, containing the counts and tables
+ *
+ * Returns: The salt number, or -1 if there is nothing worth making
+ */
+int popular_salt(ServerParams* params) {
+    if (params->precomputeUsed + salt_table_size(
+            params->engine->dict.numWords) > params->precomputeBudget) {
+        return -1;
+    }
+    int best = -1;
+    uint32_t bestCount = 0;
+    for (int i = 0; i < NUM_SALTS; i++) {
+        uint32_t count = __atomic_load_n(&params->saltRequests[i],
+                __ATOMIC_RELAXED);
+        if (count > bestCount && params->saltTables[i] == NULL) {
+            best = i;
+            bestCount = count;
+        }
+    }
+    return best;
+}
+
+/* do_crypt()
+ * ----------
+ * Validates the salt of a crypt request and carries it out. Shared by both
+ * protocols once they have decoded the request.
+ *
+ * key: The plain text to be encrypted
+ *
+ * salt: The SALT_LENGTH character salt, or modular crypt setting (starting
+ *      with '$'), to encrypt with
+ *
+ * conn: The connection the request arrived on, whose crypt_r state the result
+ *      is written into
+ *
+ * Returns: The encrypted text or INVALID_RESPONSE
+ */
+const char* do_crypt(const char* key, const char* salt, Connection* conn) {
+    if (salt[0] != '$' && strlen(salt) != SALT_LENGTH) {
+        return INVALID_RESPONSE; // invalid salt length
+    }
+    const char* encrypted = engine_crypt(key, salt, &conn->cryptData);
+    return encrypted != NULL ? encrypted : INVALID_RESPONSE;
+}
+
 /* crack()
  * -------
- * A method which implements the brute force cracking technique in a
- * multithreaded way.
+ * Runs a crack request as a job on the crack engine. While the job's threads
+ * run, the client's connection is watched so that the crack is abandoned if
+ * the client resets it (which is how a coordinator cancels the rest of a
+ * crack once one worker finds it). The same wait also enforces the request's
+ * deadline and reports its progress.
  *
- * encrypted: The value we are checking each encryption against to see if we
- *          have found our word
- * 
- * numThreads: The number of threads to be created for cracking, specified by
- *          client
+ * request: The crack request, containing the value we are checking each
+ *          encryption against to see if we have found our word, the number of
+ *          threads to be created for cracking (specified by client) and the
+ *          range of the dictionary to be searched
+ *
+ * engine: The engine to run the job on
  * 
  * Returns: The result of cracking the password:
  *              :invalid if the command is found to be invalid
  *              :failed if the encryption cannot be found in our dictionary
+ *              :timeout if the deadline passed before the word was found
  *              else, the word which correlates to the given encryption
- * Errors: Potential malloc errors
  */
-char* crack(char* encrypted, int numThreads, Dictionary dict) {
-    if (strlen(encrypted) != CRYPT_LEN) {
-        return ":invalid\n"; // must be 13 characters long
+const char* crack(CrackRequest* request, const CrackEngine* engine) {
+    CrackJob* job = engine_submit(engine, request->encrypted,
+            request->numThreads, request->start, request->end, request->bloom,
+            request->nice, arena_alloc(request->arena,
+            engine_job_size(request->numThreads)));
+    if (job == NULL) {
+        return INVALID_RESPONSE;
     }
-    char salt[SALT_LENGTH + 2];
-    for (int i = 0; i < SALT_LENGTH; i++) {
-        salt[i] = encrypted[i];
-    }
-    salt[SALT_LENGTH] = '\0';
-    if (strspn(salt, PLAINTEXT_CHARS) != 2) {
-        return ":invalid\n"; // check if salt substring exclusively plaintext
-    }
-
-    pthread_t* threads = malloc(sizeof(pthread_t) * numThreads);
-    CrackThreadData* threadData = malloc(sizeof(CrackThreadData) * numThreads);
-    char* result = NULL;
-    
-    volatile int stopFlag = 0;
-    pthread_mutex_t dictMutex = PTHREAD_MUTEX_INITIALIZER;
-    
-    for (int i = 0; i < numThreads; i++) {
-        threadData[i].encrypted = encrypted;
-        threadData[i].salt = salt;
-        threadData[i].threadId = i;
-        threadData[i].numThreads = numThreads;
-        threadData[i].dict = dict;
-        threadData[i].result = NULL;
-        threadData[i].stopFlag = &stopFlag;
-        threadData[i].dict.dictMutex = &dictMutex;
-        
-        pthread_create(&threads[i], NULL, crack_thread, &threadData[i]);
-    }
-    
-    for (int i = 0; i < numThreads; i++) {
-        pthread_join(threads[i], NULL);
-        
-        if (threadData[i].result != NULL && threadData[i].result[0] != ':') {
-            result = threadData[i].result;
-            break;
+
+    struct pollfd fds[2] = {{.fd = engine_job_fd(job), .events = POLLIN},
+            {.fd = request->cancelFd, .events = 0}}; // only hang ups
+    long long now = now_ms();
+    long long deadline = request->timeoutMs ? now + request->timeoutMs : 0;
+    long long nextProgress = request->progressMs ? now + request->progressMs :
+            0;
+    bool timedOut = false;
+    while (!engine_poll(job)) {
+        bool stopped = engine_stopped(job);
+        int numFds = request->cancelFd >= 0 && !stopped ? 2 : 1;
+        long long wake = deadline;
+        if (nextProgress && (!wake || nextProgress < wake)) {
+            wake = nextProgress;
+        }
+        int waitMs = wake && !stopped ? (wake > now ? wake - now : 0) : -1;
+        if (poll(fds, numFds, waitMs) < 0) {
+            continue; // interrupted
+        }
+        if (numFds == 2 && fds[1].revents != 0) {
+            engine_cancel(job); // nobody is left to answer, stop searching
+        }
+        now = now_ms();
+        if (deadline && now >= deadline && !engine_stopped(job)) {
+            engine_cancel(job);
+            timedOut = true;
+        }
+        if (nextProgress && now >= nextProgress && !engine_stopped(job)) {
+            request->onProgress(request->progressContext, engine_tested(job),
+                    request->end - request->start);
+            while (nextProgress <= now) { // skip any ticks we were late for
+                nextProgress += request->progressMs;
+            }
         }
     }
-    
-    free(threads);
-    free(threadData);
+
+    const char* result = engine_finish(job, &request->tested,
+            request->profile);
+    if (result == NULL && timedOut) {
+        return TIMEOUT_RESPONSE;
+    }
     // ensure null pointer safety
-    return result != NULL ? result : ":failed\n";
+    return result != NULL ? result : FAILED_RESPONSE;
 }
 
-/* crack_thread()
- * --------------
- * The thread method to be called by crack which does the actual cracking of
- * the encryption.
+/* client_gone()
+ * -------------
+ * Checks, without blocking, whether the other end of a connection has reset
+ * it. A client that has only closed its sending side still gets its answers.
+ *
+ * fd: The connection to check
+ *
+ * Returns: true if the connection has been reset or has errored
+ */
+bool client_gone(int fd) {
+    struct pollfd pollFd = {.fd = fd, .events = 0}; // only hang ups
+    return poll(&pollFd, 1, 0) > 0 && (pollFd.revents & (POLLHUP | POLLERR));
+}
+
+/* coordinate_crack()
+ * ------------------
+ * Cracks a password by splitting the dictionary into ranges (shards) and
+ * handing them out to the worker crackservers, one thread per worker. As soon
+ * as any worker finds the word the rest are cancelled. Shards held by a worker
+ * that fails are put back to be retried by the others, and if every worker
+ * has failed the coordinator searches whatever is left itself.
+ *
+ * request: The crack request, covering the whole dictionary
+ *
+ * conn: The connection the request arrived on
+ *
+ * Returns: The result of cracking the password, as for crack()
+ */
+const char* coordinate_crack(CrackRequest* request, Connection* conn) {
+    ServerParams* server = conn->server;
+    Coordination coord = {.request = request, .shardsDone = 0,
+            .liveWorkers = server->numWorkers, .found = false,
+            .stopped = false,
+            .cancelFd = eventfd(0, 0)};
+    coord.numShards = server->numWorkers * SHARDS_PER_WORKER;
+    if (coord.numShards > request->end) {
+        coord.numShards = request->end; // never make an empty shard
+    }
+    coord.shardStarts = arena_alloc(&conn->arena,
+            sizeof(int) * (coord.numShards + 1));
+    coord.shards = arena_alloc(&conn->arena,
+            sizeof(ShardState) * coord.numShards);
+    memset(coord.shards, 0, sizeof(ShardState) * coord.numShards);
+    for (int i = 0; i <= coord.numShards; i++) {
+        coord.shardStarts[i] = (int)((long)request->end * i / coord.numShards);
+    }
+    pthread_mutex_init(&coord.lock, NULL);
+    pthread_cond_init(&coord.changed, NULL);
+
+    pthread_t* threads = arena_alloc(&conn->arena,
+            sizeof(pthread_t) * server->numWorkers);
+    WorkerParams* params = arena_alloc(&conn->arena,
+            sizeof(WorkerParams) * server->numWorkers);
+    for (int i = 0; i < server->numWorkers; i++) {
+        params[i].coord = &coord;
+        params[i].worker = &server->workers[i];
+        params[i].index = i;
+        pthread_create(&threads[i], NULL, worker_thread, &params[i]);
+    }
+
+    long long now = now_ms();
+    long long deadline = request->timeoutMs ? now + request->timeoutMs : 0;
+    long long nextProgress = request->progressMs ? now + request->progressMs :
+            0;
+    bool timedOut = false;
+    pthread_mutex_lock(&coord.lock);
+    while (!coord.found && coord.shardsDone < coord.numShards &&
+            coord.liveWorkers > 0) {
+        long long waitNs = COORDINATOR_POLL_NS;
+        if (deadline && (deadline - now) * NS_PER_MS < waitNs) {
+            waitNs = (deadline - now) * NS_PER_MS;
+        }
+        if (nextProgress && (nextProgress - now) * NS_PER_MS < waitNs) {
+            waitNs = (nextProgress - now) * NS_PER_MS;
+        }
+        struct timespec wake;
+        clock_gettime(CLOCK_REALTIME, &wake);
+        wake.tv_nsec += waitNs > 0 ? waitNs : 0;
+        wake.tv_sec += wake.tv_nsec / NS_PER_SEC;
+        wake.tv_nsec %= NS_PER_SEC;
+        pthread_cond_timedwait(&coord.changed, &coord.lock, &wake);
+        now = now_ms();
+        if (client_gone(request->cancelFd)) {
+            break; // nobody is left to answer
+        } else if (deadline && now >= deadline) {
+            timedOut = true;
+            break;
+        } else if (nextProgress && now >= nextProgress) {
+            long tested = 0; // progress is counted in completed shards
+            for (int i = 0; i < coord.numShards; i++) {
+                if (coord.shards[i] == SHARD_DONE) {
+                    tested += coord.shardStarts[i + 1] - coord.shardStarts[i];
+                }
+            }
+            request->onProgress(request->progressContext, tested,
+                    request->end);
+            while (nextProgress <= now) {
+                nextProgress += request->progressMs;
+            }
+        }
+    }
+    coord.stopped = true;
+    eventfd_write(coord.cancelFd, 1); // stop all workers still going
+    pthread_mutex_unlock(&coord.lock);
+    for (int i = 0; i < server->numWorkers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    // all workers failed, so search whatever they did not finish ourselves
+    const char* result = coord.found ? coord.result : FAILED_RESPONSE;
+    for (int i = 0; i < coord.numShards && !coord.found && !timedOut &&
+            !client_gone(request->cancelFd); i++) {
+        if (coord.shards[i] != SHARD_DONE) {
+            CrackRequest shard = *request;
+            shard.start = coord.shardStarts[i];
+            shard.end = coord.shardStarts[i + 1];
+            shard.progressMs = 0;
+            if (deadline) { // whatever time is left of the whole request
+                shard.timeoutMs = deadline - now_ms();
+                if (shard.timeoutMs <= 0) {
+                    timedOut = true;
+                    break;
+                }
+            }
+            size_t used = conn->arena.used;
+            result = crack(&shard, server->engine);
+            conn->arena.used = used; // only the result is needed from here
+            coord.found = result[0] != ':';
+            timedOut = strcmp(result, TIMEOUT_RESPONSE) == 0;
+        }
+    }
+    if (!coord.found && timedOut) {
+        result = TIMEOUT_RESPONSE;
+    }
+    if (result[0] != ':') { // copy out of the coordination or dictionary
+        result = strcpy(arena_alloc(&conn->arena, strlen(result) + 1),
+                result);
+    }
+
+    close(coord.cancelFd);
+    pthread_mutex_destroy(&coord.lock);
+    pthread_cond_destroy(&coord.changed);
+    return result;
+}
+
+/* worker_thread()
+ * ---------------
+ * The thread run by a coordinator for each of its workers. Connects to the
+ * worker and repeatedly sends it the next pending shard until the word is
+ * found, there are no shards left or the worker fails. While waiting for an
+ * answer the coordination's cancel event is also watched; when it fires the
+ * connection is reset so the worker abandons the shard.
+ *
+ * arg: The WorkerParams for this thread
  *
- * arg: The CrackThreadData struct which contains all the important information
- *      for cracking a password, as well as their id for calculating where in
- *      the dictionary they should search.
- * 
  * Returns: void*
- * Errors: should not produce any errors.
  */
-void* crack_thread(void* arg) {
-    CrackThreadData* data = (CrackThreadData*)arg;
-    // get the start of where to look with floor (numDict / numThreads)
-    int start = data->threadId * (data->dict.numWords / data->numThreads);
-    int end;
-    if (data->threadId == data->numThreads - 1) {
-        end = data->dict.numWords; // last thread gets rest of the words
-    } else { // basically gets the next start
-        end = (data->threadId + 1) * (data->dict.numWords / data->numThreads);
+void* worker_thread(void* arg) {
+    WorkerParams* params = (WorkerParams*)arg;
+    Coordination* coord = params->coord;
+    int fd = connect_worker(params->worker);
+    if (fd < 0) {
+        log_event(LOG_WARN, coord->request->requestId, -1,
+                "worker %s:%s unreachable", params->worker->host,
+                params->worker->port);
     }
+    FILE* to = fd < 0 ? NULL : fdopen(fd, "w");
+    FILE* from = fd < 0 ? NULL : fdopen(dup(fd), "r");
+    bool cancelled = false;
 
-    struct crypt_data cryptData;
-    cryptData.initialized = 0;
-    
-    for (int i = start; i < end; i++) {
-        if (*data->stopFlag) {
-            data->result = NULL;
-            return NULL;
-        }
-        
-        char* encryptedWord;
-        pthread_mutex_lock(data->dict.dictMutex);
-        encryptedWord = crypt_r(data->dict.words[i], data->salt, &cryptData);
-        pthread_mutex_unlock(data->dict.dictMutex);
-        
-        if (strcmp(encryptedWord, data->encrypted) == 0) {
-            *data->stopFlag = 1;
-            data->result = data->dict.words[i];
-            return NULL;
-        }
-    }
-    
-    data->result = ":failed\n";
+    while (to != NULL && from != NULL) {
+        pthread_mutex_lock(&coord->lock);
+        int shard = 0;
+        while (shard < coord->numShards &&
+                coord->shards[shard] != SHARD_PENDING) {
+            shard++;
+        }
+        if (coord->found || coord->stopped || shard == coord->numShards) {
+            pthread_mutex_unlock(&coord->lock);
+            break;
+        }
+        coord->shards[shard] = SHARD_RUNNING;
+        pthread_mutex_unlock(&coord->lock);
+
+        fprintf(to, "crack %s %d %s%d-%d\n", coord->request->encrypted,
+                coord->request->numThreads, RANGE_OPTION,
+                coord->shardStarts[shard], coord->shardStarts[shard + 1]);
+        fflush(to);
+        struct pollfd fds[2] = {{.fd = fd, .events = POLLIN},
+                {.fd = coord->cancelFd, .events = POLLIN}};
+        while (poll(fds, 2, -1) < 0) {
+            // interrupted, try again
+        }
+        cancelled = fds[1].revents != 0;
+        char line[CONN_BUFFER_SIZE];
+        char* response = cancelled ? NULL : fgets(line, sizeof(line), from);
+        if (response != NULL) {
+            response[strcspn(response, "\n")] = '\0';
+        }
+
+        pthread_mutex_lock(&coord->lock);
+        if (response == NULL || strcmp(response, INVALID_RESPONSE) == 0) {
+            coord->shards[shard] = SHARD_PENDING; // someone else can retry it
+        } else {
+            coord->shards[shard] = SHARD_DONE;
+            coord->shardsDone++;
+            if (response[0] != ':' && !coord->found &&
+                    strlen(response) <= MAX_WORD_LEN) {
+                coord->found = true;
+                strcpy(coord->result, response);
+            }
+        }
+        pthread_cond_broadcast(&coord->changed);
+        pthread_mutex_unlock(&coord->lock);
+        // the worker failed, or disagrees with us about the dictionary
+        bool failed = response == NULL || strcmp(response,
+                INVALID_RESPONSE) == 0;
+        if (failed) {
+            if (!cancelled) {
+                log_event(LOG_WARN, coord->request->requestId, -1,
+                        "worker %s:%s failed, shard %d requeued",
+                        params->worker->host, params->worker->port, shard);
+            }
+            break;
+        }
+    }
+
+    if (cancelled) { // reset rather than close, which is the cancel signal
+        struct linger linger = {.l_onoff = 1, .l_linger = 0};
+        setsockopt(fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+    }
+    if (to != NULL) {
+        fclose(to);
+    } else if (fd >= 0) {
+        close(fd);
+    }
+    if (from != NULL) {
+        fclose(from);
+    }
+    pthread_mutex_lock(&coord->lock);
+    coord->liveWorkers--;
+    pthread_cond_broadcast(&coord->changed);
+    pthread_mutex_unlock(&coord->lock);
     return NULL;
 }
 
+/* connect_worker()
+ * ----------------
+ * Opens a connection to a worker crackserver.
+ *
+ * worker: The address of the worker
+ *
+ * Returns: The connected socket, or -1 if the worker could not be reached
+ */
+int connect_worker(Worker* worker) {
+    struct addrinfo* ai = NULL;
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(worker->host, worker->port, &hints, &ai) != 0) {
+        return -1;
+    }
+    int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) == -1) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(ai);
+    if (fd >= 0) {
+        int optVal = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &optVal, sizeof(int));
+    }
+    return fd;
+}
+
+/* now_ms()
+ * --------
+ * Gets the current time from the monotonic clock, for measuring deadlines and
+ * intervals.
+ *
+ * Returns: The current time in milliseconds since an arbitrary point
+ */
+long long now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / NS_PER_MS;
+}
+
+/* now_us()
+ * --------
+ * Gets the current time from the monotonic clock, for measuring latencies.
+ *
+ * Returns: The current time in microseconds since an arbitrary point
+ */
+long long now_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000 + now.tv_nsec / NS_PER_US;
+}
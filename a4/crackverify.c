@@ -0,0 +1,256 @@
+/*
+ * crackverify.c
+ *      CSSE2310 - Assignment Four
+ *
+ *      Written by Alex Viller, a.viller@uqconnect.edu.au
+ *
+ * Usage:
+ *  crackverify [--dictionary filename] [--words count]
+ *
+ *  Checks the crack engine's own DES (see descrypt.h) against crypt_r()
+ *  with every one of the 4096 salts. Each salt is tried with a fixed set of
+ *  awkward keys (empty, longer than 8 characters, bytes with the top bit set
+ *  and so on) and with count words of the dictionary (default 16), a
+ *  different run of them for each salt. Every hash crypt_r() gives is also
+ *  decoded and checked against the block it came from.
+ *
+ *  The first few mismatches are printed, followed by how many keys were
+ *  checked and how long each implementation took over them.
+ *
+ */
+#define _GNU_SOURCE // for crackengine.h
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <time.h>
+#include "crackengine.h"
+
+/* Global Definitions */
+// The dictionary used if none is given
+#define DEFAULT_DICT "/usr/share/dict/words"
+// The number of dictionary words tried with each salt if not given
+#define DEFAULT_WORDS 16
+// The most digits accepted in a numeric option
+#define MAX_OPTION_DIGITS 9
+// The characters of a salt, in the order of their values
+#define SALT_CHARS "./0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"\
+                   "abcdefghijklmnopqrstuvwxyz"
+// The number of values each salt character can take, and salts there are
+#define SALT_CHAR_VALUES 64
+#define NUM_SALTS (SALT_CHAR_VALUES * SALT_CHAR_VALUES)
+// The most mismatches printed
+#define MAX_REPORTED 10
+// The number of nanoseconds in a second
+#define NS_PER_SEC 1000000000.0
+
+/* New Type Creations */
+// enum containing all the error codes
+typedef enum {
+    OK = 0,
+    USAGE_ERR = 1,
+    DICT_ERR = 2,
+    MISMATCH_ERR = 3
+} ErrorCodes;
+
+// enum containing the values to be used for getopt_long
+typedef enum {
+    DICT_ARG = 1,
+    WORDS_ARG = 2
+} ArgType;
+
+// struct for containing the keys checked so far, the mismatches found, and
+// the time each implementation has taken
+typedef struct {
+    long checked;
+    long mismatches;
+    double builtinSecs;
+    double libcSecs;
+} Results;
+
+// Keys which are tried with every salt
+static const char* const fixedKeys[] = {
+    "", "a", "z", "AAAAAAAA", "password", "12345678", "longerthan8",
+    "./09AZaz", "\x01", "\x7f\x7f\x7f\x7f\x7f\x7f\x7f\x7f", "\x80",
+    "\xff\xfe\xfd\xfc\xfb\xfa\xf9\xf8", "caf\xc3\xa9", "a b\tc"
+};
+
+/* Function Prototypes */
+int main(int argc, char* argv[]);
+int get_args(int argc, char* argv[], const char** dictPath);
+void print_usage(void);
+void verify_salt(const char* salt, const char* const* keys, int numKeys,
+        struct crypt_data* cryptData, Results* results);
+double now_seconds(void);
+
+/* main()
+ * ------
+ * Checks every salt and reports the results.
+ *
+ * Returns: OK -> 0
+ * Errors: For invalid arguments -> USAGE_ERR
+ *         If the dictionary cannot be read or has no words -> DICT_ERR
+ *         If any key hashes differently -> MISMATCH_ERR
+ */
+int main(int argc, char* argv[]) {
+    const char* dictPath = DEFAULT_DICT;
+    int numWords = get_args(argc, argv, &dictPath);
+    Dictionary dict;
+    if (!engine_load_dict(dictPath, &dict) || dict.numWords == 0) {
+        fprintf(stderr, "crackverify: unable to read dictionary \"%s\"\n",
+                dictPath);
+        exit(DICT_ERR);
+    }
+    int numFixed = sizeof(fixedKeys) / sizeof(*fixedKeys);
+    const char** keys = malloc(sizeof(char*) * (numFixed + numWords));
+    memcpy(keys, fixedKeys, sizeof(fixedKeys));
+    struct crypt_data* cryptData = calloc(1, sizeof(struct crypt_data));
+    Results results = {0, 0, 0, 0};
+    for (int i = 0; i < NUM_SALTS; i++) {
+        char salt[ENGINE_SALT_LEN + 1] = {SALT_CHARS[i % SALT_CHAR_VALUES],
+                SALT_CHARS[i / SALT_CHAR_VALUES], '\0'};
+        for (int j = 0; j < numWords; j++) { // a new run of words each salt
+            keys[numFixed + j] = dict.words[((long)i * numWords + j) %
+                    dict.numWords];
+        }
+        verify_salt(salt, keys, numFixed + numWords, cryptData, &results);
+    }
+    printf("%ld keys checked over %d salts, %ld mismatches\n",
+            results.checked, NUM_SALTS, results.mismatches);
+    printf("builtin: %.0f hashes/s, crypt_r: %.0f hashes/s\n",
+            results.checked / results.builtinSecs,
+            results.checked / results.libcSecs);
+    free(cryptData);
+    free(keys);
+    engine_free_dict(dict);
+    return results.mismatches > 0 ? MISMATCH_ERR : OK;
+}
+
+/* get_args()
+ * ----------
+ * Processes the command line arguments, checking their validity.
+ *
+ * argc: the number of arguments (including the program itself)
+ *
+ * argv: the arguments
+ *
+ * dictPath: Where to store the dictionary given, if one is
+ *
+ * Returns: The number of dictionary words to try with each salt
+ * Errors: For any usage error, calls print_usage() which will error
+ */
+int get_args(int argc, char* argv[], const char** dictPath) {
+    int numWords = -1;
+    bool dictFlag = false;
+    static struct option longOpts[] = {
+        {"dictionary", required_argument, NULL, DICT_ARG},
+        {"words", required_argument, NULL, WORDS_ARG},
+        {0, 0, 0, 0}
+    };
+    while (true) {
+        int opt = getopt_long(argc, argv, ":", longOpts, NULL);
+        if (opt == -1) {
+            break;
+        } else if (opt == DICT_ARG && !dictFlag) {
+            dictFlag = true;
+            *dictPath = optarg;
+        } else if (opt == WORDS_ARG && numWords < 0 && strlen(optarg) > 0 &&
+                strlen(optarg) <= MAX_OPTION_DIGITS &&
+                strspn(optarg, "0123456789") == strlen(optarg)) {
+            numWords = atoi(optarg);
+        } else {
+            print_usage();
+        }
+    }
+    if (optind < argc) {
+        print_usage();
+    }
+    return numWords < 0 ? DEFAULT_WORDS : numWords;
+}
+
+/* print_usage()
+ * -------------
+ * Prints the usage message and exits.
+ *
+ * Returns: void
+ * Errors: with USAGE_ERR
+ */
+void print_usage(void) {
+    fprintf(stderr, "Usage: crackverify [--dictionary filename] "
+            "[--words count]\n");
+    exit(USAGE_ERR);
+}
+
+/* verify_salt()
+ * -------------
+ * Hashes each key with one salt both ways and compares the results, then
+ * checks that each hash crypt_r() gave decodes to the block it came from.
+ * Each implementation is timed over the whole set of keys on its own.
+ *
+ * salt: The salt
+ *
+ * keys: The keys
+ *
+ * numKeys: The number of keys
+ *
+ * cryptData: The crypt_r() state to use
+ *
+ * results: The results to add to
+ *
+ * Returns: void
+ */
+void verify_salt(const char* salt, const char* const* keys, int numKeys,
+        struct crypt_data* cryptData, Results* results) {
+    uint32_t saltBits;
+    if (!des_parse_salt(salt, &saltBits)) {
+        fprintf(stderr, "crackverify: salt \"%s\" not accepted\n", salt);
+        results->mismatches++;
+        return;
+    }
+    DesKey key;
+    DesBlock* blocks = malloc(sizeof(DesBlock) * numKeys);
+    double start = now_seconds();
+    for (int i = 0; i < numKeys; i++) {
+        des_set_key(keys[i], &key);
+        des_crypt_block(&key, saltBits, &blocks[i]);
+    }
+    double middle = now_seconds();
+    char (*expected)[ENGINE_HASH_LEN + 1] = malloc(sizeof(*expected) *
+            numKeys);
+    for (int i = 0; i < numKeys; i++) {
+        const char* hash = crypt_r(keys[i], salt, cryptData);
+        strncpy(expected[i], hash != NULL ? hash : "", ENGINE_HASH_LEN + 1);
+        expected[i][ENGINE_HASH_LEN] = '\0';
+    }
+    results->builtinSecs += middle - start;
+    results->libcSecs += now_seconds() - middle;
+
+    for (int i = 0; i < numKeys; i++) {
+        char actual[ENGINE_HASH_LEN + 1];
+        DesBlock decoded;
+        des_encode(&blocks[i], salt, actual);
+        bool matches = strcmp(actual, expected[i]) == 0 &&
+                des_decode(expected[i] + ENGINE_SALT_LEN, &decoded) &&
+                decoded.l == blocks[i].l && decoded.r == blocks[i].r;
+        if (!matches && results->mismatches++ < MAX_REPORTED) {
+            printf("mismatch: salt \"%s\" key \"%s\": builtin %s, "
+                    "crypt_r %s\n", salt, keys[i], actual, expected[i]);
+        }
+        results->checked++;
+    }
+    free(expected);
+    free(blocks);
+}
+
+/* now_seconds()
+ * -------------
+ * Reads the monotonic clock.
+ *
+ * Returns: The time in seconds
+ */
+double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / NS_PER_SEC;
+}
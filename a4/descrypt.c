@@ -0,0 +1,405 @@
+/*
+ * descrypt.c
+ *      CSSE2310 - Assignment Four
+ *
+ *      Written by Alex Viller, a.viller@uqconnect.edu.au
+ *
+ * Traditional DES crypt(3), see descrypt.h. The cipher is table driven:
+ * each permutation is done a byte (or 7 bits) at a time with masks worked
+ * out from the standard tables, and pairs of S-boxes are merged with the
+ * P-box so that each round is four lookups.
+ *
+ */
+#include <string.h>
+#include <pthread.h>
+#include "descrypt.h"
+
+// The characters of crypt(3)'s base 64, in order
+#define ASCII64 "./0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"\
+                "abcdefghijklmnopqrstuvwxyz"
+// The number of bits of a 7 bit key character, and values it can take
+#define KEY_CHAR_BITS 7
+#define KEY_CHAR_VALUES 128
+// The number of values a byte can take
+#define BYTE_VALUES 256
+// The number of values a pair of S-box inputs can take
+#define SBOX_PAIR_VALUES 4096
+// Marks a bit which a permutation leaves out
+#define NO_BIT 255
+
+/* Function Prototypes */
+void des_init(void);
+int ascii_to_bin(char c);
+
+// The initial permutation, IP
+static const uint8_t ipTable[64] = {
+    58, 50, 42, 34, 26, 18, 10, 2, 60, 52, 44, 36, 28, 20, 12, 4,
+    62, 54, 46, 38, 30, 22, 14, 6, 64, 56, 48, 40, 32, 24, 16, 8,
+    57, 49, 41, 33, 25, 17, 9, 1, 59, 51, 43, 35, 27, 19, 11, 3,
+    61, 53, 45, 37, 29, 21, 13, 5, 63, 55, 47, 39, 31, 23, 15, 7
+};
+
+// The key permutation, PC-1
+static const uint8_t keyPerm[56] = {
+    57, 49, 41, 33, 25, 17, 9, 1, 58, 50, 42, 34, 26, 18,
+    10, 2, 59, 51, 43, 35, 27, 19, 11, 3, 60, 52, 44, 36,
+    63, 55, 47, 39, 31, 23, 15, 7, 62, 54, 46, 38, 30, 22,
+    14, 6, 61, 53, 45, 37, 29, 21, 13, 5, 28, 20, 12, 4
+};
+
+// How far the key halves are rotated before each round
+static const uint8_t keyShifts[DES_ROUNDS] = {
+    1, 1, 2, 2, 2, 2, 2, 2, 1, 2, 2, 2, 2, 2, 2, 1
+};
+
+// The compression permutation, PC-2
+static const uint8_t compPerm[48] = {
+    14, 17, 11, 24, 1, 5, 3, 28, 15, 6, 21, 10,
+    23, 19, 12, 4, 26, 8, 16, 7, 27, 20, 13, 2,
+    41, 52, 31, 37, 47, 55, 30, 40, 51, 45, 33, 48,
+    44, 49, 39, 56, 34, 53, 46, 42, 50, 36, 29, 32
+};
+
+// The S-boxes, each row by row
+static const uint8_t sbox[8][64] = {
+    {14, 4, 13, 1, 2, 15, 11, 8, 3, 10, 6, 12, 5, 9, 0, 7,
+     0, 15, 7, 4, 14, 2, 13, 1, 10, 6, 12, 11, 9, 5, 3, 8,
+     4, 1, 14, 8, 13, 6, 2, 11, 15, 12, 9, 7, 3, 10, 5, 0,
+     15, 12, 8, 2, 4, 9, 1, 7, 5, 11, 3, 14, 10, 0, 6, 13},
+    {15, 1, 8, 14, 6, 11, 3, 4, 9, 7, 2, 13, 12, 0, 5, 10,
+     3, 13, 4, 7, 15, 2, 8, 14, 12, 0, 1, 10, 6, 9, 11, 5,
+     0, 14, 7, 11, 10, 4, 13, 1, 5, 8, 12, 6, 9, 3, 2, 15,
+     13, 8, 10, 1, 3, 15, 4, 2, 11, 6, 7, 12, 0, 5, 14, 9},
+    {10, 0, 9, 14, 6, 3, 15, 5, 1, 13, 12, 7, 11, 4, 2, 8,
+     13, 7, 0, 9, 3, 4, 6, 10, 2, 8, 5, 14, 12, 11, 15, 1,
+     13, 6, 4, 9, 8, 15, 3, 0, 11, 1, 2, 12, 5, 10, 14, 7,
+     1, 10, 13, 0, 6, 9, 8, 7, 4, 15, 14, 3, 11, 5, 2, 12},
+    {7, 13, 14, 3, 0, 6, 9, 10, 1, 2, 8, 5, 11, 12, 4, 15,
+     13, 8, 11, 5, 6, 15, 0, 3, 4, 7, 2, 12, 1, 10, 14, 9,
+     10, 6, 9, 0, 12, 11, 7, 13, 15, 1, 3, 14, 5, 2, 8, 4,
+     3, 15, 0, 6, 10, 1, 13, 8, 9, 4, 5, 11, 12, 7, 2, 14},
+    {2, 12, 4, 1, 7, 10, 11, 6, 8, 5, 3, 15, 13, 0, 14, 9,
+     14, 11, 2, 12, 4, 7, 13, 1, 5, 0, 15, 10, 3, 9, 8, 6,
+     4, 2, 1, 11, 10, 13, 7, 8, 15, 9, 12, 5, 6, 3, 0, 14,
+     11, 8, 12, 7, 1, 14, 2, 13, 6, 15, 0, 9, 10, 4, 5, 3},
+    {12, 1, 10, 15, 9, 2, 6, 8, 0, 13, 3, 4, 14, 7, 5, 11,
+     10, 15, 4, 2, 7, 12, 9, 5, 6, 1, 13, 14, 0, 11, 3, 8,
+     9, 14, 15, 5, 2, 8, 12, 3, 7, 0, 4, 10, 1, 13, 11, 6,
+     4, 3, 2, 12, 9, 5, 15, 10, 11, 14, 1, 7, 6, 0, 8, 13},
+    {4, 11, 2, 14, 15, 0, 8, 13, 3, 12, 9, 7, 5, 10, 6, 1,
+     13, 0, 11, 7, 4, 9, 1, 10, 14, 3, 5, 12, 2, 15, 8, 6,
+     1, 4, 11, 13, 12, 3, 7, 14, 10, 15, 6, 8, 0, 5, 9, 2,
+     6, 11, 13, 8, 1, 4, 10, 7, 9, 5, 0, 15, 14, 2, 3, 12},
+    {13, 2, 8, 4, 6, 15, 11, 1, 10, 9, 3, 14, 5, 0, 12, 7,
+     1, 15, 13, 8, 10, 3, 7, 4, 12, 5, 6, 11, 0, 14, 9, 2,
+     7, 11, 4, 1, 9, 12, 14, 2, 0, 6, 10, 13, 15, 3, 5, 8,
+     2, 1, 14, 7, 4, 10, 8, 13, 15, 12, 9, 0, 3, 5, 6, 11}
+};
+
+// The P-box
+static const uint8_t pbox[32] = {
+    16, 7, 20, 21, 29, 12, 28, 17, 1, 15, 23, 26, 5, 18, 31, 10,
+    2, 8, 24, 14, 32, 27, 3, 9, 19, 13, 30, 6, 22, 11, 4, 25
+};
+
+// The tables below are worked out from those above by des_init()
+static pthread_once_t initialised = PTHREAD_ONCE_INIT;
+// Each pair of S-boxes as one, indexed by both 6 bit inputs together
+static uint8_t pairSbox[4][SBOX_PAIR_VALUES];
+// The P-box applied to each byte of the S-boxes' output
+static uint32_t pSbox[4][BYTE_VALUES];
+// IP and the final permutation applied to each byte of a block
+static uint32_t ipMaskL[8][BYTE_VALUES];
+static uint32_t ipMaskR[8][BYTE_VALUES];
+static uint32_t fpMaskL[8][BYTE_VALUES];
+static uint32_t fpMaskR[8][BYTE_VALUES];
+// PC-1 applied to each key character, into the two 28 bit halves
+static uint32_t keyMaskL[8][KEY_CHAR_VALUES];
+static uint32_t keyMaskR[8][KEY_CHAR_VALUES];
+// PC-2 applied to each 7 bits of the key, into the two 24 bit halves
+static uint32_t compMaskL[8][KEY_CHAR_VALUES];
+static uint32_t compMaskR[8][KEY_CHAR_VALUES];
+
+/* des_init()
+ * ----------
+ * Works out the tables the cipher uses from the standard ones. Called once,
+ * through pthread_once().
+ *
+ * Returns: void
+ */
+void des_init(void) {
+    for (int i = 0; i < 8; i++) { // reorder each S-box by its 6 bit input
+        for (int j = 0; j < 64; j++) {
+            int row = (j & 0x20) | ((j & 1) << 4) | ((j >> 1) & 0xf);
+            for (int k = 0; k < 64 && !(i & 1); k++) {
+                int rowK = (k & 0x20) | ((k & 1) << 4) | ((k >> 1) & 0xf);
+                pairSbox[i / 2][(j << 6) | k] = (sbox[i][row] << 4) |
+                        sbox[i + 1][rowK];
+            }
+        }
+    }
+    uint8_t initPerm[64], finalPerm[64];
+    for (int i = 0; i < 64; i++) {
+        finalPerm[i] = ipTable[i] - 1;
+        initPerm[finalPerm[i]] = i;
+    }
+    for (int k = 0; k < 8; k++) {
+        for (int i = 0; i < BYTE_VALUES; i++) {
+            ipMaskL[k][i] = ipMaskR[k][i] = 0;
+            fpMaskL[k][i] = fpMaskR[k][i] = 0;
+            for (int j = 0; j < 8; j++) {
+                if (!(i & (0x80 >> j))) {
+                    continue;
+                }
+                int bit = initPerm[8 * k + j];
+                *(bit < 32 ? &ipMaskL[k][i] : &ipMaskR[k][i]) |=
+                        0x80000000u >> (bit % 32);
+                bit = finalPerm[8 * k + j];
+                *(bit < 32 ? &fpMaskL[k][i] : &fpMaskR[k][i]) |=
+                        0x80000000u >> (bit % 32);
+            }
+        }
+    }
+    uint8_t invKeyPerm[64], invCompPerm[56];
+    memset(invKeyPerm, NO_BIT, sizeof(invKeyPerm));
+    memset(invCompPerm, NO_BIT, sizeof(invCompPerm));
+    for (int i = 0; i < 56; i++) {
+        invKeyPerm[keyPerm[i] - 1] = i;
+    }
+    for (int i = 0; i < 48; i++) {
+        invCompPerm[compPerm[i] - 1] = i;
+    }
+    for (int k = 0; k < 8; k++) {
+        for (int i = 0; i < KEY_CHAR_VALUES; i++) {
+            keyMaskL[k][i] = keyMaskR[k][i] = 0;
+            compMaskL[k][i] = compMaskR[k][i] = 0;
+            for (int j = 0; j < KEY_CHAR_BITS; j++) {
+                if (!(i & (0x40 >> j))) {
+                    continue;
+                }
+                int bit = invKeyPerm[8 * k + j];
+                if (bit != NO_BIT) {
+                    *(bit < 28 ? &keyMaskL[k][i] : &keyMaskR[k][i]) |=
+                            0x08000000u >> (bit % 28);
+                }
+                bit = invCompPerm[7 * k + j];
+                if (bit != NO_BIT) {
+                    *(bit < 24 ? &compMaskL[k][i] : &compMaskR[k][i]) |=
+                            0x00800000u >> (bit % 24);
+                }
+            }
+        }
+    }
+    uint8_t unPbox[32];
+    for (int i = 0; i < 32; i++) {
+        unPbox[pbox[i] - 1] = i;
+    }
+    for (int b = 0; b < 4; b++) {
+        for (int i = 0; i < BYTE_VALUES; i++) {
+            pSbox[b][i] = 0;
+            for (int j = 0; j < 8; j++) {
+                if (i & (0x80 >> j)) {
+                    pSbox[b][i] |= 0x80000000u >> unPbox[8 * b + j];
+                }
+            }
+        }
+    }
+}
+
+/* ascii_to_bin()
+ * --------------
+ * Finds the value of a crypt(3) base 64 character.
+ *
+ * c: The character
+ *
+ * Returns: Its value, or -1 if it is not a base 64 character
+ */
+int ascii_to_bin(char c) {
+    const char* position = c != '\0' ? strchr(ASCII64, c) : NULL;
+    return position != NULL ? position - ASCII64 : -1;
+}
+
+/* des_parse_salt()
+ * ----------------
+ * Works out which bits of the E-box's output a salt swaps.
+ *
+ * salt: The DES_SALT_LEN character salt
+ *
+ * saltBits: Where to store the swapped bits
+ *
+ * Returns: false if the salt is not valid
+ */
+bool des_parse_salt(const char* salt, uint32_t* saltBits) {
+    int low = ascii_to_bin(salt[0]);
+    int high = low >= 0 ? ascii_to_bin(salt[1]) : -1;
+    if (high < 0) {
+        return false;
+    }
+    pthread_once(&initialised, des_init);
+    int value = (high << 6) | low;
+    *saltBits = 0;
+    for (int i = 0; i < 2 * 6; i++) {
+        if (value & (1 << i)) {
+            *saltBits |= 0x800000u >> i;
+        }
+    }
+    return true;
+}
+
+/* des_set_key()
+ * -------------
+ * Works out the key schedule for a word, which crypt(3) takes the first 8
+ * characters of, 7 bits from each.
+ *
+ * word: The word
+ *
+ * key: Where to store the key schedule
+ *
+ * Returns: void
+ */
+void des_set_key(const char* word, DesKey* key) {
+    pthread_once(&initialised, des_init);
+    uint32_t k0 = 0, k1 = 0;
+    for (int i = 0; i < 8; i++) {
+        int c = (unsigned char)*word & 0x7f;
+        if (*word != '\0') {
+            word++;
+        }
+        k0 |= keyMaskL[i][c];
+        k1 |= keyMaskR[i][c];
+    }
+    int shifts = 0;
+    for (int round = 0; round < DES_ROUNDS; round++) {
+        shifts += keyShifts[round];
+        uint32_t t0 = (k0 << shifts) | (k0 >> (28 - shifts));
+        uint32_t t1 = (k1 << shifts) | (k1 >> (28 - shifts));
+        key->keysl[round] = compMaskL[0][(t0 >> 21) & 0x7f] |
+                compMaskL[1][(t0 >> 14) & 0x7f] |
+                compMaskL[2][(t0 >> 7) & 0x7f] | compMaskL[3][t0 & 0x7f] |
+                compMaskL[4][(t1 >> 21) & 0x7f] |
+                compMaskL[5][(t1 >> 14) & 0x7f] |
+                compMaskL[6][(t1 >> 7) & 0x7f] | compMaskL[7][t1 & 0x7f];
+        key->keysr[round] = compMaskR[0][(t0 >> 21) & 0x7f] |
+                compMaskR[1][(t0 >> 14) & 0x7f] |
+                compMaskR[2][(t0 >> 7) & 0x7f] | compMaskR[3][t0 & 0x7f] |
+                compMaskR[4][(t1 >> 21) & 0x7f] |
+                compMaskR[5][(t1 >> 14) & 0x7f] |
+                compMaskR[6][(t1 >> 7) & 0x7f] | compMaskR[7][t1 & 0x7f];
+    }
+}
+
+/* des_crypt_block()
+ * -----------------
+ * Encrypts a block of zeroes DES_ITERATIONS times, as crypt(3) does. The
+ * initial permutation of zeroes is zeroes, and the final one is left off.
+ *
+ * key: The key schedule of the word
+ *
+ * saltBits: The salt's swapped bits, from des_parse_salt()
+ *
+ * block: Where to store the result
+ *
+ * Returns: void
+ */
+void des_crypt_block(const DesKey* key, uint32_t saltBits, DesBlock* block) {
+    uint32_t l = 0, r = 0, f = 0;
+    for (int i = 0; i < DES_ITERATIONS; i++) {
+        for (int round = 0; round < DES_ROUNDS; round++) {
+            // expand r to 48 bits, as two 24 bit halves
+            uint32_t r48l = ((r & 0x00000001) << 23) |
+                    ((r & 0xf8000000) >> 9) | ((r & 0x1f800000) >> 11) |
+                    ((r & 0x01f80000) >> 13) | ((r & 0x001f8000) >> 15);
+            uint32_t r48r = ((r & 0x0001f800) << 7) |
+                    ((r & 0x00001f80) << 5) | ((r & 0x000001f8) << 3) |
+                    ((r & 0x0000001f) << 1) | ((r & 0x80000000) >> 31);
+            // the salt swaps bits between the halves
+            f = (r48l ^ r48r) & saltBits;
+            r48l ^= f ^ key->keysl[round];
+            r48r ^= f ^ key->keysr[round];
+            f = pSbox[0][pairSbox[0][r48l >> 12]] |
+                    pSbox[1][pairSbox[1][r48l & 0xfff]] |
+                    pSbox[2][pairSbox[2][r48r >> 12]] |
+                    pSbox[3][pairSbox[3][r48r & 0xfff]];
+            f ^= l;
+            l = r;
+            r = f;
+        }
+        r = l;
+        l = f;
+    }
+    block->l = l;
+    block->r = r;
+}
+
+/* des_decode()
+ * ------------
+ * Decodes the text of a hash, after its salt, into the block
+ * des_crypt_block() gives for it.
+ *
+ * hash: The DES_HASH_LEN - DES_SALT_LEN characters of the hash
+ *
+ * block: Where to store the block
+ *
+ * Returns: false if the text is not one crypt(3) could have made
+ */
+bool des_decode(const char* hash, DesBlock* block) {
+    uint32_t values[DES_HASH_LEN - DES_SALT_LEN];
+    for (int i = 0; i < DES_HASH_LEN - DES_SALT_LEN; i++) {
+        int value = ascii_to_bin(hash[i]);
+        if (value < 0) {
+            return false;
+        }
+        values[i] = value;
+    }
+    uint32_t first = values[0] << 18 | values[1] << 12 | values[2] << 6 |
+            values[3];
+    uint32_t second = values[4] << 18 | values[5] << 12 | values[6] << 6 |
+            values[7];
+    uint32_t third = values[8] << 12 | values[9] << 6 | values[10];
+    if ((third & 3) != 0 || hash[DES_HASH_LEN - DES_SALT_LEN] != '\0') {
+        return false; // crypt(3) only has 64 bits to give
+    }
+    uint32_t r0 = first << 8 | second >> 16;
+    uint32_t r1 = (second & 0xffff) << 16 | third >> 2;
+    pthread_once(&initialised, des_init);
+    block->l = block->r = 0;
+    for (int k = 0; k < 4; k++) { // undo the final permutation
+        block->l |= ipMaskL[k][(r0 >> (24 - 8 * k)) & 0xff] |
+                ipMaskL[k + 4][(r1 >> (24 - 8 * k)) & 0xff];
+        block->r |= ipMaskR[k][(r0 >> (24 - 8 * k)) & 0xff] |
+                ipMaskR[k + 4][(r1 >> (24 - 8 * k)) & 0xff];
+    }
+    return true;
+}
+
+/* des_encode()
+ * ------------
+ * Encodes a block from des_crypt_block() as crypt(3) text.
+ *
+ * block: The block
+ *
+ * salt: The salt it was encrypted with
+ *
+ * hash: Where to store the text, at least DES_HASH_LEN + 1 characters
+ *
+ * Returns: void
+ */
+void des_encode(const DesBlock* block, const char* salt, char* hash) {
+    uint32_t r0 = 0, r1 = 0;
+    for (int k = 0; k < 4; k++) {
+        r0 |= fpMaskL[k][(block->l >> (24 - 8 * k)) & 0xff] |
+                fpMaskL[k + 4][(block->r >> (24 - 8 * k)) & 0xff];
+        r1 |= fpMaskR[k][(block->l >> (24 - 8 * k)) & 0xff] |
+                fpMaskR[k + 4][(block->r >> (24 - 8 * k)) & 0xff];
+    }
+    uint32_t groups[3] = {r0 >> 8, (r0 << 16) | (r1 >> 16), r1 << 2};
+    hash[0] = salt[0];
+    hash[1] = salt[1];
+    char* out = hash + DES_SALT_LEN;
+    for (int g = 0; g < 3; g++) {
+        for (int shift = g < 2 ? 18 : 12; shift >= 0; shift -= 6) {
+            *out++ = ASCII64[(groups[g] >> shift) & 0x3f];
+        }
+    }
+    *out = '\0';
+}
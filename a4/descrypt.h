@@ -0,0 +1,58 @@
+/*
+ * descrypt.h
+ *      CSSE2310 - Assignment Four
+ *
+ *      Written by Alex Viller, a.viller@uqconnect.edu.au
+ *
+ * Traditional DES crypt(3), split up so that a crack can do the parts which
+ * only depend on the salt or the hash being cracked once, rather than once
+ * for every word as crypt_r() must:
+ *
+ *      des_parse_salt()        the salt's E-box swaps, once per crack
+ *      des_decode()            the hash being cracked, once per crack
+ *      des_set_key()           the key schedule, once per word
+ *      des_crypt_block()       the 25 encryptions, once per word
+ *
+ * Blocks are kept as they are before the final permutation, which is undone
+ * on the decoded hash instead, so each word's result can be compared to it
+ * as is. des_encode() turns a block back into crypt(3) text.
+ *
+ * The tables the cipher is built from are worked out the first time any of
+ * these is called. crackverify checks the results against crypt_r() for
+ * every salt.
+ *
+ */
+#ifndef DESCRYPT_H
+#define DESCRYPT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// The length of a salt
+#define DES_SALT_LEN 2
+// The length of a hash, including its salt
+#define DES_HASH_LEN 13
+// The number of DES rounds, and the number of times crypt(3) encrypts
+#define DES_ROUNDS 16
+#define DES_ITERATIONS 25
+
+// struct for containing a 64 bit block, as two halves
+typedef struct {
+    uint32_t l;
+    uint32_t r;
+} DesBlock;
+
+// struct for containing a key schedule, each 48 bit subkey in two halves
+typedef struct {
+    uint32_t keysl[DES_ROUNDS];
+    uint32_t keysr[DES_ROUNDS];
+} DesKey;
+
+/* Function Prototypes */
+bool des_parse_salt(const char* salt, uint32_t* saltBits);
+void des_set_key(const char* word, DesKey* key);
+void des_crypt_block(const DesKey* key, uint32_t saltBits, DesBlock* block);
+bool des_decode(const char* hash, DesBlock* block);
+void des_encode(const DesBlock* block, const char* salt, char* hash);
+
+#endif
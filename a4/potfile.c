@@ -0,0 +1,428 @@
+/*
+ * potfile.c
+ *      CSSE2310 - Assignment Four
+ *
+ *      Written by Alex Viller, a.viller@uqconnect.edu.au
+ *
+ * The persistent store of cracked hashes, see potfile.h
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "potfile.h"
+
+/* Function Prototypes */
+bool read_records(int fd, size_t length, size_t start, PotRecord** records,
+        int* numRecords);
+bool parse_record(const char* line, size_t length, PotRecord* record);
+int compare_records(const void* a, const void* b);
+bool build_index(Potfile* pot, size_t potLength);
+bool map_index(Potfile* pot);
+const PotRecord* find_record(const PotRecord* records, int numRecords,
+        const char* hash);
+void* compactor_thread(void* arg);
+
+/* potfile_open()
+ * --------------
+ * Opens (creating if needed) a pot file and loads its index. Cracks added
+ * since the index was last built are read into memory if there are only a
+ * few of them, otherwise the index is rebuilt before returning. A thread is
+ * then started to keep the index up to date.
+ *
+ * path: Where the pot file is
+ *
+ * Returns: The open pot file, or NULL if it could not be opened
+ */
+Potfile* potfile_open(const char* path) {
+    int fd = open(path, O_RDWR | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        return NULL;
+    }
+    Potfile* pot = calloc(1, sizeof(Potfile));
+    pot->fd = fd;
+    pot->path = strdup(path);
+    pot->indexPath = malloc(strlen(path) + sizeof(POT_INDEX_SUFFIX));
+    sprintf(pot->indexPath, "%s%s", path, POT_INDEX_SUFFIX);
+    pthread_rwlock_init(&pot->indexLock, NULL);
+    pthread_mutex_init(&pot->lock, NULL);
+    pthread_cond_init(&pot->wake, NULL);
+    // the index may run over the threshold by one compaction's worth
+    pot->recentCapacity = 2 * POT_COMPACT_THRESHOLD;
+    pot->recent = malloc(sizeof(PotRecord) * pot->recentCapacity);
+
+    struct stat info;
+    fstat(fd, &info);
+    PotRecord* tail = NULL;
+    int numTail = 0;
+    bool current = map_index(pot) && pot->index->potLength <=
+            (uint64_t)info.st_size && read_records(fd, info.st_size,
+            pot->index->potLength, &tail, &numTail) &&
+            numTail <= POT_COMPACT_THRESHOLD;
+    if (current) {
+        memcpy(pot->recent, tail, sizeof(PotRecord) * numTail);
+        pot->numRecent = numTail;
+    } else if (!build_index(pot, info.st_size)) {
+        free(tail);
+        potfile_close(pot);
+        return NULL;
+    }
+    free(tail);
+    pthread_create(&pot->compactor, NULL, compactor_thread, pot);
+    return pot;
+}
+
+/* potfile_lookup()
+ * ----------------
+ * Looks for a hash amongst everything that has been cracked.
+ *
+ * pot: The pot file to look in
+ *
+ * hash: The POT_HASH_LEN character hash to look for
+ *
+ * plaintext: Where to copy the plain text if it is found, at least
+ *      POT_WORD_LEN + 1 bytes
+ *
+ * Returns: true if the hash was found
+ */
+bool potfile_lookup(Potfile* pot, const char* hash, char* plaintext) {
+    pthread_rwlock_rdlock(&pot->indexLock);
+    const PotRecord* found = NULL;
+    if (pot->index != NULL) {
+        found = find_record((const PotRecord*)(pot->index + 1),
+                pot->index->numRecords, hash);
+        if (found != NULL) {
+            strcpy(plaintext, found->plaintext);
+        }
+    }
+    pthread_rwlock_unlock(&pot->indexLock);
+    if (found != NULL) {
+        return true;
+    }
+
+    pthread_mutex_lock(&pot->lock);
+    for (int i = 0; i < pot->numRecent && found == NULL; i++) {
+        if (memcmp(pot->recent[i].hash, hash, POT_HASH_LEN) == 0) {
+            found = &pot->recent[i];
+            strcpy(plaintext, found->plaintext);
+        }
+    }
+    pthread_mutex_unlock(&pot->lock);
+    return found != NULL;
+}
+
+/* potfile_add()
+ * -------------
+ * Records a newly cracked hash, appending it to the pot file straight away.
+ * Hashes which are already known, and anything too long to store, are
+ * ignored.
+ *
+ * pot: The pot file to add to
+ *
+ * hash: The hash that was cracked
+ *
+ * plaintext: What it was cracked to
+ *
+ * Returns: void
+ */
+void potfile_add(Potfile* pot, const char* hash, const char* plaintext) {
+    char known[POT_WORD_LEN + 1];
+    PotRecord record;
+    char line[POT_HASH_LEN + POT_WORD_LEN + 3];
+    int length = snprintf(line, sizeof(line), "%s:%s\n", hash, plaintext);
+    if (length >= (int)sizeof(line) || !parse_record(line, length - 1,
+            &record) || potfile_lookup(pot, hash, known)) {
+        return;
+    }
+
+    pthread_mutex_lock(&pot->lock);
+    if (write(pot->fd, line, length) == length) {
+        // if the index has fallen behind this only waits for the next build
+        if (pot->numRecent < pot->recentCapacity) {
+            pot->recent[pot->numRecent++] = record;
+        }
+        if (pot->numRecent >= POT_COMPACT_THRESHOLD) {
+            pthread_cond_signal(&pot->wake);
+        }
+    }
+    pthread_mutex_unlock(&pot->lock);
+}
+
+/* potfile_close()
+ * ---------------
+ * Stops the index from being kept up to date and closes the pot file.
+ *
+ * pot: The pot file to close
+ *
+ * Returns: void
+ */
+void potfile_close(Potfile* pot) {
+    pthread_mutex_lock(&pot->lock);
+    pot->closing = true;
+    pthread_cond_signal(&pot->wake);
+    pthread_mutex_unlock(&pot->lock);
+    if (pot->compactor) {
+        pthread_join(pot->compactor, NULL);
+    }
+    if (pot->index != NULL) {
+        munmap(pot->index, pot->indexSize);
+    }
+    close(pot->fd);
+    pthread_rwlock_destroy(&pot->indexLock);
+    pthread_mutex_destroy(&pot->lock);
+    pthread_cond_destroy(&pot->wake);
+    free(pot->recent);
+    free(pot->path);
+    free(pot->indexPath);
+    free(pot);
+}
+
+/* read_records()
+ * --------------
+ * Reads the records from part of a pot file. Lines which are not valid
+ * records are skipped, as is a final line without a new line (it is still
+ * being written).
+ *
+ * fd: The pot file
+ *
+ * length: How much of the pot file to read
+ *
+ * start: Where in the pot file to start reading, which must be the start of
+ *      a line
+ *
+ * records: Where to store the malloced list of records
+ *
+ * numRecords: Where to store the number of records
+ *
+ * Returns: false if the pot file could not be read
+ */
+bool read_records(int fd, size_t length, size_t start, PotRecord** records,
+        int* numRecords) {
+    *records = NULL;
+    *numRecords = 0;
+    if (start >= length) {
+        return true;
+    }
+    char* text = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (text == MAP_FAILED) {
+        return false;
+    }
+    int capacity = 0;
+    for (char* line = text + start; line < text + length;) {
+        char* end = memchr(line, '\n', text + length - line);
+        if (end == NULL) {
+            break;
+        }
+        if (*numRecords == capacity) { // double the list when full
+            capacity = capacity ? capacity * 2 : POT_COMPACT_THRESHOLD;
+            *records = realloc(*records, sizeof(PotRecord) * capacity);
+        }
+        if (parse_record(line, end - line, &(*records)[*numRecords])) {
+            (*numRecords)++;
+        }
+        line = end + 1;
+    }
+    munmap(text, length);
+    return true;
+}
+
+/* parse_record()
+ * --------------
+ * Parses one "hash:plaintext" line of a pot file.
+ *
+ * line: The line, which need not be null terminated
+ *
+ * length: The length of the line, not counting its new line
+ *
+ * record: Where to store the record
+ *
+ * Returns: true if the line was a valid record
+ */
+bool parse_record(const char* line, size_t length, PotRecord* record) {
+    size_t wordLen = length - POT_HASH_LEN - 1;
+    if (length <= POT_HASH_LEN + 1 || line[POT_HASH_LEN] != ':' ||
+            wordLen > POT_WORD_LEN || memchr(line, '\0', length) != NULL) {
+        return false;
+    }
+    memset(record, 0, sizeof(PotRecord));
+    memcpy(record->hash, line, POT_HASH_LEN);
+    memcpy(record->plaintext, line + POT_HASH_LEN + 1, wordLen);
+    return true;
+}
+
+/* compare_records()
+ * -----------------
+ * qsort() and bsearch() comparison of two records by their hashes.
+ *
+ * a: The first record
+ *
+ * b: The second record
+ *
+ * Returns: Less than, equal to or greater than 0 as a's hash sorts before,
+ *      with or after b's
+ */
+int compare_records(const void* a, const void* b) {
+    return memcmp(((const PotRecord*)a)->hash, ((const PotRecord*)b)->hash,
+            POT_HASH_LEN);
+}
+
+/* build_index()
+ * -------------
+ * Rebuilds the index from the pot file, sorting and removing duplicates, and
+ * swaps it in for the current one. The new index is written beside the old
+ * one and renamed over it, so a crash part way through leaves the old index
+ * in place.
+ *
+ * pot: The pot file to index
+ *
+ * potLength: How much of the pot file to index
+ *
+ * Returns: true if the new index is now in use
+ */
+bool build_index(Potfile* pot, size_t potLength) {
+    PotRecord* records;
+    int numRecords;
+    if (!read_records(pot->fd, potLength, 0, &records, &numRecords)) {
+        return false;
+    }
+    qsort(records, numRecords, sizeof(PotRecord), compare_records);
+    int unique = 0;
+    for (int i = 0; i < numRecords; i++) {
+        if (unique == 0 || compare_records(&records[unique - 1],
+                &records[i]) != 0) {
+            records[unique++] = records[i];
+        }
+    }
+
+    PotIndexHeader header = {.potLength = potLength, .numRecords = unique};
+    memcpy(header.magic, POT_MAGIC, sizeof(header.magic));
+    char* tempPath = malloc(strlen(pot->indexPath) + sizeof(".tmp"));
+    sprintf(tempPath, "%s.tmp", pot->indexPath);
+    FILE* file = fopen(tempPath, "w");
+    bool success = file != NULL &&
+            fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(records, sizeof(PotRecord), unique, file) ==
+            (size_t)unique;
+    if (file != NULL) {
+        success = fclose(file) == 0 && success;
+    }
+    success = success && rename(tempPath, pot->indexPath) == 0 &&
+            map_index(pot);
+    if (!success) {
+        unlink(tempPath);
+    }
+    free(tempPath);
+    free(records);
+    return success;
+}
+
+/* map_index()
+ * -----------
+ * Maps the index file, if it is valid, in place of the one currently in use.
+ *
+ * pot: The pot file whose index is to be mapped
+ *
+ * Returns: true if the index file was valid and is now in use
+ */
+bool map_index(Potfile* pot) {
+    int fd = open(pot->indexPath, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    PotIndexHeader* index = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(*index)) {
+        index = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (index == MAP_FAILED) {
+        return false;
+    }
+    if (memcmp(index->magic, POT_MAGIC, sizeof(index->magic)) != 0 ||
+            (uint64_t)info.st_size != sizeof(*index) +
+            index->numRecords * sizeof(PotRecord)) {
+        munmap(index, info.st_size);
+        return false;
+    }
+
+    pthread_rwlock_wrlock(&pot->indexLock);
+    PotIndexHeader* old = pot->index;
+    size_t oldSize = pot->indexSize;
+    pot->index = index;
+    pot->indexSize = info.st_size;
+    pthread_rwlock_unlock(&pot->indexLock);
+    if (old != NULL) {
+        munmap(old, oldSize);
+    }
+    return true;
+}
+
+/* find_record()
+ * -------------
+ * Binary searches a sorted list of records for a hash.
+ *
+ * records: The records to search
+ *
+ * numRecords: The number of records
+ *
+ * hash: The hash to search for
+ *
+ * Returns: The record with that hash, or NULL if there is none
+ */
+const PotRecord* find_record(const PotRecord* records, int numRecords,
+        const char* hash) {
+    PotRecord key;
+    memcpy(key.hash, hash, POT_HASH_LEN);
+    return bsearch(&key, records, numRecords, sizeof(PotRecord),
+            compare_records);
+}
+
+/* compactor_thread()
+ * ------------------
+ * The thread which rebuilds the index once enough cracks have been added, or
+ * once any have waited POT_COMPACT_SECS, so that lookups stay a binary
+ * search. Cracks are only forgotten from memory once the new index has them.
+ *
+ * arg: The Potfile to keep up to date
+ *
+ * Returns: void*
+ */
+void* compactor_thread(void* arg) {
+    Potfile* pot = (Potfile*)arg;
+    bool built = true;
+    pthread_mutex_lock(&pot->lock);
+    while (!pot->closing) {
+        struct timespec wake;
+        clock_gettime(CLOCK_REALTIME, &wake);
+        wake.tv_sec += POT_COMPACT_SECS;
+        int waited = 0;
+        // after a failed build, wait the full time before trying again
+        while (!pot->closing && (pot->numRecent < POT_COMPACT_THRESHOLD ||
+                !built) && waited != ETIMEDOUT) {
+            waited = pthread_cond_timedwait(&pot->wake, &pot->lock, &wake);
+        }
+        struct stat info;
+        if (pot->closing || fstat(pot->fd, &info) != 0 ||
+                info.st_size == (off_t)pot->index->potLength) {
+            continue; // nothing new since the last build
+        }
+        // appends happen under the lock, so these are all in the file
+        int numIndexed = pot->numRecent;
+        pthread_mutex_unlock(&pot->lock);
+        built = build_index(pot, info.st_size);
+        pthread_mutex_lock(&pot->lock);
+        if (built) {
+            pot->numRecent -= numIndexed;
+            memmove(pot->recent, pot->recent + numIndexed,
+                    sizeof(PotRecord) * pot->numRecent);
+        }
+    }
+    pthread_mutex_unlock(&pot->lock);
+    return NULL;
+}
@@ -0,0 +1,79 @@
+/*
+ * potfile.h
+ *      CSSE2310 - Assignment Four
+ *
+ *      Written by Alex Viller, a.viller@uqconnect.edu.au
+ *
+ * A persistent store of every hash crackserver has cracked, so they can be
+ * answered straight away, even after a restart.
+ *
+ * The pot file itself is append only text, one "hash:plaintext" line per
+ * crack. Next to it, at the same path with POT_INDEX_SUFFIX added, is an
+ * index: a PotIndexHeader followed by PotRecords sorted by hash, which is
+ * mmapped and binary searched. Cracks added since the index was built are
+ * kept in memory until a background thread rebuilds the index from the
+ * whole pot file, leaving out any duplicates.
+ *
+ */
+#ifndef POTFILE_H
+#define POTFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+// The length of a hash stored in a pot file
+#define POT_HASH_LEN 13
+// The longest plain text stored in a pot file, matching the longest word
+//      crackserver will test
+#define POT_WORD_LEN 8
+// Added to the pot file's path to give its index's path
+#define POT_INDEX_SUFFIX ".idx"
+// The first bytes of every index file
+#define POT_MAGIC "crackpot"
+// How many cracks may be added before the index is rebuilt
+#define POT_COMPACT_THRESHOLD 256
+// How long, in seconds, cracks may wait to be indexed if there are fewer
+//      than POT_COMPACT_THRESHOLD of them
+#define POT_COMPACT_SECS 60
+
+// struct for containing one cracked hash, null terminated and padded
+typedef struct {
+    char hash[POT_HASH_LEN + 1];
+    char plaintext[POT_WORD_LEN + 2];
+} PotRecord;
+
+// struct for containing the header of an index file. potLength is how much
+// of the pot file the index covers.
+typedef struct {
+    char magic[sizeof(POT_MAGIC) - 1];
+    uint64_t potLength;
+    uint64_t numRecords;
+} PotIndexHeader;
+
+// struct for containing an open pot file. The mapped index is guarded by
+// indexLock, and everything else by lock.
+typedef struct {
+    char* path;
+    char* indexPath;
+    int fd;
+    pthread_rwlock_t indexLock;
+    PotIndexHeader* index;
+    size_t indexSize;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    PotRecord* recent;
+    int numRecent;
+    int recentCapacity;
+    bool closing;
+    pthread_t compactor;
+} Potfile;
+
+/* Function Prototypes */
+Potfile* potfile_open(const char* path);
+bool potfile_lookup(Potfile* pot, const char* hash, char* plaintext);
+void potfile_add(Potfile* pot, const char* hash, const char* plaintext);
+void potfile_close(Potfile* pot);
+
+#endif
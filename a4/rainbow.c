@@ -0,0 +1,335 @@
+/*
+ * rainbow.c
+ *      CSSE2310 - Assignment Four
+ *
+ *      Written by Alex Viller, a.viller@uqconnect.edu.au
+ *
+ * Rainbow table chains, lookups and table files, see rainbow.h
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rainbow.h"
+
+// The FNV-1a offset basis and prime, used to fold a hash into a number
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+// An odd constant which spreads the step number over all 64 bits
+#define STEP_MIX 0x9e3779b97f4a7c15ULL
+
+/* rainbow_init()
+ * --------------
+ * Sets up an empty set of tables for a keyspace.
+ *
+ * set: The set to set up
+ *
+ * charset: The characters plain texts are made of, without repeats
+ *
+ * maxLen: The longest plain text, at most RAINBOW_MAX_LEN
+ *
+ * chainLen: The number of steps in each chain
+ *
+ * Returns: false if any of the arguments are out of range
+ */
+bool rainbow_init(RainbowSet* set, const char* charset, int maxLen,
+        int chainLen) {
+    memset(set, 0, sizeof(RainbowSet));
+    size_t charsetLen = strlen(charset);
+    if (charsetLen == 0 || charsetLen > RAINBOW_MAX_CHARSET || maxLen < 1 ||
+            maxLen > RAINBOW_MAX_LEN || chainLen < 1) {
+        return false;
+    }
+    for (size_t i = 0; i < charsetLen; i++) {
+        if (strchr(charset + i + 1, charset[i]) != NULL) {
+            return false; // a repeat would number one string twice
+        }
+    }
+    memcpy(set->header.magic, RAINBOW_MAGIC, sizeof(set->header.magic));
+    set->header.maxLen = maxLen;
+    set->header.chainLen = chainLen;
+    set->header.charsetLen = charsetLen;
+    memcpy(set->header.charset, charset, charsetLen);
+    uint64_t count = 1;
+    for (int length = 1; length <= maxLen; length++) {
+        count *= charsetLen;
+        set->keyspace += count;
+    }
+    return true;
+}
+
+/* rainbow_plaintext()
+ * -------------------
+ * Finds the string with a given number in the keyspace.
+ *
+ * set: The set whose keyspace to use
+ *
+ * index: The number of the string, less than the keyspace
+ *
+ * plaintext: Where to store the string, at least RAINBOW_MAX_LEN + 1 bytes
+ *
+ * Returns: void
+ */
+void rainbow_plaintext(const RainbowSet* set, uint64_t index,
+        char* plaintext) {
+    uint64_t base = set->header.charsetLen;
+    uint64_t count = base;
+    int length = 1;
+    while (index >= count) { // skip past all of the shorter strings
+        index -= count;
+        count *= base;
+        length++;
+    }
+    for (int i = 0; i < length; i++) {
+        plaintext[i] = set->header.charset[index % base];
+        index /= base;
+    }
+    plaintext[length] = '\0';
+}
+
+/* rainbow_reduce()
+ * ----------------
+ * The reduction function, which turns a hash back into a number in the
+ * keyspace. It is different for every step of a chain.
+ *
+ * set: The set whose keyspace to use
+ *
+ * hash: The RAINBOW_HASH_LEN character hash to reduce
+ *
+ * step: Which step of the chain this is
+ *
+ * Returns: A number in the keyspace
+ */
+uint64_t rainbow_reduce(const RainbowSet* set, const char* hash, int step) {
+    uint64_t value = FNV_OFFSET;
+    for (int i = RAINBOW_SALT_LEN; i < RAINBOW_HASH_LEN; i++) {
+        value = (value ^ (unsigned char)hash[i]) * FNV_PRIME;
+    }
+    value ^= (step + 1) * STEP_MIX;
+    // finish mixing, so that neighbouring steps reduce far apart
+    value ^= value >> 31;
+    value *= STEP_MIX;
+    value ^= value >> 29;
+    return value % set->keyspace;
+}
+
+/* rainbow_walk()
+ * --------------
+ * Follows a chain through some of its steps.
+ *
+ * set: The set whose keyspace to use
+ *
+ * salt: The salt of the table the chain is in
+ *
+ * index: The number the chain is at before step from
+ *
+ * from: The first step to take
+ *
+ * to: The step to stop before
+ *
+ * data: The crypt_r() state to use
+ *
+ * Returns: The number the chain is at before step to
+ */
+uint64_t rainbow_walk(const RainbowSet* set, const char* salt, uint64_t index,
+        int from, int to, struct crypt_data* data) {
+    char plaintext[RAINBOW_MAX_LEN + 1];
+    for (int step = from; step < to; step++) {
+        rainbow_plaintext(set, index, plaintext);
+        index = rainbow_reduce(set, crypt_r(plaintext, salt, data), step);
+    }
+    return index;
+}
+
+/* compare_chains()
+ * ----------------
+ * qsort() comparison of two chains by their ends.
+ *
+ * a: The first chain
+ *
+ * b: The second chain
+ *
+ * Returns: Less than, equal to or greater than 0 as a ends before, with or
+ *      after b
+ */
+int compare_chains(const void* a, const void* b) {
+    uint64_t endA = ((const RainbowChain*)a)->end;
+    uint64_t endB = ((const RainbowChain*)b)->end;
+    return endA < endB ? -1 : endA > endB;
+}
+
+/* rainbow_lookup()
+ * ----------------
+ * Searches the table for a hash's salt for its plain text. The hash is
+ * assumed to be at each step of a chain in turn, last step first, and walked
+ * to the chain's end; any chain ending there is then walked from its start
+ * to check it really does contain the hash. This takes up to chainLen
+ * squared over two encryptions, plus any false alarms.
+ *
+ * set: The tables to search
+ *
+ * hash: The RAINBOW_HASH_LEN character hash to search for
+ *
+ * plaintext: Where to store the plain text, at least RAINBOW_MAX_LEN + 1
+ *      bytes
+ *
+ * data: The crypt_r() state to use
+ *
+ * Returns: true if the plain text was found
+ */
+bool rainbow_lookup(const RainbowSet* set, const char* hash, char* plaintext,
+        struct crypt_data* data) {
+    const RainbowTable* table = NULL;
+    for (int i = 0; i < set->numTables && table == NULL; i++) {
+        if (strncmp(set->tables[i].salt, hash, RAINBOW_SALT_LEN) == 0) {
+            table = &set->tables[i];
+        }
+    }
+    if (table == NULL || strlen(hash) != RAINBOW_HASH_LEN) {
+        return false;
+    }
+    int chainLen = set->header.chainLen;
+    for (int position = chainLen - 1; position >= 0; position--) {
+        uint64_t end = rainbow_walk(set, table->salt,
+                rainbow_reduce(set, hash, position), position + 1, chainLen,
+                data);
+        // find the first chain with this end, then try every one of them
+        uint64_t low = 0, high = table->numChains;
+        while (low < high) {
+            uint64_t middle = low + (high - low) / 2;
+            if (table->chains[middle].end < end) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        for (; low < table->numChains && table->chains[low].end == end;
+                low++) {
+            uint64_t candidate = rainbow_walk(set, table->salt,
+                    table->chains[low].start, 0, position, data);
+            rainbow_plaintext(set, candidate, plaintext);
+            if (strcmp(crypt_r(plaintext, table->salt, data), hash) == 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/* rainbow_load()
+ * --------------
+ * Maps a table file made by rainbow_save().
+ *
+ * set: Where to store the tables
+ *
+ * path: The table file
+ *
+ * Returns: false if the file could not be read or is not a valid table file
+ */
+bool rainbow_load(RainbowSet* set, const char* path) {
+    memset(set, 0, sizeof(RainbowSet));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    char* mapping = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(RainbowHeader)) {
+        mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    RainbowHeader header;
+    memcpy(&header, mapping, sizeof(header));
+    char charset[RAINBOW_MAX_CHARSET + 1] = {0};
+    memcpy(charset, header.charset, header.charsetLen < RAINBOW_MAX_CHARSET ?
+            header.charsetLen : RAINBOW_MAX_CHARSET);
+    if (memcmp(header.magic, RAINBOW_MAGIC, sizeof(header.magic)) != 0 ||
+            strlen(charset) != header.charsetLen ||
+            !rainbow_init(set, charset, header.maxLen, header.chainLen)) {
+        munmap(mapping, info.st_size);
+        return false;
+    }
+    set->mapping = mapping;
+    set->mappingSize = info.st_size;
+    set->tables = malloc(sizeof(RainbowTable) * (header.numTables + 1));
+    size_t offset = sizeof(RainbowHeader);
+    for (uint32_t i = 0; i < header.numTables; i++) {
+        RainbowTableHeader tableHeader;
+        if (offset + sizeof(tableHeader) > set->mappingSize) {
+            rainbow_free(set);
+            return false;
+        }
+        memcpy(&tableHeader, mapping + offset, sizeof(tableHeader));
+        offset += sizeof(tableHeader);
+        if (tableHeader.numChains > (set->mappingSize - offset) /
+                sizeof(RainbowChain)) {
+            rainbow_free(set);
+            return false;
+        }
+        RainbowTable* table = &set->tables[set->numTables++];
+        memcpy(table->salt, tableHeader.salt, RAINBOW_SALT_LEN);
+        table->salt[RAINBOW_SALT_LEN] = '\0';
+        table->numChains = tableHeader.numChains;
+        table->chains = (RainbowChain*)(mapping + offset);
+        offset += sizeof(RainbowChain) * tableHeader.numChains;
+    }
+    set->header.numTables = set->numTables;
+    return true;
+}
+
+/* rainbow_save()
+ * --------------
+ * Writes a set of tables, each already sorted by chain end, to a file.
+ *
+ * set: The tables to write
+ *
+ * path: The file to write them to
+ *
+ * Returns: false if the file could not be written
+ */
+bool rainbow_save(const RainbowSet* set, const char* path) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        return false;
+    }
+    RainbowHeader header = set->header;
+    header.numTables = set->numTables;
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (int i = 0; i < set->numTables && success; i++) {
+        RainbowTableHeader tableHeader = {.padding = 0,
+                .numChains = set->tables[i].numChains};
+        memset(tableHeader.salt, 0, sizeof(tableHeader.salt));
+        memcpy(tableHeader.salt, set->tables[i].salt, RAINBOW_SALT_LEN);
+        success = fwrite(&tableHeader, sizeof(tableHeader), 1, file) == 1 &&
+                fwrite(set->tables[i].chains, sizeof(RainbowChain),
+                set->tables[i].numChains, file) == set->tables[i].numChains;
+    }
+    return fclose(file) == 0 && success;
+}
+
+/* rainbow_free()
+ * --------------
+ * Frees a set of tables, unmapping its table file if it was loaded from one.
+ *
+ * set: The tables to free
+ *
+ * Returns: void
+ */
+void rainbow_free(RainbowSet* set) {
+    if (set->mapping != NULL) {
+        munmap(set->mapping, set->mappingSize);
+    } else {
+        for (int i = 0; i < set->numTables; i++) {
+            free(set->tables[i].chains);
+        }
+    }
+    free(set->tables);
+    memset(set, 0, sizeof(RainbowSet));
+}
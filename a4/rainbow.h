@@ -0,0 +1,98 @@
+/*
+ * rainbow.h
+ *      CSSE2310 - Assignment Four
+ *
+ *      Written by Alex Viller, a.viller@uqconnect.edu.au
+ *
+ * Rainbow tables, which trade memory for time when cracking short passwords
+ * that are not in any dictionary. They are made by crackrainbow and searched
+ * by crackserver --rainbow.
+ *
+ * The keyspace is every string of 1 to maxLen characters from a charset,
+ * numbered shortest first. A chain starts at a number, and each of its
+ * chainLen steps encrypts that number's string with the table's salt and
+ * reduces the hash back to a number, using the step number so that chains
+ * which collide at different steps do not merge. Only the start and end of
+ * each chain are kept, sorted by end. More chains, or longer ones, cover
+ * more of the keyspace; longer chains also make each lookup slower.
+ *
+ * A table file is a RainbowHeader, followed for each salt by a
+ * RainbowTableHeader and then its RainbowChains. Numbers are in host byte
+ * order, since the file is only meant for the machine which made it.
+ *
+ */
+#ifndef RAINBOW_H
+#define RAINBOW_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <crypt.h>
+
+// The first bytes of every table file
+#define RAINBOW_MAGIC "crackrbw"
+// The longest plain text a table can cover
+#define RAINBOW_MAX_LEN 8
+// The most characters a table's charset may have
+#define RAINBOW_MAX_CHARSET 64
+// The length of a salt
+#define RAINBOW_SALT_LEN 2
+// The length of a hash, including its salt
+#define RAINBOW_HASH_LEN 13
+
+// struct for containing the header of a table file
+typedef struct {
+    char magic[sizeof(RAINBOW_MAGIC) - 1];
+    uint32_t maxLen;
+    uint32_t chainLen;
+    uint32_t charsetLen;
+    uint32_t numTables;
+    char charset[RAINBOW_MAX_CHARSET];
+} RainbowHeader;
+
+// struct for containing the header of the table for one salt
+typedef struct {
+    char salt[RAINBOW_SALT_LEN + 2];
+    uint32_t padding;
+    uint64_t numChains;
+} RainbowTableHeader;
+
+// struct for containing the two ends of a chain
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+} RainbowChain;
+
+// struct for containing the table for one salt
+typedef struct {
+    char salt[RAINBOW_SALT_LEN + 1];
+    uint64_t numChains;
+    RainbowChain* chains;
+} RainbowTable;
+
+// struct for containing a set of tables sharing a keyspace, either loaded
+// from a table file (and mapped) or being made
+typedef struct {
+    RainbowHeader header;
+    uint64_t keyspace;
+    int numTables;
+    RainbowTable* tables;
+    void* mapping;
+    size_t mappingSize;
+} RainbowSet;
+
+/* Function Prototypes */
+bool rainbow_init(RainbowSet* set, const char* charset, int maxLen,
+        int chainLen);
+void rainbow_plaintext(const RainbowSet* set, uint64_t index, char* plaintext);
+uint64_t rainbow_reduce(const RainbowSet* set, const char* hash, int step);
+uint64_t rainbow_walk(const RainbowSet* set, const char* salt, uint64_t index,
+        int from, int to, struct crypt_data* data);
+int compare_chains(const void* a, const void* b);
+bool rainbow_lookup(const RainbowSet* set, const char* hash, char* plaintext,
+        struct crypt_data* data);
+bool rainbow_load(RainbowSet* set, const char* path);
+bool rainbow_save(const RainbowSet* set, const char* path);
+void rainbow_free(RainbowSet* set);
+
+#endif
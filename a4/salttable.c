@@ -0,0 +1,269 @@
+/*
+ * salttable.c
+ *      CSSE2310 - Assignment Four
+ *
+ *      Written by Alex Viller, a.viller@uqconnect.edu.au
+ *
+ * Salt tables of dictionary hashes, see salttable.h
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "salttable.h"
+
+// The FNV-1a offset basis and prime, for fingerprinting dictionaries
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+// Added to a table's path while it is being written
+#define TEMP_SUFFIX ".tmp"
+
+/* Function Prototypes */
+int compare_entries(const void* a, const void* b);
+
+/* salt_table_fingerprint()
+ * ------------------------
+ * Fingerprints a dictionary, so a table can tell if it was made from it.
+ *
+ * words: The dictionary's words
+ *
+ * numWords: The number of words
+ *
+ * Returns: The fingerprint
+ */
+uint64_t salt_table_fingerprint(char** words, int numWords) {
+    uint64_t hash = FNV_OFFSET;
+    for (int i = 0; i < numWords; i++) {
+        // include each terminator so that word boundaries count
+        for (const char* c = words[i]; ; c++) {
+            hash = (hash ^ (unsigned char)*c) * FNV_PRIME;
+            if (*c == '\0') {
+                break;
+            }
+        }
+    }
+    return hash;
+}
+
+/* salt_table_size()
+ * -----------------
+ * Works out how much memory a table of a dictionary takes.
+ *
+ * numWords: The number of words in the dictionary
+ *
+ * Returns: The size in bytes
+ */
+size_t salt_table_size(int numWords) {
+    return sizeof(SaltTableHeader) + sizeof(SaltEntry) * (size_t)numWords;
+}
+
+/* salt_table_create()
+ * -------------------
+ * Makes an empty table, to be filled in with salt_table_fill().
+ *
+ * salt: The table's salt
+ *
+ * dictHash: The fingerprint of the dictionary the table is for
+ *
+ * numWords: The number of words in the dictionary
+ *
+ * Returns: The table, or NULL if there was no memory for it
+ */
+SaltTable* salt_table_create(const char* salt, uint64_t dictHash,
+        int numWords) {
+    SaltTable* table = malloc(sizeof(SaltTable));
+    table->size = salt_table_size(numWords);
+    table->header = malloc(table->size);
+    if (table->header == NULL) {
+        free(table);
+        return NULL;
+    }
+    memset(table->header, 0, sizeof(SaltTableHeader));
+    memcpy(table->header->magic, SALT_TABLE_MAGIC,
+            sizeof(table->header->magic));
+    table->header->dictHash = dictHash;
+    table->header->numWords = numWords;
+    memcpy(table->header->salt, salt, SALT_TABLE_SALT_LEN);
+    table->entries = (SaltEntry*)(table->header + 1);
+    table->mapped = false;
+    table->filled = 0;
+    return table;
+}
+
+/* salt_table_fill()
+ * -----------------
+ * Hashes the next words of the dictionary into a table being made, so that
+ * a table can be made a little at a time.
+ *
+ * table: The table
+ *
+ * words: The dictionary's words
+ *
+ * count: The most words to hash
+ *
+ * cryptData: The crypt_r() state to hash with
+ *
+ * Returns: The number of words still to be hashed
+ */
+int salt_table_fill(SaltTable* table, char** words, int count,
+        struct crypt_data* cryptData) {
+    int numWords = table->header->numWords;
+    int end = table->filled + count < numWords ? table->filled + count :
+            numWords;
+    for (int i = table->filled; i < end; i++) {
+        SaltEntry* entry = &table->entries[i];
+        const char* hash = crypt_r(words[i], table->header->salt, cryptData);
+        memcpy(entry->hash, hash + SALT_TABLE_SALT_LEN, SALT_TABLE_HASH_LEN);
+        entry->padding = 0;
+        entry->word = i;
+    }
+    table->filled = end;
+    return numWords - end;
+}
+
+/* compare_entries()
+ * -----------------
+ * Orders two table entries by hash, for qsort() and bsearch().
+ *
+ * a: The first entry
+ *
+ * b: The second entry
+ *
+ * Returns: Less than, equal to or greater than 0 as a is before, the same as
+ *      or after b
+ */
+int compare_entries(const void* a, const void* b) {
+    return memcmp(((const SaltEntry*)a)->hash, ((const SaltEntry*)b)->hash,
+            SALT_TABLE_HASH_LEN);
+}
+
+/* salt_table_finish()
+ * -------------------
+ * Sorts a table once every word has been hashed, ready to be looked up.
+ *
+ * table: The table
+ *
+ * Returns: void
+ */
+void salt_table_finish(SaltTable* table) {
+    qsort(table->entries, table->header->numWords, sizeof(SaltEntry),
+            compare_entries);
+}
+
+/* salt_table_save()
+ * -----------------
+ * Writes a finished table to a file. It is written beside the file first
+ * and then renamed over it, so a half written table is never loaded.
+ *
+ * table: The table
+ *
+ * path: The file to write
+ *
+ * Returns: false if the file could not be written
+ */
+bool salt_table_save(const SaltTable* table, const char* path) {
+    char* tempPath = malloc(strlen(path) + sizeof(TEMP_SUFFIX));
+    sprintf(tempPath, "%s%s", path, TEMP_SUFFIX);
+    FILE* file = fopen(tempPath, "w");
+    bool saved = file != NULL &&
+            fwrite(table->header, 1, table->size, file) == table->size;
+    if (file != NULL && fclose(file) != 0) {
+        saved = false;
+    }
+    if (saved) {
+        saved = rename(tempPath, path) == 0;
+    }
+    if (!saved) {
+        unlink(tempPath);
+    }
+    free(tempPath);
+    return saved;
+}
+
+/* salt_table_load()
+ * -----------------
+ * Maps a table file made by salt_table_save().
+ *
+ * path: The file to load
+ *
+ * dictHash: The fingerprint of the dictionary the table must be for
+ *
+ * numWords: The number of words in that dictionary
+ *
+ * Returns: The table, or NULL if the file could not be read, is not a table
+ *      or is for another dictionary
+ */
+SaltTable* salt_table_load(const char* path, uint64_t dictHash,
+        int numWords) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat info;
+    void* mapping = MAP_FAILED;
+    if (fstat(fd, &info) == 0 &&
+            (size_t)info.st_size == salt_table_size(numWords)) {
+        mapping = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return NULL;
+    }
+    SaltTableHeader* header = mapping;
+    if (memcmp(header->magic, SALT_TABLE_MAGIC, sizeof(header->magic)) != 0 ||
+            header->dictHash != dictHash ||
+            header->numWords != (uint32_t)numWords) {
+        munmap(mapping, info.st_size);
+        return NULL;
+    }
+    SaltTable* table = malloc(sizeof(SaltTable));
+    table->header = header;
+    table->entries = (SaltEntry*)(header + 1);
+    table->size = info.st_size;
+    table->mapped = true;
+    table->filled = numWords;
+    return table;
+}
+
+/* salt_table_lookup()
+ * -------------------
+ * Finds the dictionary word with a hash in a finished table.
+ *
+ * table: The table
+ *
+ * hash: The hash, without its salt
+ *
+ * Returns: The position of the word in the dictionary, or -1 if no word has
+ *      that hash
+ */
+int salt_table_lookup(const SaltTable* table, const char* hash) {
+    if (strlen(hash) != SALT_TABLE_HASH_LEN) {
+        return -1;
+    }
+    SaltEntry key;
+    memcpy(key.hash, hash, SALT_TABLE_HASH_LEN);
+    const SaltEntry* found = bsearch(&key, table->entries,
+            table->header->numWords, sizeof(SaltEntry), compare_entries);
+    return found != NULL ? (int)found->word : -1;
+}
+
+/* salt_table_free()
+ * -----------------
+ * Frees a table, unmapping it if it was loaded.
+ *
+ * table: The table
+ *
+ * Returns: void
+ */
+void salt_table_free(SaltTable* table) {
+    if (table->mapped) {
+        munmap(table->header, table->size);
+    } else {
+        free(table->header);
+    }
+    free(table);
+}
@@ -0,0 +1,74 @@
+/*
+ * salttable.h
+ *      CSSE2310 - Assignment Four
+ *
+ *      Written by Alex Viller, a.viller@uqconnect.edu.au
+ *
+ * Salt tables: the hash of every dictionary word with one salt, sorted so
+ * that cracking a hash with that salt is a binary search instead of a sweep.
+ * crackserver --precompute makes them for its most requested salts while it
+ * is idle, and keeps them in a directory so they outlast a restart.
+ *
+ * A table file is a SaltTableHeader followed by numWords SaltEntries sorted
+ * by hash. The header records a fingerprint of the dictionary the table was
+ * made from, so a table made from another dictionary is never used. Numbers
+ * are in host byte order, since the file is only meant for the machine which
+ * made it.
+ *
+ */
+#ifndef SALTTABLE_H
+#define SALTTABLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <crypt.h>
+
+// The first bytes of every table file
+#define SALT_TABLE_MAGIC "crackslt"
+// The length of a salt
+#define SALT_TABLE_SALT_LEN 2
+// The length of a hash once its salt is left off
+#define SALT_TABLE_HASH_LEN 11
+
+// struct for containing the header of a table file
+typedef struct {
+    char magic[sizeof(SALT_TABLE_MAGIC) - 1];
+    uint64_t dictHash;
+    uint32_t numWords;
+    char salt[SALT_TABLE_SALT_LEN + 2];
+} SaltTableHeader;
+
+// struct for containing the hash of one dictionary word, without its salt
+// and not terminated, and the word's position in the dictionary
+typedef struct {
+    char hash[SALT_TABLE_HASH_LEN];
+    uint8_t padding;
+    uint32_t word;
+} SaltEntry;
+
+// struct for containing a table, either loaded from a file (and mapped) or
+// being made, in which case filled counts the words hashed so far
+typedef struct {
+    SaltTableHeader* header;
+    SaltEntry* entries;
+    size_t size;
+    bool mapped;
+    int filled;
+} SaltTable;
+
+/* Function Prototypes */
+uint64_t salt_table_fingerprint(char** words, int numWords);
+size_t salt_table_size(int numWords);
+SaltTable* salt_table_create(const char* salt, uint64_t dictHash,
+        int numWords);
+int salt_table_fill(SaltTable* table, char** words, int count,
+        struct crypt_data* cryptData);
+void salt_table_finish(SaltTable* table);
+bool salt_table_save(const SaltTable* table, const char* path);
+SaltTable* salt_table_load(const char* path, uint64_t dictHash,
+        int numWords);
+int salt_table_lookup(const SaltTable* table, const char* hash);
+void salt_table_free(SaltTable* table);
+
+#endif
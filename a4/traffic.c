@@ -0,0 +1,155 @@
+/*
+ * traffic.c
+ *      CSSE2310 - Assignment Four
+ *
+ *      Written by Alex Viller, a.viller@uqconnect.edu.au
+ *
+ * Recordings of crackserver requests, see traffic.h
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "traffic.h"
+
+// The number of microseconds in a second and nanoseconds in a microsecond
+#define US_PER_SEC 1000000LL
+#define NS_PER_US 1000
+
+/* traffic_open()
+ * --------------
+ * Starts a new recording, replacing anything already in the file.
+ *
+ * path: The file to record to
+ *
+ * nowUs: The current time in microseconds, on the clock that the arrival
+ *      times given to traffic_add() are on
+ *
+ * Returns: The recording, or NULL if the file could not be written
+ */
+TrafficLog* traffic_open(const char* path, long long nowUs) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        return NULL;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    TrafficHeader header = {.startUs = now.tv_sec * US_PER_SEC +
+            now.tv_nsec / NS_PER_US};
+    memcpy(header.magic, TRAFFIC_MAGIC, sizeof(header.magic));
+    if (fwrite(&header, sizeof(header), 1, file) != 1 || fflush(file) != 0) {
+        fclose(file);
+        return NULL;
+    }
+    TrafficLog* recording = malloc(sizeof(TrafficLog));
+    recording->file = file;
+    recording->startUs = recording->flushedUs = nowUs;
+    pthread_mutex_init(&recording->lock, NULL);
+    return recording;
+}
+
+/* traffic_add()
+ * -------------
+ * Adds a finished request to a recording. The file is flushed at most every
+ * TRAFFIC_FLUSH_US, so a recording may be read while the server runs.
+ *
+ * recording: The recording
+ *
+ * connection: The number of the connection the request arrived on
+ *
+ * arrivalUs: When the request arrived, in microseconds on the same clock as
+ *      traffic_open() was given
+ *
+ * latencyUs: How long the request took to answer
+ *
+ * lane: The lane the request ran in
+ *
+ * request: The request as a text protocol line, not necessarily terminated
+ *
+ * length: The length of the request, cut to TRAFFIC_MAX_REQUEST
+ *
+ * Returns: void
+ */
+void traffic_add(TrafficLog* recording, uint32_t connection,
+        long long arrivalUs, long long latencyUs, int lane,
+        const char* request, size_t length) {
+    TrafficEntry entry = {.arrivalUs = arrivalUs - recording->startUs,
+            .connection = connection,
+            .latencyUs = latencyUs > UINT32_MAX ? UINT32_MAX : latencyUs,
+            .length = length > TRAFFIC_MAX_REQUEST ? TRAFFIC_MAX_REQUEST :
+            length, .lane = lane};
+    pthread_mutex_lock(&recording->lock);
+    fwrite(&entry, sizeof(entry), 1, recording->file);
+    fwrite(request, 1, entry.length, recording->file);
+    if (arrivalUs + latencyUs - recording->flushedUs >= TRAFFIC_FLUSH_US) {
+        fflush(recording->file);
+        recording->flushedUs = arrivalUs + latencyUs;
+    }
+    pthread_mutex_unlock(&recording->lock);
+}
+
+/* traffic_flush()
+ * ---------------
+ * Writes everything recorded so far out to the file.
+ *
+ * recording: The recording
+ *
+ * Returns: void
+ */
+void traffic_flush(TrafficLog* recording) {
+    pthread_mutex_lock(&recording->lock);
+    fflush(recording->file);
+    pthread_mutex_unlock(&recording->lock);
+}
+
+/* traffic_close()
+ * ---------------
+ * Finishes a recording.
+ *
+ * recording: The recording, which is freed
+ *
+ * Returns: void
+ */
+void traffic_close(TrafficLog* recording) {
+    fclose(recording->file);
+    pthread_mutex_destroy(&recording->lock);
+    free(recording);
+}
+
+/* traffic_read_header()
+ * ---------------------
+ * Reads the start of a recording.
+ *
+ * file: The recording, at its start
+ *
+ * header: Where to store the header
+ *
+ * Returns: false if the file is not a recording
+ */
+bool traffic_read_header(FILE* file, TrafficHeader* header) {
+    return fread(header, sizeof(TrafficHeader), 1, file) == 1 &&
+            memcmp(header->magic, TRAFFIC_MAGIC, sizeof(header->magic)) == 0;
+}
+
+/* traffic_read()
+ * --------------
+ * Reads the next request from a recording.
+ *
+ * file: The recording, after its header
+ *
+ * entry: Where to store the entry
+ *
+ * request: Where to store the request, null terminated, at least
+ *      TRAFFIC_MAX_REQUEST + 1 bytes
+ *
+ * Returns: false at the end of the recording, or if it is cut short
+ */
+bool traffic_read(FILE* file, TrafficEntry* entry, char* request) {
+    if (fread(entry, sizeof(TrafficEntry), 1, file) != 1 ||
+            entry->length > TRAFFIC_MAX_REQUEST ||
+            fread(request, 1, entry->length, file) != entry->length) {
+        return false;
+    }
+    request[entry->length] = '\0';
+    return true;
+}
@@ -0,0 +1,70 @@
+/*
+ * traffic.h
+ *      CSSE2310 - Assignment Four
+ *
+ *      Written by Alex Viller, a.viller@uqconnect.edu.au
+ *
+ * Recordings of the requests a crackserver handles, made by its --record
+ * option and played back by crackreplay.
+ *
+ * A recording is a TrafficHeader followed by one entry per request, in the
+ * order the requests finished. Each entry is a TrafficEntry followed by
+ * length bytes of the request as a text protocol line, without its new line
+ * (binary protocol requests are recorded as the equivalent text line).
+ * Arrival times are in microseconds since the recording began. All numbers
+ * are in the byte order of the recording host.
+ *
+ */
+#ifndef TRAFFIC_H
+#define TRAFFIC_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+// The magic number at the start of every recording
+#define TRAFFIC_MAGIC "crackrec"
+// The longest request a recording holds; longer ones are cut short
+#define TRAFFIC_MAX_REQUEST 1024
+// How often, in microseconds, a recording is flushed to its file
+#define TRAFFIC_FLUSH_US 1000000
+
+// struct for containing the start of a recording. startUs is when it began,
+// in microseconds since the epoch.
+typedef struct {
+    char magic[8];
+    int64_t startUs;
+} TrafficHeader;
+
+// struct for containing one recorded request. latencyUs is how long the
+// server took to answer it, and lane which lane it ran in.
+typedef struct {
+    int64_t arrivalUs;
+    uint32_t connection;
+    uint32_t latencyUs;
+    uint16_t length;
+    uint8_t lane;
+    uint8_t padding[5];
+} TrafficEntry;
+
+// struct for containing a recording being made. Entries may be added from
+// any thread.
+typedef struct {
+    FILE* file;
+    long long startUs;
+    long long flushedUs;
+    pthread_mutex_t lock;
+} TrafficLog;
+
+/* Function Prototypes */
+TrafficLog* traffic_open(const char* path, long long nowUs);
+void traffic_add(TrafficLog* recording, uint32_t connection,
+        long long arrivalUs, long long latencyUs, int lane,
+        const char* request, size_t length);
+void traffic_flush(TrafficLog* recording);
+void traffic_close(TrafficLog* recording);
+bool traffic_read_header(FILE* file, TrafficHeader* header);
+bool traffic_read(FILE* file, TrafficEntry* entry, char* request);
+
+#endif